@@ -0,0 +1,122 @@
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+std::atomic<int64_t> s_liveBytes{0};
+
+// Every allocation is prefixed by a header recording its size and where the underlying block starts
+struct AllocationHeader {
+    void* m_block;
+    std::size_t m_bytes;
+};
+
+void* CountedNew (std::size_t bytes, std::size_t alignment) {
+    alignment = std::max(alignment, alignof(AllocationHeader));
+    uint8_t* block = static_cast<uint8_t*>(std::malloc(bytes + alignment + sizeof(AllocationHeader)));
+    if (block == nullptr) {
+        throw std::bad_alloc();
+    }
+    const uintptr_t start = reinterpret_cast<uintptr_t>(block) + sizeof(AllocationHeader);
+    uint8_t* data = reinterpret_cast<uint8_t*>((start + alignment - 1) / alignment * alignment);
+    AllocationHeader* header = reinterpret_cast<AllocationHeader*>(data) - 1;
+    header->m_block = block;
+    header->m_bytes = bytes;
+    s_liveBytes.fetch_add(static_cast<int64_t>(bytes), std::memory_order_relaxed);
+    return data;
+}
+
+// The nothrow forms must come from here too, since the replaced delete expects the header
+void* CountedNewNothrow (std::size_t bytes, std::size_t alignment) noexcept {
+    try {
+        return CountedNew(bytes, alignment);
+    }
+    catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+void CountedDelete (void* data) {
+    if (data == nullptr) {
+        return;
+    }
+    AllocationHeader* header = static_cast<AllocationHeader*>(data) - 1;
+    s_liveBytes.fetch_sub(static_cast<int64_t>(header->m_bytes), std::memory_order_relaxed);
+    std::free(header->m_block);
+}
+
+} // namespace
+
+void* operator new (std::size_t bytes) { return CountedNew(bytes, alignof(std::max_align_t)); }
+void* operator new[] (std::size_t bytes) { return CountedNew(bytes, alignof(std::max_align_t)); }
+void* operator new (std::size_t bytes, std::align_val_t alignment) { return CountedNew(bytes, static_cast<std::size_t>(alignment)); }
+void* operator new[] (std::size_t bytes, std::align_val_t alignment) { return CountedNew(bytes, static_cast<std::size_t>(alignment)); }
+void* operator new (std::size_t bytes, const std::nothrow_t&) noexcept { return CountedNewNothrow(bytes, alignof(std::max_align_t)); }
+void* operator new[] (std::size_t bytes, const std::nothrow_t&) noexcept { return CountedNewNothrow(bytes, alignof(std::max_align_t)); }
+void* operator new (std::size_t bytes, std::align_val_t alignment, const std::nothrow_t&) noexcept { return CountedNewNothrow(bytes, static_cast<std::size_t>(alignment)); }
+void* operator new[] (std::size_t bytes, std::align_val_t alignment, const std::nothrow_t&) noexcept { return CountedNewNothrow(bytes, static_cast<std::size_t>(alignment)); }
+void operator delete (void* data) noexcept { CountedDelete(data); }
+void operator delete[] (void* data) noexcept { CountedDelete(data); }
+void operator delete (void* data, std::size_t) noexcept { CountedDelete(data); }
+void operator delete[] (void* data, std::size_t) noexcept { CountedDelete(data); }
+void operator delete (void* data, std::align_val_t) noexcept { CountedDelete(data); }
+void operator delete[] (void* data, std::align_val_t) noexcept { CountedDelete(data); }
+void operator delete (void* data, std::size_t, std::align_val_t) noexcept { CountedDelete(data); }
+void operator delete[] (void* data, std::size_t, std::align_val_t) noexcept { CountedDelete(data); }
+void operator delete (void* data, const std::nothrow_t&) noexcept { CountedDelete(data); }
+void operator delete[] (void* data, const std::nothrow_t&) noexcept { CountedDelete(data); }
+void operator delete (void* data, std::align_val_t, const std::nothrow_t&) noexcept { CountedDelete(data); }
+void operator delete[] (void* data, std::align_val_t, const std::nothrow_t&) noexcept { CountedDelete(data); }
+
+namespace bench {
+
+int64_t LiveBytes () {
+    return s_liveBytes.load(std::memory_order_relaxed);
+}
+
+void Runner::Measure (Result result, const std::function<double(Result&)>& run) {
+    double bestNs = 0.0;
+    for (uint32_t i = 0; i < std::max(m_options.m_repeats, 1u); ++i) {
+        const double ns = run(result);
+        bestNs = (i == 0) ? ns : std::min(bestNs, ns);
+    }
+    result.m_nsPerEntity = bestNs / std::max(result.m_entities, 1u);
+    m_results.push_back(result);
+
+    if (!m_options.m_json) {
+        char bytes[32] = "-";
+        if (result.m_bytesPerEntity) {
+            std::snprintf(bytes, sizeof(bytes), "%.1f", *result.m_bytesPerEntity);
+        }
+        std::printf("%-24s %-10s %9u %8.2f %8u %12.3f %14s\n", result.m_name.c_str(), result.m_storage.c_str(), result.m_entities,
+            result.m_density, result.m_workers, result.m_nsPerEntity, bytes);
+        std::fflush(stdout);
+    }
+}
+
+void Runner::Report () const {
+    if (!m_options.m_json) {
+        return;
+    }
+    std::printf("[\n");
+    for (std::size_t i = 0; i < m_results.size(); ++i) {
+        const Result& result = m_results[i];
+        // Benches that do not measure memory report null rather than a zero that reads as a measurement
+        char bytes[32] = "null";
+        if (result.m_bytesPerEntity) {
+            std::snprintf(bytes, sizeof(bytes), "%.2f", *result.m_bytesPerEntity);
+        }
+        std::printf("  {\"name\": \"%s\", \"storage\": \"%s\", \"entities\": %u, \"density\": %.2f, \"workers\": %u, \"ns_per_entity\": %.4f, \"bytes_per_entity\": %s}%s\n",
+            result.m_name.c_str(), result.m_storage.c_str(), result.m_entities, result.m_density, result.m_workers,
+            result.m_nsPerEntity, bytes, (i + 1 < m_results.size()) ? "," : "");
+    }
+    std::printf("]\n");
+}
+
+} // namespace bench
\ No newline at end of file
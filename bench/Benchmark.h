@@ -0,0 +1,63 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+// Bytes currently allocated through operator new, tracked by the replacement operators in Benchmark.cpp
+int64_t LiveBytes ();
+
+struct Result {
+    std::string m_name;
+    std::string m_storage;
+    uint32_t m_entities{0};
+    double m_density{1.0};
+    uint32_t m_workers{0};
+    double m_nsPerEntity{0.0};
+    // Only set by the benches that measure memory
+    std::optional<double> m_bytesPerEntity{};
+};
+
+struct Options {
+    std::vector<uint32_t> m_sizes{10000, 100000, 1000000};
+    uint32_t m_repeats{5};
+    std::string m_filter;
+    bool m_json{false};
+};
+
+class Timer {
+public:
+    Timer () : m_start{std::chrono::steady_clock::now()} {}
+
+    double ElapsedNs () const {
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - m_start).count();
+    }
+
+private:
+    std::chrono::steady_clock::time_point m_start;
+};
+
+class Runner {
+public:
+    explicit Runner (const Options& options) : m_options{options} {}
+
+    const Options& GetOptions () const { return m_options; }
+    bool IsEnabled (const std::string& name) const { return m_options.m_filter.empty() || name.find(m_options.m_filter) != std::string::npos; }
+
+    // Calls run once per repeat, each call returns the nanoseconds it spent on the measured work and may
+    // record the memory it used. The fastest repeat is reported since it is the least disturbed by the machine.
+    void Measure (Result result, const std::function<double(Result&)>& run);
+
+    void Report () const;
+
+private:
+    Options m_options;
+    std::vector<Result> m_results{};
+};
+
+} // namespace bench
\ No newline at end of file
@@ -0,0 +1,855 @@
+#include "Benchmark.h"
+
+#include "CommandBuffer.h"
+#include "Encosys.h"
+#include "System.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+
+namespace {
+
+struct Position { float x{0.0f}, y{0.0f}, z{0.0f}; };
+struct Velocity { float x{1.0f}, y{0.0f}, z{0.0f}; };
+struct Health { int32_t value{100}; };
+struct Lifetime { float remaining{1.0f}; };
+struct Hostile {};
+
+// The same layouts split into one column per field
+struct SoaPosition { float x{0.0f}, y{0.0f}, z{0.0f}; };
+struct SoaVelocity { float x{1.0f}, y{0.0f}, z{0.0f}; };
+
+} // namespace
+
+template <> struct ecs::SoaLayout<SoaPosition> : ecs::SoaFields<&SoaPosition::x, &SoaPosition::y, &SoaPosition::z> {};
+template <> struct ecs::SoaLayout<SoaVelocity> : ecs::SoaFields<&SoaVelocity::x, &SoaVelocity::y, &SoaVelocity::z> {};
+
+namespace {
+
+const ecs::ComponentStorage c_storages[] = { ecs::ComponentStorage::Pool, ecs::ComponentStorage::SparseSet, ecs::ComponentStorage::Archetype };
+const double c_densities[] = { 1.0, 0.5, 0.1 };
+
+const char* StorageName (ecs::ComponentStorage storage) {
+    switch (storage) {
+    case ecs::ComponentStorage::Pool: return "pool";
+    case ecs::ComponentStorage::SparseSet: return "sparse_set";
+    case ecs::ComponentStorage::Archetype: return "archetype";
+    case ecs::ComponentStorage::Tag: return "tag";
+    }
+    return "unknown";
+}
+
+// Every density-th entity gets a velocity, spread evenly through the world
+bool HasVelocity (uint32_t index, double density) {
+    return static_cast<uint32_t>((index + 1) * density) != static_cast<uint32_t>(index * density);
+}
+
+std::unique_ptr<ecs::Encosys> CreateWorld (ecs::ComponentStorage storage, uint32_t workerCount = 0, ecs::Allocator& allocator = ecs::HeapAllocator::Instance()) {
+    std::unique_ptr<ecs::Encosys> encosys(new ecs::Encosys(workerCount, allocator));
+    encosys->RegisterComponent<Position>(storage);
+    encosys->RegisterComponent<Velocity>(storage);
+    encosys->RegisterComponent<Health>(storage);
+    encosys->RegisterComponent<Lifetime>(storage);
+    encosys->RegisterComponent<Hostile>();
+    return encosys;
+}
+
+void Populate (ecs::Encosys& encosys, uint32_t count, double density) {
+    for (uint32_t i = 0; i < count; ++i) {
+        const ecs::EntityId id = encosys.Create().GetId();
+        encosys.AddComponent<Position>(id);
+        if (HasVelocity(i, density)) {
+            encosys.AddComponent<Velocity>(id);
+        }
+    }
+}
+
+class MovementSystem : public ecs::System {
+public:
+    virtual void Initialize (ecs::SystemType& type) override {
+        RequiredComponent<Position>(type, ecs::Access::Write);
+        RequiredComponent<Velocity>(type, ecs::Access::Read);
+    }
+
+    virtual void Update (ecs::TimeDelta delta) override {
+        for (ecs::SystemEntity entity : SystemIterator()) {
+            Position* position = entity.WriteComponent<Position>();
+            const Velocity* velocity = entity.ReadComponent<Velocity>();
+            position->x += velocity->x * delta;
+            position->y += velocity->y * delta;
+            position->z += velocity->z * delta;
+        }
+    }
+};
+
+class GravitySystem : public ecs::System {
+public:
+    virtual void Initialize (ecs::SystemType& type) override {
+        RequiredComponent<Velocity>(type, ecs::Access::Write);
+    }
+
+    virtual void Update (ecs::TimeDelta delta) override {
+        for (ecs::SystemEntity entity : SystemIterator()) {
+            entity.WriteComponent<Velocity>()->y -= 9.8f * delta;
+        }
+    }
+};
+
+class RegenerationSystem : public ecs::System {
+public:
+    virtual void Initialize (ecs::SystemType& type) override {
+        RequiredComponent<Health>(type, ecs::Access::Write);
+    }
+
+    virtual void Update (ecs::TimeDelta) override {
+        for (ecs::SystemEntity entity : SystemIterator()) {
+            Health* health = entity.WriteComponent<Health>();
+            health->value = std::min(health->value + 1, 100);
+        }
+    }
+};
+
+// Replaces entities whose lifetime ran out, so every frame also exercises the command buffers
+class LifetimeSystem : public ecs::System {
+public:
+    virtual void Initialize (ecs::SystemType& type) override {
+        RequiredComponent<Lifetime>(type, ecs::Access::Write);
+    }
+
+    virtual void Update (ecs::TimeDelta delta) override {
+        // The expired list lives in frame memory, so building it every frame does not touch the heap
+        ecs::FrameVector<ecs::EntityId> expired(FrameStlAllocator<ecs::EntityId>());
+        for (ecs::SystemEntity entity : SystemIterator()) {
+            Lifetime* lifetime = entity.WriteComponent<Lifetime>();
+            lifetime->remaining -= delta;
+            if (lifetime->remaining <= 0.0f) {
+                expired.push_back(entity.GetId());
+            }
+        }
+
+        ecs::CommandBuffer& commands = Commands();
+        for (const ecs::EntityId id : expired) {
+            commands.Destroy(id);
+            const ecs::EntityId spawned = commands.Create();
+            commands.AddComponent<Position>(spawned);
+            commands.AddComponent<Velocity>(spawned);
+            commands.AddComponent<Lifetime>(spawned, Lifetime{1.0f});
+        }
+    }
+};
+
+// Copies the positions written since its previous run, the system version of the for_each_changed pass
+class FollowSystem : public ecs::System {
+public:
+    virtual void Initialize (ecs::SystemType& type) override {
+        RequiredComponent<Position>(type, ecs::Access::Read);
+        RequiredComponent<Velocity>(type, ecs::Access::Write);
+        Filter<ecs::Changed<Position>>(type);
+    }
+
+    virtual void Update (ecs::TimeDelta) override {
+        for (ecs::SystemEntity entity : SystemIterator()) {
+            entity.WriteComponent<Velocity>()->x = entity.ReadComponent<Position>()->x;
+        }
+    }
+};
+
+void BenchCreateDestroy (bench::Runner& runner, uint32_t count) {
+    for (const ecs::ComponentStorage storage : c_storages) {
+        if (runner.IsEnabled("create")) {
+            runner.Measure({"create", StorageName(storage), count}, [storage, count] (bench::Result& result) {
+                const int64_t bytesBefore = bench::LiveBytes();
+                std::unique_ptr<ecs::Encosys> encosys = CreateWorld(storage);
+                bench::Timer timer;
+                Populate(*encosys, count, 1.0);
+                const double ns = timer.ElapsedNs();
+                result.m_bytesPerEntity = static_cast<double>(bench::LiveBytes() - bytesBefore) / count;
+                return ns;
+            });
+        }
+
+        if (runner.IsEnabled("create_batch")) {
+            runner.Measure({"create_batch", StorageName(storage), count}, [storage, count] (bench::Result& result) {
+                const int64_t bytesBefore = bench::LiveBytes();
+                std::unique_ptr<ecs::Encosys> encosys = CreateWorld(storage);
+                bench::Timer timer;
+                encosys->CreateBatch(count, Position{}, Velocity{});
+                const double ns = timer.ElapsedNs();
+                result.m_bytesPerEntity = static_cast<double>(bench::LiveBytes() - bytesBefore) / count;
+                return ns;
+            });
+        }
+
+        if (runner.IsEnabled("instantiate")) {
+            runner.Measure({"instantiate", StorageName(storage), count}, [storage, count] (bench::Result&) {
+                std::unique_ptr<ecs::Encosys> encosys = CreateWorld(storage);
+                const ecs::EntityId source = encosys->Create(false).GetId();
+                encosys->AddComponent<Position>(source);
+                encosys->AddComponent<Velocity>(source);
+                encosys->AddComponent<Health>(source);
+                encosys->AddComponent<Lifetime>(source);
+                const ecs::Prefab prefab = encosys->CreatePrefab(source);
+                bench::Timer timer;
+                encosys->Instantiate(prefab, count);
+                return timer.ElapsedNs();
+            });
+        }
+
+        if (runner.IsEnabled("destroy")) {
+            runner.Measure({"destroy", StorageName(storage), count}, [storage, count] (bench::Result&) {
+                std::unique_ptr<ecs::Encosys> encosys = CreateWorld(storage);
+                Populate(*encosys, count, 1.0);
+                std::vector<ecs::EntityId> ids;
+                for (uint32_t i = 0; i < encosys->EntityCount(); ++i) {
+                    ids.push_back((*encosys)[i].GetId());
+                }
+                bench::Timer timer;
+                for (const ecs::EntityId id : ids) {
+                    encosys->Destroy(id);
+                }
+                return timer.ElapsedNs();
+            });
+        }
+
+        if (runner.IsEnabled("clear")) {
+            runner.Measure({"clear", StorageName(storage), count}, [storage, count] (bench::Result&) {
+                std::unique_ptr<ecs::Encosys> encosys = CreateWorld(storage);
+                Populate(*encosys, count, 1.0);
+                bench::Timer timer;
+                encosys->Clear();
+                return timer.ElapsedNs();
+            });
+        }
+
+        if (runner.IsEnabled("copy")) {
+            runner.Measure({"copy", StorageName(storage), count}, [storage, count] (bench::Result&) {
+                std::unique_ptr<ecs::Encosys> encosys = CreateWorld(storage);
+                const ecs::EntityId prefab = encosys->Create(false).GetId();
+                encosys->AddComponent<Position>(prefab);
+                encosys->AddComponent<Velocity>(prefab);
+                encosys->AddComponent<Health>(prefab);
+                bench::Timer timer;
+                for (uint32_t i = 0; i < count; ++i) {
+                    encosys->Copy(prefab);
+                }
+                return timer.ElapsedNs();
+            });
+        }
+    }
+}
+
+// Destroys nine in ten entities after a spike and compacts what is left, reporting the bytes still held per survivor
+void BenchCompact (bench::Runner& runner, uint32_t count) {
+    if (!runner.IsEnabled("compact")) {
+        return;
+    }
+    for (const ecs::ComponentStorage storage : c_storages) {
+        runner.Measure({"compact", StorageName(storage), count}, [storage, count] (bench::Result& result) {
+            const int64_t bytesBefore = bench::LiveBytes();
+            std::unique_ptr<ecs::Encosys> encosys = CreateWorld(storage);
+            Populate(*encosys, count, 1.0);
+            std::vector<ecs::EntityId> ids;
+            for (uint32_t i = 0; i < encosys->EntityCount(); ++i) {
+                ids.push_back((*encosys)[i].GetId());
+            }
+            for (uint32_t i = 0; i < count; ++i) {
+                if (i % 10 != 0) {
+                    encosys->Destroy(ids[i]);
+                }
+            }
+            bench::Timer timer;
+            encosys->Compact();
+            const double ns = timer.ElapsedNs();
+            result.m_bytesPerEntity = static_cast<double>(bench::LiveBytes() - bytesBefore) / encosys->EntityCount();
+            return ns;
+        });
+    }
+}
+
+// Sorts a shuffled world by position, then re-sorts it incrementally after one in a hundred entities moved
+void BenchSort (bench::Runner& runner, uint32_t count) {
+    if (!runner.IsEnabled("sort") && !runner.IsEnabled("sort_incremental")) {
+        return;
+    }
+    const auto key = [] (const Position& position) { return position.x; };
+    for (const ecs::ComponentStorage storage : c_storages) {
+        std::unique_ptr<ecs::Encosys> encosys = CreateWorld(storage);
+        Populate(*encosys, count, 1.0);
+        uint32_t seed = 1;
+        // Only the picked entities are written, so their ticks say which keys changed
+        std::vector<ecs::EntityId> picked;
+        const auto shuffle = [&encosys, &seed, &picked] (uint32_t stride) {
+            picked.clear();
+            encosys->ForEach([&seed, &picked, stride] (ecs::Entity& entity, const Position&) {
+                seed = seed * 1664525u + 1013904223u;
+                if (seed % stride == 0) {
+                    picked.push_back(entity.GetId());
+                }
+            });
+            for (const ecs::EntityId id : picked) {
+                seed = seed * 1664525u + 1013904223u;
+                encosys->GetComponent<Position>(id)->x = static_cast<float>(seed >> 8);
+            }
+        };
+
+        if (runner.IsEnabled("sort")) {
+            runner.Measure({"sort", StorageName(storage), count}, [&encosys, &shuffle, &key] (bench::Result&) {
+                shuffle(1);
+                bench::Timer timer;
+                encosys->SortEntities<Position>(key);
+                return timer.ElapsedNs();
+            });
+        }
+
+        if (runner.IsEnabled("sort_incremental")) {
+            encosys->SortEntities<Position>(key);
+            runner.Measure({"sort_incremental", StorageName(storage), count}, [&encosys, &shuffle, &key] (bench::Result&) {
+                shuffle(100);
+                bench::Timer timer;
+                encosys->SortEntities<Position>(key, true);
+                return timer.ElapsedNs();
+            });
+        }
+    }
+}
+
+void BenchAddRemove (bench::Runner& runner, uint32_t count) {
+    if (!runner.IsEnabled("add_remove") && !runner.IsEnabled("add_remove_observed") && !runner.IsEnabled("add_remove_queried")) {
+        return;
+    }
+
+    // Tags only flip a bit of the entity, whatever storage the other components use
+    if (runner.IsEnabled("add_remove")) {
+        std::unique_ptr<ecs::Encosys> encosys = CreateWorld(ecs::ComponentStorage::Pool);
+        Populate(*encosys, count, 0.0);
+        std::vector<ecs::EntityId> ids;
+        for (uint32_t i = 0; i < encosys->EntityCount(); ++i) {
+            ids.push_back((*encosys)[i].GetId());
+        }
+        runner.Measure({"add_remove", StorageName(ecs::ComponentStorage::Tag), count}, [&encosys, &ids] (bench::Result&) {
+            bench::Timer timer;
+            for (const ecs::EntityId id : ids) {
+                encosys->AddComponent<Hostile>(id);
+            }
+            for (const ecs::EntityId id : ids) {
+                encosys->RemoveComponent<Hostile>(id);
+            }
+            return timer.ElapsedNs();
+        });
+    }
+
+    for (const ecs::ComponentStorage storage : c_storages) {
+        std::unique_ptr<ecs::Encosys> encosys = CreateWorld(storage);
+        Populate(*encosys, count, 0.0);
+        std::vector<ecs::EntityId> ids;
+        for (uint32_t i = 0; i < encosys->EntityCount(); ++i) {
+            ids.push_back((*encosys)[i].GetId());
+        }
+
+        // Each measured entity gains and then loses a component
+        if (runner.IsEnabled("add_remove")) {
+            runner.Measure({"add_remove", StorageName(storage), count}, [&encosys, &ids] (bench::Result&) {
+                bench::Timer timer;
+                for (const ecs::EntityId id : ids) {
+                    encosys->AddComponent<Velocity>(id);
+                }
+                for (const ecs::EntityId id : ids) {
+                    encosys->RemoveComponent<Velocity>(id);
+                }
+                return timer.ElapsedNs();
+            });
+        }
+
+        // The same with observers on both events, delivered in bulk by Update
+        if (runner.IsEnabled("add_remove_observed")) {
+            uint64_t observed = 0;
+            encosys->Observe<Velocity>(ecs::ComponentEvent::OnAdd, [&observed] (ecs::Encosys&, const std::vector<ecs::EntityId>& added) {
+                observed += added.size();
+            });
+            encosys->Observe<Velocity>(ecs::ComponentEvent::OnRemove, [&observed] (ecs::Encosys&, const std::vector<ecs::EntityId>& removed) {
+                observed += removed.size();
+            });
+            runner.Measure({"add_remove_observed", StorageName(storage), count}, [&encosys, &ids] (bench::Result&) {
+                bench::Timer timer;
+                for (const ecs::EntityId id : ids) {
+                    encosys->AddComponent<Velocity>(id);
+                }
+                for (const ecs::EntityId id : ids) {
+                    encosys->RemoveComponent<Velocity>(id);
+                }
+                encosys->Update(0.0f);
+                return timer.ElapsedNs();
+            });
+        }
+    }
+
+    // The same with ForEach queries cached over every other combination of components, which the changes must not visit
+    if (runner.IsEnabled("add_remove_queried")) {
+        for (const ecs::ComponentStorage storage : c_storages) {
+            std::unique_ptr<ecs::Encosys> encosys = CreateWorld(storage);
+            Populate(*encosys, count, 0.0);
+            std::vector<ecs::EntityId> ids;
+            for (uint32_t i = 0; i < encosys->EntityCount(); ++i) {
+                ids.push_back((*encosys)[i].GetId());
+            }
+            encosys->ForEach([] (ecs::Entity&, const Position&) {});
+            encosys->ForEach([] (ecs::Entity&, const Health&) {});
+            encosys->ForEach([] (ecs::Entity&, const Lifetime&) {});
+            encosys->ForEach([] (ecs::Entity&, const Position&, const Health&) {});
+            encosys->ForEach([] (ecs::Entity&, const Position&, const Lifetime&) {});
+            encosys->ForEach([] (ecs::Entity&, const Health&, const Lifetime&) {});
+            encosys->ForEach([] (ecs::Entity&, const Position&, const Health&, const Lifetime&) {});
+            encosys->ForEach([] (ecs::Entity&, const Position&, const Velocity&) {});
+            runner.Measure({"add_remove_queried", StorageName(storage), count}, [&encosys, &ids] (bench::Result&) {
+                bench::Timer timer;
+                for (const ecs::EntityId id : ids) {
+                    encosys->AddComponent<Velocity>(id);
+                }
+                for (const ecs::EntityId id : ids) {
+                    encosys->RemoveComponent<Velocity>(id);
+                }
+                return timer.ElapsedNs();
+            });
+        }
+    }
+}
+
+void BenchIteration (bench::Runner& runner, uint32_t count) {
+    if (!runner.IsEnabled("for_each") && !runner.IsEnabled("for_each_single") && !runner.IsEnabled("for_each_without") && !runner.IsEnabled("system_iter") && !runner.IsEnabled("set_active")) {
+        return;
+    }
+    for (const ecs::ComponentStorage storage : c_storages) {
+        for (const double density : c_densities) {
+            const int64_t bytesBefore = bench::LiveBytes();
+            std::unique_ptr<ecs::Encosys> encosys = CreateWorld(storage);
+            encosys->RegisterSystem<MovementSystem>();
+            encosys->Initialize();
+            Populate(*encosys, count, density);
+            bench::Result result{"", StorageName(storage), count, density};
+            result.m_bytesPerEntity = static_cast<double>(bench::LiveBytes() - bytesBefore) / count;
+
+            if (runner.IsEnabled("for_each")) {
+                result.m_name = "for_each";
+                runner.Measure(result, [&encosys] (bench::Result&) {
+                    bench::Timer timer;
+                    encosys->ForEach([] (ecs::Entity&, Position& position, const Velocity& velocity) {
+                        position.x += velocity.x;
+                        position.y += velocity.y;
+                        position.z += velocity.z;
+                    });
+                    return timer.ElapsedNs();
+                });
+            }
+
+            // A single component, which sparse sets walk without going through the entities
+            if (runner.IsEnabled("for_each_single")) {
+                result.m_name = "for_each_single";
+                runner.Measure(result, [&encosys] (bench::Result&) {
+                    bench::Timer timer;
+                    encosys->ForEach([] (ecs::Entity&, Velocity& velocity) {
+                        velocity.y -= 1.0f;
+                    });
+                    return timer.ElapsedNs();
+                });
+            }
+
+            // The entities left out of the pass above, rejected by the mask before the callback
+            if (runner.IsEnabled("for_each_without")) {
+                result.m_name = "for_each_without";
+                runner.Measure(result, [&encosys] (bench::Result&) {
+                    bench::Timer timer;
+                    encosys->ForEach<ecs::Without<Velocity>>([] (ecs::Entity&, Position& position) {
+                        position.x += 1.0f;
+                    });
+                    return timer.ElapsedNs();
+                });
+            }
+
+            if (runner.IsEnabled("system_iter")) {
+                result.m_name = "system_iter";
+                runner.Measure(result, [&encosys] (bench::Result&) {
+                    bench::Timer timer;
+                    encosys->Update(1.0f / 60.0f);
+                    return timer.ElapsedNs();
+                });
+            }
+
+            // Toggling activity only depends on the storage, so a single density is enough
+            if (runner.IsEnabled("set_active") && density == c_densities[0]) {
+                std::vector<ecs::EntityId> ids;
+                for (uint32_t i = 0; i < encosys->EntityCount(); ++i) {
+                    ids.push_back((*encosys)[i].GetId());
+                }
+                result.m_name = "set_active";
+                runner.Measure(result, [&encosys, &ids] (bench::Result&) {
+                    bench::Timer timer;
+                    for (const ecs::EntityId id : ids) {
+                        encosys->SetActive(id, false);
+                    }
+                    for (const ecs::EntityId id : ids) {
+                        encosys->SetActive(id, true);
+                    }
+                    return timer.ElapsedNs();
+                });
+            }
+        }
+    }
+}
+
+// Integrates one axis chunk by chunk, once over whole components and once over SoA field columns where only that axis is loaded
+void BenchChunks (bench::Runner& runner, uint32_t count) {
+    if (!runner.IsEnabled("for_each_chunk")) {
+        return;
+    }
+    for (const double density : c_densities) {
+        std::unique_ptr<ecs::Encosys> encosys = CreateWorld(ecs::ComponentStorage::Archetype);
+        Populate(*encosys, count, density);
+        runner.Measure({"for_each_chunk", "archetype", count, density}, [&encosys] (bench::Result&) {
+            bench::Timer timer;
+            encosys->ForEachChunk([] (uint32_t size, ecs::ChunkSpan<Position> positions, ecs::ChunkSpan<const Velocity> velocities) {
+                Position* position = positions.Data();
+                const Velocity* velocity = velocities.Data();
+                for (uint32_t i = 0; i < size; ++i) {
+                    position[i].x += velocity[i].x;
+                }
+            });
+            return timer.ElapsedNs();
+        });
+
+        std::unique_ptr<ecs::Encosys> soa(new ecs::Encosys());
+        soa->RegisterComponent<SoaPosition>(ecs::ComponentStorage::Archetype);
+        soa->RegisterComponent<SoaVelocity>(ecs::ComponentStorage::Archetype);
+        for (uint32_t i = 0; i < count; ++i) {
+            const ecs::EntityId id = soa->Create().GetId();
+            soa->AddComponent<SoaPosition>(id);
+            if (HasVelocity(i, density)) {
+                soa->AddComponent<SoaVelocity>(id);
+            }
+        }
+        runner.Measure({"for_each_chunk", "soa", count, density}, [&soa] (bench::Result&) {
+            bench::Timer timer;
+            soa->ForEachChunk([] (uint32_t size, ecs::ChunkSpan<SoaPosition> positions, ecs::ChunkSpan<const SoaVelocity> velocities) {
+                float* x = positions.Field<&SoaPosition::x>();
+                const float* vx = velocities.Field<&SoaVelocity::x>();
+                for (uint32_t i = 0; i < size; ++i) {
+                    x[i] += vx[i];
+                }
+            });
+            return timer.ElapsedNs();
+        });
+    }
+}
+
+// Writes the positions of one in a hundred entities, then visits only the changed ones
+void BenchChanged (bench::Runner& runner, uint32_t count) {
+    if (!runner.IsEnabled("for_each_changed") && !runner.IsEnabled("system_iter_changed")) {
+        return;
+    }
+    const double fraction = 0.01;
+    for (const ecs::ComponentStorage storage : c_storages) {
+        std::unique_ptr<ecs::Encosys> encosys = CreateWorld(storage);
+        if (runner.IsEnabled("system_iter_changed")) {
+            encosys->RegisterSystem<FollowSystem>();
+        }
+        encosys->Initialize();
+        Populate(*encosys, count, 1.0);
+        std::vector<ecs::EntityId> ids;
+        for (uint32_t i = 0; i < encosys->EntityCount(); ++i) {
+            ids.push_back((*encosys)[i].GetId());
+        }
+        encosys->Update(0.0f);
+
+        uint32_t offset = 0;
+        if (runner.IsEnabled("for_each_changed")) {
+            runner.Measure({"for_each_changed", StorageName(storage), count, fraction}, [&encosys, &ids, &offset, fraction] (bench::Result&) {
+                const uint32_t stride = static_cast<uint32_t>(1.0 / fraction);
+                for (uint32_t i = offset++ % stride; i < ids.size(); i += stride) {
+                    encosys->GetComponent<Position>(ids[i])->x += 1.0f;
+                }
+                encosys->Update(0.0f);
+
+                bench::Timer timer;
+                encosys->ForEach<ecs::Changed<Position>>([] (ecs::Entity&, const Position& position, Velocity& velocity) {
+                    velocity.x = position.x;
+                });
+                return timer.ElapsedNs();
+            });
+        }
+
+        // The writes land between two updates, so the system sees them on the next one
+        if (runner.IsEnabled("system_iter_changed")) {
+            runner.Measure({"system_iter_changed", StorageName(storage), count, fraction}, [&encosys, &ids, &offset, fraction] (bench::Result&) {
+                const uint32_t stride = static_cast<uint32_t>(1.0 / fraction);
+                for (uint32_t i = offset++ % stride; i < ids.size(); i += stride) {
+                    encosys->GetComponent<Position>(ids[i])->x += 1.0f;
+                }
+
+                bench::Timer timer;
+                encosys->Update(0.0f);
+                return timer.ElapsedNs();
+            });
+        }
+    }
+}
+
+void BenchUpdate (bench::Runner& runner, uint32_t count) {
+    if (!runner.IsEnabled("update")) {
+        return;
+    }
+    // Serial updates and one worker per spare hardware thread
+    std::vector<uint32_t> workerCounts{0};
+    if (std::thread::hardware_concurrency() > 1) {
+        workerCounts.push_back(std::thread::hardware_concurrency() - 1);
+    }
+    for (const uint32_t workerCount : workerCounts) {
+        const int64_t bytesBefore = bench::LiveBytes();
+        std::unique_ptr<ecs::Encosys> encosys(new ecs::Encosys(workerCount));
+        encosys->RegisterComponent<Position>(ecs::ComponentStorage::Archetype);
+        encosys->RegisterComponent<Velocity>(ecs::ComponentStorage::Archetype);
+        encosys->RegisterComponent<Health>(ecs::ComponentStorage::SparseSet);
+        encosys->RegisterComponent<Lifetime>(ecs::ComponentStorage::Pool);
+        encosys->RegisterSystem<MovementSystem>();
+        encosys->RegisterSystem<GravitySystem>();
+        encosys->RegisterSystem<RegenerationSystem>();
+        encosys->RegisterSystem<LifetimeSystem>();
+        encosys->Initialize();
+
+        // Most entities move, a quarter can be damaged and a tenth expire over roughly a second
+        for (uint32_t i = 0; i < count; ++i) {
+            const ecs::EntityId id = encosys->Create().GetId();
+            encosys->AddComponent<Position>(id);
+            encosys->AddComponent<Velocity>(id);
+            if (i % 4 == 0) {
+                encosys->AddComponent<Health>(id);
+            }
+            if (i % 10 == 0) {
+                encosys->AddComponent<Lifetime>(id, Lifetime{static_cast<float>(i % 60) / 60.0f});
+            }
+        }
+
+        bench::Result result{"update", "mixed", count, 1.0, workerCount};
+        result.m_bytesPerEntity = static_cast<double>(bench::LiveBytes() - bytesBefore) / count;
+        runner.Measure(result, [&encosys] (bench::Result&) {
+            bench::Timer timer;
+            encosys->Update(1.0f / 60.0f);
+            return timer.ElapsedNs();
+        });
+    }
+}
+
+std::vector<uint32_t> ParseSizes (const char* text) {
+    std::vector<uint32_t> sizes;
+    while (*text != '\0') {
+        char* end = nullptr;
+        const unsigned long size = std::strtoul(text, &end, 10);
+        if (end == text) {
+            break;
+        }
+        sizes.push_back(static_cast<uint32_t>(size));
+        text = (*end == ',') ? end + 1 : end;
+    }
+    return sizes;
+}
+
+// Saves a populated world to a file and loads it into a new one, bytes per entity is the size of the file
+void BenchSnapshot (bench::Runner& runner, uint32_t count) {
+    if (!runner.IsEnabled("snapshot_save") && !runner.IsEnabled("snapshot_load")) {
+        return;
+    }
+    const char* path = "encosys-bench.snapshot";
+    for (const ecs::ComponentStorage storage : c_storages) {
+        std::unique_ptr<ecs::Encosys> encosys = CreateWorld(storage);
+        Populate(*encosys, count, 0.5);
+        if (!encosys->SaveSnapshot(path)) {
+            continue;
+        }
+        bench::Result result{"", StorageName(storage), count, 0.5};
+        if (std::FILE* file = std::fopen(path, "rb")) {
+            std::fseek(file, 0, SEEK_END);
+            result.m_bytesPerEntity = static_cast<double>(std::ftell(file)) / count;
+            std::fclose(file);
+        }
+        if (runner.IsEnabled("snapshot_save")) {
+            result.m_name = "snapshot_save";
+            runner.Measure(result, [&encosys, path] (bench::Result&) {
+                bench::Timer timer;
+                encosys->SaveSnapshot(path);
+                return timer.ElapsedNs();
+            });
+        }
+        if (runner.IsEnabled("snapshot_load")) {
+            result.m_name = "snapshot_load";
+            runner.Measure(result, [storage, path] (bench::Result&) {
+                std::unique_ptr<ecs::Encosys> loaded = CreateWorld(storage);
+                bench::Timer timer;
+                loaded->LoadSnapshot(path);
+                return timer.ElapsedNs();
+            });
+        }
+    }
+    std::remove(path);
+}
+
+// Captures a delta snapshot per tick after a system moved every entity, and rolls back to the oldest retained one
+void BenchRollback (bench::Runner& runner, uint32_t count) {
+    if (!runner.IsEnabled("snapshot_delta") && !runner.IsEnabled("snapshot_restore")) {
+        return;
+    }
+    for (const ecs::ComponentStorage storage : c_storages) {
+        std::unique_ptr<ecs::Encosys> encosys = CreateWorld(storage);
+        Populate(*encosys, count, 0.5);
+        auto tick = [&encosys] () {
+            encosys->ForEach([] (ecs::Entity&, Position& position, const Velocity& velocity) {
+                position.x += velocity.x;
+                position.y += velocity.y;
+                position.z += velocity.z;
+            });
+        };
+        // Fills the history so every capture measured is a delta that folds the oldest one
+        for (uint32_t i = 0; i <= ENCOSYS_SNAPSHOT_HISTORY_; ++i) {
+            tick();
+            if (encosys->CaptureSnapshot() == ecs::c_invalidIndex) {
+                break;
+            }
+        }
+        if (runner.IsEnabled("snapshot_delta")) {
+            bench::Result result{"snapshot_delta", StorageName(storage), count, 0.5};
+            runner.Measure(result, [&encosys, &tick] (bench::Result&) {
+                tick();
+                bench::Timer timer;
+                encosys->CaptureSnapshot();
+                return timer.ElapsedNs();
+            });
+        }
+        if (runner.IsEnabled("snapshot_restore")) {
+            bench::Result result{"snapshot_restore", StorageName(storage), count, 0.5};
+            runner.Measure(result, [&encosys, &tick] (bench::Result&) {
+                const uint32_t snapshot = encosys->CaptureSnapshot();
+                for (uint32_t i = 0; i < ENCOSYS_SNAPSHOT_HISTORY_ - 1; ++i) {
+                    tick();
+                    encosys->CaptureSnapshot();
+                }
+                tick();
+                bench::Timer timer;
+                encosys->RestoreSnapshot(snapshot);
+                return timer.ElapsedNs();
+            });
+        }
+    }
+}
+
+// Iterates a pool world whose storage comes from each kind of allocator, huge pages should cut the TLB misses of large worlds
+void BenchAllocators (bench::Runner& runner, uint32_t count) {
+    if (!runner.IsEnabled("allocator")) {
+        return;
+    }
+    ecs::MmapAllocator mmapAllocator(ecs::MmapAllocator::Pages::Normal);
+    ecs::MmapAllocator hugeAllocator(ecs::MmapAllocator::Pages::TransparentHuge);
+    const std::size_t arenaBytes = static_cast<std::size_t>(count) * 2048 + (std::size_t{64} << 20);
+    ecs::ArenaAllocator heapArena(arenaBytes);
+    ecs::ArenaAllocator hugeArena(arenaBytes, hugeAllocator);
+    const std::pair<const char*, ecs::Allocator*> allocators[] = {
+        {"heap", &ecs::HeapAllocator::Instance()},
+        {"mmap", &mmapAllocator},
+        {"arena", &heapArena},
+        {"arena_huge", &hugeArena},
+    };
+    for (const auto& allocator : allocators) {
+        const std::size_t bytesBefore = allocator.second->GetAllocatedBytes();
+        std::unique_ptr<ecs::Encosys> encosys = CreateWorld(ecs::ComponentStorage::Pool, 0, *allocator.second);
+        Populate(*encosys, count, 1.0);
+        bench::Result result{"allocator", allocator.first, count};
+        result.m_bytesPerEntity = static_cast<double>(allocator.second->GetAllocatedBytes() - bytesBefore) / count;
+        runner.Measure(result, [&encosys] (bench::Result&) {
+            bench::Timer timer;
+            encosys->ForEach([] (ecs::Entity&, Position& position, const Velocity& velocity) {
+                position.x += velocity.x;
+                position.y += velocity.y;
+                position.z += velocity.z;
+            });
+            return timer.ElapsedNs();
+        });
+    }
+}
+
+// Creates and destroys waves of growing size in an arena that only fits a few of them at once, so the
+// arrays that grow along with each wave have to reuse the buffers they outgrew. Reports the arena's peak.
+void BenchArenaChurn (bench::Runner& runner, uint32_t count) {
+    if (!runner.IsEnabled("arena_churn")) {
+        return;
+    }
+    for (const ecs::ComponentStorage storage : c_storages) {
+        bench::Result result{"arena_churn", StorageName(storage), count};
+        runner.Measure(result, [storage, count] (bench::Result& result) {
+            ecs::ArenaAllocator arena(static_cast<std::size_t>(count) * 512 + (std::size_t{16} << 20));
+            std::unique_ptr<ecs::Encosys> encosys = CreateWorld(storage, 0, arena);
+            bench::Timer timer;
+            for (uint32_t wave = 1; wave <= 8; ++wave) {
+                for (const ecs::EntityId id : encosys->CreateBatch(count / 8 * wave, Position{}, Velocity{})) {
+                    encosys->Destroy(id);
+                }
+                encosys->Compact();
+            }
+            const double ns = timer.ElapsedNs();
+            result.m_bytesPerEntity = static_cast<double>(arena.GetPeakBytes()) / count;
+            return ns;
+        });
+    }
+}
+
+void PrintUsage () {
+    std::printf("usage: encosys-bench [--json] [--repeats=N] [--sizes=N,N,...] [--filter=NAME]\n");
+    std::printf("  --json         print the results as a JSON array instead of a table\n");
+    std::printf("  --repeats=N    runs per benchmark, the fastest is reported (default 5)\n");
+    std::printf("  --sizes=N,...  entity counts to benchmark (default 10000,100000,1000000)\n");
+    std::printf("  --filter=NAME  only run benchmarks whose name contains NAME\n");
+}
+
+} // namespace
+
+int main (int argc, char** argv) {
+    bench::Options options;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--json") {
+            options.m_json = true;
+        }
+        else if (arg.compare(0, 10, "--repeats=") == 0) {
+            options.m_repeats = static_cast<uint32_t>(std::strtoul(arg.c_str() + 10, nullptr, 10));
+        }
+        else if (arg.compare(0, 8, "--sizes=") == 0) {
+            options.m_sizes = ParseSizes(arg.c_str() + 8);
+        }
+        else if (arg.compare(0, 9, "--filter=") == 0) {
+            options.m_filter = arg.substr(9);
+        }
+        else {
+            PrintUsage();
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+
+    bench::Runner runner(options);
+    if (!options.m_json) {
+        std::printf("%-24s %-10s %9s %8s %8s %12s %14s\n", "benchmark", "storage", "entities", "density", "workers", "ns/entity", "bytes/entity");
+    }
+    for (const uint32_t count : options.m_sizes) {
+        BenchCreateDestroy(runner, count);
+        BenchAddRemove(runner, count);
+        BenchCompact(runner, count);
+        BenchSort(runner, count);
+        BenchIteration(runner, count);
+        BenchChunks(runner, count);
+        BenchChanged(runner, count);
+        BenchSnapshot(runner, count);
+        BenchRollback(runner, count);
+        BenchAllocators(runner, count);
+        BenchArenaChurn(runner, count);
+        BenchUpdate(runner, count);
+    }
+    runner.Report();
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+
+namespace ecs {
+
+// Source of the memory behind component pools, archetype chunks and entity storage. Encosys only
+// allocates while making structural changes, which happen on one thread at a time, so only the
+// byte counters are safe to share between worlds on different threads.
+class Allocator {
+public:
+    virtual ~Allocator () = default;
+
+    // The alignment is a power of two. Throws std::bad_alloc when the request cannot be met.
+    void* Allocate (std::size_t bytes, std::size_t alignment);
+    // Bytes and alignment must match the Allocate call that returned the data
+    void Deallocate (void* data, std::size_t bytes, std::size_t alignment);
+
+    // Bytes handed out and not yet returned, and the most that were ever out at once
+    std::size_t GetAllocatedBytes () const { return m_allocatedBytes.load(std::memory_order_relaxed); }
+    std::size_t GetPeakBytes () const { return m_peakBytes.load(std::memory_order_relaxed); }
+
+protected:
+    virtual void* DoAllocate (std::size_t bytes, std::size_t alignment) = 0;
+    virtual void DoDeallocate (void* data, std::size_t bytes, std::size_t alignment) = 0;
+
+    // For allocators that release everything at once without a Deallocate per allocation
+    void ForgetAllocations () { m_allocatedBytes.store(0, std::memory_order_relaxed); }
+
+private:
+    std::atomic<std::size_t> m_allocatedBytes{0};
+    std::atomic<std::size_t> m_peakBytes{0};
+};
+
+// Forwards to the aligned global operator new and delete
+class HeapAllocator : public Allocator {
+public:
+    // Shared by every world and pool that is not given an allocator of its own
+    static HeapAllocator& Instance ();
+
+protected:
+    void* DoAllocate (std::size_t bytes, std::size_t alignment) override;
+    void DoDeallocate (void* data, std::size_t bytes, std::size_t alignment) override;
+};
+
+// Maps every allocation straight from the OS. Allocations are rounded up to whole pages, so this
+// suits large requests best and is usually the upstream of an ArenaAllocator. Huge pages back the
+// mapping with 2 MiB pages and cut TLB misses on large worlds. Transparent ones only need the
+// kernel to allow madvise, explicit ones need pages reserved through vm.nr_hugepages and fall back
+// to transparent ones when none are left.
+class MmapAllocator : public Allocator {
+public:
+    enum class Pages { Normal, TransparentHuge, Huge };
+
+    explicit MmapAllocator (Pages pages = Pages::Normal, bool populate = false);
+
+    Pages GetPages () const { return m_pages; }
+
+protected:
+    void* DoAllocate (std::size_t bytes, std::size_t alignment) override;
+    void DoDeallocate (void* data, std::size_t bytes, std::size_t alignment) override;
+
+private:
+    std::size_t MappedBytes (std::size_t bytes) const;
+
+    Pages m_pages;
+    bool m_populate;
+    std::size_t m_pageBytes;
+};
+
+// Carves allocations out of one region of a fixed size taken from the upstream allocator up front,
+// which gives a world a hard memory budget. Freed ranges merge with their free neighbours, and each
+// request takes the smallest free range that fits before carving more of the region. Pool blocks and
+// archetype chunks are recycled this way, and the buffers that growing arrays outgrow are reused too.
+class ArenaAllocator : public Allocator {
+public:
+    explicit ArenaAllocator (std::size_t capacity, Allocator& upstream = HeapAllocator::Instance());
+    ~ArenaAllocator () override;
+
+    ArenaAllocator (const ArenaAllocator&) = delete;
+    ArenaAllocator& operator= (const ArenaAllocator&) = delete;
+
+    std::size_t GetCapacity () const { return m_capacity; }
+    // Bytes past the last range in use, free ranges below it excluded
+    std::size_t GetRemainingBytes () const { return m_capacity - m_used; }
+
+protected:
+    void* DoAllocate (std::size_t bytes, std::size_t alignment) override;
+    void DoDeallocate (void* data, std::size_t bytes, std::size_t alignment) override;
+
+private:
+    void InsertFree (uint8_t* data, std::size_t bytes);
+    void EraseFree (std::map<uint8_t*, std::size_t>::iterator it);
+
+    Allocator& m_upstream;
+    uint8_t* m_region{nullptr};
+    std::size_t m_capacity{0};
+    std::size_t m_used{0};
+    // Free ranges below m_used by address, to merge neighbours, and by size, to find the smallest that fits
+    std::map<uint8_t*, std::size_t> m_freeByAddress{};
+    std::multimap<std::size_t, uint8_t*> m_freeBySize{};
+};
+
+// Adapts an Allocator for standard containers
+template <typename T>
+class StlAllocator {
+public:
+    using value_type = T;
+
+    StlAllocator (Allocator& allocator) : m_allocator{&allocator} {}
+    template <typename U>
+    StlAllocator (const StlAllocator<U>& other) : m_allocator{&other.GetAllocator()} {}
+
+    T* allocate (std::size_t count) { return static_cast<T*>(m_allocator->Allocate(count * sizeof(T), alignof(T))); }
+    void deallocate (T* data, std::size_t count) { m_allocator->Deallocate(data, count * sizeof(T), alignof(T)); }
+
+    Allocator& GetAllocator () const { return *m_allocator; }
+
+    template <typename U>
+    bool operator== (const StlAllocator<U>& other) const { return m_allocator == &other.GetAllocator(); }
+    template <typename U>
+    bool operator!= (const StlAllocator<U>& other) const { return m_allocator != &other.GetAllocator(); }
+
+private:
+    Allocator* m_allocator;
+};
+
+}
\ No newline at end of file
@@ -0,0 +1,137 @@
+#pragma once
+
+#include "Allocator.h"
+#include "ChangeTicks.h"
+#include "ComponentType.h"
+#include "EncosysConfig.h"
+#include "EntityId.h"
+#include "Snapshot.h"
+#include <array>
+#include <vector>
+
+namespace ecs {
+
+// Stores the components of every entity that shares the same archetype bitset.
+// Rows are packed into fixed-size chunks, and each chunk holds one contiguous
+// column per component type preceded by a column of entity ids. SoA components
+// get one column per field instead, and have no address as a whole. Every type
+// also has a column of change ticks, and the end of each chunk holds one tick
+// summary per type covering all of its rows. Every write marks its chunk dirty
+// for delta snapshots.
+class Archetype {
+public:
+    Archetype (const ComponentBitset& bitset, bool active, const std::vector<ComponentType>& types, Allocator& allocator);
+    ~Archetype ();
+
+    Archetype (const Archetype&) = delete;
+    Archetype& operator= (const Archetype&) = delete;
+
+    const ComponentBitset& GetBitset () const { return m_bitset; }
+    const std::vector<ComponentType>& GetTypes () const { return m_types; }
+    bool IsActive () const { return m_active; }
+    uint32_t GetSize () const { return m_size; }
+    uint32_t GetChunkCapacity () const { return m_chunkCapacity; }
+    uint32_t GetChunkCount () const { return static_cast<uint32_t>(m_chunks.size()); }
+    uint32_t GetChunkSize (uint32_t chunk) const;
+
+    EntityId* GetEntityIds (uint32_t chunk) { return reinterpret_cast<EntityId*>(m_chunks[chunk]); }
+    const EntityId* GetEntityIds (uint32_t chunk) const { return reinterpret_cast<const EntityId*>(m_chunks[chunk]); }
+    EntityId GetEntityId (uint32_t row) const { return GetEntityIds(row / m_chunkCapacity)[row % m_chunkCapacity]; }
+
+    uint8_t* GetColumn (ComponentTypeId typeId, uint32_t chunk);
+    const uint8_t* GetColumn (ComponentTypeId typeId, uint32_t chunk) const;
+
+    uint8_t* GetComponentData (ComponentTypeId typeId, uint32_t row);
+    const uint8_t* GetComponentData (ComponentTypeId typeId, uint32_t row) const;
+
+    uint8_t* GetFieldColumn (ComponentTypeId typeId, uint32_t field, uint32_t chunk);
+    const uint8_t* GetFieldColumn (ComponentTypeId typeId, uint32_t field, uint32_t chunk) const;
+
+    ComponentTicks* GetTicksColumn (ComponentTypeId typeId, uint32_t chunk);
+    const ComponentTicks* GetTicksColumn (ComponentTypeId typeId, uint32_t chunk) const;
+    const ComponentTicks& GetTicks (ComponentTypeId typeId, uint32_t row) const;
+    // Never older than the ticks of any row of the chunk, but may be newer than all of them once rows moved out
+    ComponentTicks GetChunkTicks (ComponentTypeId typeId, uint32_t chunk) const;
+    // Raises the ticks of the chunk, safe to call for the same chunk from several threads
+    void IncludeChunkTicks (ComponentTypeId typeId, uint32_t chunk, const ComponentTicks& ticks);
+
+    void MarkAdded (ComponentTypeId typeId, uint32_t row, ChangeTick tick);
+    void MarkChanged (ComponentTypeId typeId, uint32_t row, ChangeTick tick);
+    // Marks every row of the chunk as written
+    void MarkChunkChanged (ComponentTypeId typeId, uint32_t chunk, ChangeTick tick);
+
+    // Gathers an SoA component from its field columns into dst, or scatters the one at src into them
+    void LoadComponent (const ComponentType& type, uint32_t row, uint8_t* dst) const;
+    void StoreComponent (const ComponentType& type, uint32_t row, const uint8_t* src);
+
+    // Copy constructs the component from a row of another archetype, or moves it and destroys the original.
+    // Either way the change ticks come along.
+    void CopyComponent (const ComponentType& type, uint32_t row, const Archetype& source, uint32_t sourceRow);
+    void RelocateComponent (const ComponentType& type, uint32_t row, Archetype& source, uint32_t sourceRow);
+
+    // Allocates chunks up front so the next rows up to the given count do not allocate
+    void Reserve (uint32_t rows);
+
+    // Appends a row for the entity, its components are left uninitialized
+    uint32_t AddRow (EntityId id);
+
+    // Copy constructs the component in count consecutive rows from source, one bulk copy per chunk
+    void FillColumn (const ComponentType& type, uint32_t firstRow, uint32_t count, const uint8_t* source);
+
+    // Destroys every component in the row
+    void DestroyComponents (uint32_t row);
+
+    // Destroys every row and releases all chunks but one, without visiting rows when all components are trivially destructible
+    void Clear ();
+
+    // Writes the used chunks as raw bytes, so every component must be trivially copyable. Load expects
+    // an archetype of the same types and fails when the chunk layout differs.
+    void Save (SnapshotWriter& writer) const;
+    bool Load (SnapshotReader& reader);
+
+    // Delta snapshots copy the used chunks whole, so a block is one chunk. LoadBlock expects the size
+    // already restored through RestoreSize, which allocates the chunks the rows need.
+    DirtyBlocks& GetDirtyBlocks () { return m_dirtyChunks; }
+    uint32_t GetUsedBlockCount () const { return (m_size + m_chunkCapacity - 1) / m_chunkCapacity; }
+    void SaveBlock (uint32_t chunk, std::vector<uint8_t>& bytes) const;
+    void LoadBlock (uint32_t chunk, const std::vector<uint8_t>& bytes);
+    void RestoreSize (uint32_t size);
+
+    // Exchanges the components and entity ids of two rows
+    void SwapRows (uint32_t a, uint32_t b);
+
+    // Removes a row whose components were already destroyed or relocated by moving
+    // the last row into its place. Returns the id of the moved entity, if any.
+    EntityId RemoveRow (uint32_t row);
+
+private:
+    uint32_t ComputeLayout (uint32_t capacity);
+    void AllocateChunk ();
+    void ReleaseChunk ();
+    void CopyFields (const ComponentType& type, uint32_t row, const Archetype& source, uint32_t sourceRow);
+    void CopyTicks (ComponentTypeId typeId, uint32_t row, const Archetype& source, uint32_t sourceRow);
+
+    Allocator& m_allocator;
+    ComponentBitset m_bitset{};
+    bool m_active{true};
+    std::vector<ComponentType> m_types{};
+    std::array<uint32_t, ENCOSYS_MAX_COMPONENTS_> m_columnOffsets{};
+    std::array<uint32_t, ENCOSYS_MAX_COMPONENTS_> m_columnBytes{};
+    std::array<uint32_t, ENCOSYS_MAX_COMPONENTS_> m_tickOffsets{};
+    // Position of each type in m_types, which is also its position in the chunk tick summaries
+    std::array<uint32_t, ENCOSYS_MAX_COMPONENTS_> m_typeIndices{};
+    uint32_t m_chunkTicksOffset{0};
+    // Offsets of the field columns of SoA components, starting at m_firstField of the type
+    ComponentBitset m_soaBitset{};
+    std::array<uint32_t, ENCOSYS_MAX_COMPONENTS_> m_firstField{};
+    std::vector<uint32_t> m_fieldOffsets{};
+    uint32_t m_chunkBytes{0};
+    uint32_t m_chunkAlignment{ENCOSYS_POOL_BLOCK_ALIGNMENT_};
+    uint32_t m_chunkCapacity{0};
+    bool m_triviallyDestructible{true};
+    uint32_t m_size{0};
+    std::vector<uint8_t*> m_chunks{};
+    DirtyBlocks m_dirtyChunks{};
+};
+
+}
\ No newline at end of file
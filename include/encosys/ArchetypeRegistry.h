@@ -0,0 +1,43 @@
+#pragma once
+
+#include "Archetype.h"
+#include "EncosysConfig.h"
+#include <unordered_map>
+#include <vector>
+
+namespace ecs {
+
+class ComponentRegistry;
+
+class ArchetypeRegistry {
+public:
+    ArchetypeRegistry () = default;
+    virtual ~ArchetypeRegistry ();
+
+    ArchetypeRegistry (const ArchetypeRegistry&) = delete;
+    ArchetypeRegistry& operator= (const ArchetypeRegistry&) = delete;
+
+    // Returns the id of the archetype storing the given component bitset, creating it on first use
+    uint32_t FindOrCreate (const ComponentBitset& bitset, bool active, const ComponentRegistry& componentRegistry);
+
+    // Empties every archetype, the archetypes themselves stay registered
+    void Clear ();
+    // Deletes the archetypes with an id from count up, so restoring a delta snapshot drops those created since
+    void Truncate (uint32_t count);
+
+    // Writes every archetype in id order. Load replaces the registered archetypes with the saved ones,
+    // so the saved ids stay valid.
+    void Save (SnapshotWriter& writer) const;
+    bool Load (SnapshotReader& reader, const ComponentRegistry& componentRegistry);
+
+    uint32_t Count () const { return static_cast<uint32_t>(m_archetypes.size()); }
+    Archetype& operator[] (uint32_t id) { return *m_archetypes[id]; }
+    const Archetype& operator[] (uint32_t id) const { return *m_archetypes[id]; }
+
+private:
+    std::vector<Archetype*> m_archetypes{};
+    std::unordered_map<ComponentBitset, uint32_t> m_activeLookup{};
+    std::unordered_map<ComponentBitset, uint32_t> m_inactiveLookup{};
+};
+
+} // namespace ecs
\ No newline at end of file
@@ -1,37 +1,145 @@
 #pragma once
 
+#include "Allocator.h"
+#include "ChangeTicks.h"
+#include "EncosysConfig.h"
+#include "EntityId.h"
+#include "Snapshot.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <deque>
 #include <vector>
 
 namespace ecs {
 
+// Stores elements in fixed-size blocks that never move once allocated. The block size must be a
+// power of two so an index splits into a block and an offset with a shift and a mask. Blocks start
+// on ENCOSYS_POOL_BLOCK_ALIGNMENT_ or the element alignment, whichever is larger, and the element
+// stride is padded to the requested alignment so over-aligned types stay aligned within a block.
+// Blocks come from the given allocator, which must outlive the pool. Every element records the id
+// of the entity that owns it, so compaction can patch the owner after moving the element, and its
+// change ticks, which move along with it. Each block also keeps one tick summary covering all of its
+// elements, so unchanged blocks can be skipped as a whole. Every write marks its block dirty for delta snapshots.
 class BlockMemoryPool {
 public:
     BlockMemoryPool () {}
-    explicit BlockMemoryPool (uint32_t elementSize, uint32_t blockSize)
-        : m_elementSize{elementSize}, m_blockSize{blockSize} {}
+    explicit BlockMemoryPool (uint32_t elementSize, uint32_t blockSize, uint32_t alignment = 1, Allocator& allocator = HeapAllocator::Instance());
 
     virtual ~BlockMemoryPool ();
 
+    BlockMemoryPool (const BlockMemoryPool&) = delete;
+    BlockMemoryPool& operator= (const BlockMemoryPool&) = delete;
+
     uint32_t GetElementSize () const { return m_elementSize; }
-    uint32_t GetBlockSize () const { return m_blockSize;}
+    uint32_t GetStride () const { return m_stride; }
+    uint32_t GetAlignment () const { return m_alignment; }
+    uint32_t GetBlockSize () const { return m_blockMask + 1; }
     uint32_t GetCapacity () const { return m_capacity; }
     uint32_t GetSize () const { return m_size; }
+    Allocator& GetAllocator () const { return *m_allocator; }
 
     void Resize (uint32_t size);
     void Reserve (uint32_t capacity);
+    // Returns the blocks past the end of the pool to the allocator
+    void ReleaseUnusedBlocks ();
+
+    // Invalid for destroyed elements, copies start without an owner until one is assigned
+    EntityId GetEntityId (uint32_t index) const { assert(index < m_size); return m_elements[index].m_entityId; }
+    void SetEntityId (uint32_t index, EntityId id) { assert(index < m_size); m_dirtyBlocks.Mark(index); m_elements[index].m_entityId = id; }
+
+    const ComponentTicks& GetTicks (uint32_t index) const { assert(index < m_size); return m_elements[index].m_ticks; }
+    // Never older than the ticks of any element of the block, but may be newer than all of them once elements moved out
+    ComponentTicks GetBlockTicks (uint32_t block) const { return m_blockTicks[block].Load(); }
+    // Safe to call for elements of the same block from several threads
+    void MarkAdded (uint32_t index, ChangeTick tick) {
+        assert(index < m_size);
+        m_dirtyBlocks.Mark(index);
+        m_elements[index].m_ticks = ComponentTicks{tick, tick};
+        m_blockTicks[index >> m_blockShift].Include(ComponentTicks{tick, tick});
+    }
+    void MarkChanged (uint32_t index, ChangeTick tick) {
+        assert(index < m_size);
+        m_dirtyBlocks.Mark(index);
+        m_elements[index].m_ticks.m_changed = tick;
+        m_blockTicks[index >> m_blockShift].Include(ComponentTicks{0, tick});
+    }
 
     virtual uint32_t CreateFromCopy (uint32_t index);
+    // Appends count copies of the element at source and returns the index of the first
+    virtual uint32_t CreateCopies (const uint8_t* source, uint32_t count);
     virtual void Destroy (uint32_t index);
+    // Destroys every element but keeps the blocks for reuse
+    virtual void Clear ();
+
+    // Swaps two live elements along with their owners
+    virtual void Swap (uint32_t a, uint32_t b);
+    // Moves up to maxMoves elements from the back into the holes left by destroyed ones and appends the
+    // indices that received an element to filled. Returns true once no holes are left below the size.
+    virtual bool FillHoles (uint32_t maxMoves, std::vector<uint32_t>& filled);
+
+    // Writes the owners and ticks followed by the raw bytes of every used block, so elements must be trivially copyable
+    virtual void Save (SnapshotWriter& writer) const;
+    // Replaces every element with those of a saved pool of the same type, returns false if the data is malformed
+    virtual bool Load (SnapshotReader& reader);
+
+    // Delta snapshots copy the used blocks one at a time, along with the owners and ticks of their elements, and
+    // keep the size and any free list as state. LoadBlock expects the pool already resized to the saved size.
+    DirtyBlocks& GetDirtyBlocks () { return m_dirtyBlocks; }
+    uint32_t GetUsedBlockCount () const { return (m_size + m_blockMask) >> m_blockShift; }
+    void SaveBlock (uint32_t block, std::vector<uint8_t>& bytes) const;
+    void LoadBlock (uint32_t block, const std::vector<uint8_t>& bytes);
+    virtual void SaveState (SnapshotWriter& writer) const;
+    virtual bool LoadState (SnapshotReader& reader);
 
-    uint8_t* GetData (uint32_t index);
-    const uint8_t* GetData (uint32_t index) const;
+    // Handing out writable data marks the block, so the const overload is the one to read through
+    uint8_t* GetData (uint32_t index) {
+        assert(index < m_size);
+        m_dirtyBlocks.Mark(index);
+        return m_blocks[index >> m_blockShift] + (index & m_blockMask) * m_stride;
+    }
+
+    const uint8_t* GetData (uint32_t index) const {
+        assert(index < m_size);
+        return m_blocks[index >> m_blockShift] + (index & m_blockMask) * m_stride;
+    }
+
+protected:
+    struct Element {
+        EntityId m_entityId{};
+        ComponentTicks m_ticks{};
+    };
+
+    // Subclasses only write an element along with its data, whose GetData marks the block. Moving or
+    // swapping elements goes through these so the ticks of the destination blocks cover them.
+    void MoveElement (uint32_t to, uint32_t from) {
+        m_elements[to] = m_elements[from];
+        m_blockTicks[to >> m_blockShift].Include(m_elements[to].m_ticks);
+    }
+    void SwapElements (uint32_t a, uint32_t b) {
+        std::swap(m_elements[a], m_elements[b]);
+        m_blockTicks[a >> m_blockShift].Include(m_elements[a].m_ticks);
+        m_blockTicks[b >> m_blockShift].Include(m_elements[b].m_ticks);
+    }
+
+    std::vector<Element> m_elements{};
 
 private:
+    std::size_t GetBlockBytes () const { return static_cast<std::size_t>(m_stride) * GetBlockSize(); }
+    std::size_t GetBlockAlignment () const { return std::max<std::size_t>(m_alignment, ENCOSYS_POOL_BLOCK_ALIGNMENT_); }
+
+    Allocator* m_allocator{&HeapAllocator::Instance()};
     uint32_t m_elementSize{0};
-    uint32_t m_blockSize{0};
+    uint32_t m_stride{0};
+    uint32_t m_alignment{1};
+    uint32_t m_blockShift{0};
+    uint32_t m_blockMask{0};
     uint32_t m_capacity{0};
     uint32_t m_size{0};
     std::vector<uint8_t*> m_blocks{};
+    // One per allocated block, a deque since the atomics cannot move
+    std::deque<AtomicComponentTicks> m_blockTicks{};
+    DirtyBlocks m_dirtyBlocks{};
 };
 
 }
\ No newline at end of file
@@ -1,28 +1,29 @@
 #pragma once
 
 #include "BlockMemoryPool.h"
+#include <algorithm>
 #include <cassert>
+#include <cstring>
+#include <functional>
+#include <type_traits>
 
 namespace ecs {
 
 template <typename T>
 class BlockObjectPool : public BlockMemoryPool {
 public:
-    explicit BlockObjectPool (uint32_t blockSize = 4096)
-        : BlockMemoryPool(sizeof(T), blockSize) {}
+    explicit BlockObjectPool (uint32_t blockSize = ENCOSYS_POOL_BLOCK_SIZE_, uint32_t alignment = alignof(T), Allocator& allocator = HeapAllocator::Instance())
+        : BlockMemoryPool(sizeof(T), blockSize, std::max<uint32_t>(alignment, alignof(T)), allocator) {}
+
+    ~BlockObjectPool () override {
+        DestroyLiveObjects();
+    }
 
     template <typename... Args>
-    uint32_t Create (Args&&... args) {
-        uint32_t index;
-        if (!m_freeIndices.empty()) {
-            index = m_freeIndices.back();
-            m_freeIndices.pop_back();
-        }
-        else {
-            index = GetSize();
-            Resize(GetSize() + 1);
-        }
+    uint32_t Create (EntityId owner, Args&&... args) {
+        const uint32_t index = AcquireIndex();
         new (GetData(index)) T(std::forward<Args>(args)...);
+        SetEntityId(index, owner);
         return index;
     }
 
@@ -34,18 +35,172 @@ public:
         return *reinterpret_cast<const T*>(BlockMemoryPool::GetData(index));
     }
 
+    // The owner of the copy must be assigned through SetEntityId
     uint32_t CreateFromCopy (uint32_t index) override {
-        return Create(GetObject(index));
+        if constexpr (std::is_trivially_copyable<T>::value) {
+            const uint32_t copyIndex = AcquireIndex();
+            memcpy(GetData(copyIndex), GetData(index), sizeof(T));
+            return copyIndex;
+        }
+        else {
+            return Create(c_invalidEntityId, GetObject(index));
+        }
+    }
+
+    // Copies are appended rather than taken from the free list so they stay contiguous. The owners of
+    // the copies must be assigned through SetEntityId.
+    uint32_t CreateCopies (const uint8_t* source, uint32_t count) override {
+        if constexpr (std::is_trivially_copyable<T>::value) {
+            return BlockMemoryPool::CreateCopies(source, count);
+        }
+        else {
+            const uint32_t first = GetSize();
+            Resize(first + count);
+            for (uint32_t index = first; index < first + count; ++index) {
+                new (GetData(index)) T(*reinterpret_cast<const T*>(source));
+            }
+            return first;
+        }
     }
 
     // Must not destroy the same index more than once
     virtual void Destroy (uint32_t index) override {
-        GetObject(index).~T();
+        if constexpr (!std::is_trivially_destructible<T>::value) {
+            GetObject(index).~T();
+        }
+        SetEntityId(index, c_invalidEntityId);
         m_freeIndices.push_back(index);
+        m_freeSorted = false;
+    }
+
+    // Trivially destructible objects are dropped without touching them, so this is O(blocks)
+    void Clear () override {
+        DestroyLiveObjects();
+        m_freeIndices.clear();
+        m_freeSorted = true;
+        BlockMemoryPool::Clear();
+    }
+
+    void Swap (uint32_t a, uint32_t b) override {
+        if constexpr (std::is_trivially_copyable<T>::value) {
+            BlockMemoryPool::Swap(a, b);
+        }
+        else {
+            T temp(std::move(GetObject(a)));
+            GetObject(a).~T();
+            Relocate(a, b);
+            new (GetData(b)) T(std::move(temp));
+            SwapElements(a, b);
+        }
+    }
+
+    // Holes are filled lowest first from the back of the pool, and free slots left at the back are
+    // dropped from the pool, so once this returns true the live objects are packed at the front
+    bool FillHoles (uint32_t maxMoves, std::vector<uint32_t>& filled) override {
+        // Sorted high to low, the highest free slots sit at the front and the lowest at the back
+        if (!m_freeSorted) {
+            std::sort(m_freeIndices.begin(), m_freeIndices.end(), std::greater<uint32_t>());
+            m_freeSorted = true;
+        }
+
+        uint32_t size = GetSize();
+        std::size_t trailing = 0;
+        for (uint32_t moves = 0;; ++moves) {
+            while (trailing < m_freeIndices.size() && m_freeIndices[trailing] == size - 1) {
+                ++trailing;
+                --size;
+            }
+            if (trailing == m_freeIndices.size() || moves == maxMoves) {
+                break;
+            }
+            const uint32_t hole = m_freeIndices.back();
+            m_freeIndices.pop_back();
+            Relocate(hole, size - 1);
+            MoveElement(hole, size - 1);
+            filled.push_back(hole);
+            --size;
+        }
+        m_freeIndices.erase(m_freeIndices.begin(), m_freeIndices.begin() + trailing);
+        Resize(size);
+        if (m_freeIndices.empty()) {
+            m_freeIndices.shrink_to_fit();
+            return true;
+        }
+        return false;
+    }
+
+    // Saved pools keep their free list, so a loaded pool hands out indices in the same order
+    void Save (SnapshotWriter& writer) const override {
+        BlockMemoryPool::Save(writer);
+        writer.WriteVector(m_freeIndices);
+        writer.Write(m_freeSorted);
+    }
+
+    bool Load (SnapshotReader& reader) override {
+        if (!BlockMemoryPool::Load(reader) || !reader.ReadVector(m_freeIndices) || !reader.Read(m_freeSorted)) {
+            Clear();
+            return false;
+        }
+        for (const uint32_t index : m_freeIndices) {
+            if (index >= GetSize()) {
+                Clear();
+                return reader.Fail();
+            }
+        }
+        return true;
+    }
+
+    void SaveState (SnapshotWriter& writer) const override {
+        BlockMemoryPool::SaveState(writer);
+        writer.WriteVector(m_freeIndices);
+        writer.Write(m_freeSorted);
+    }
+
+    bool LoadState (SnapshotReader& reader) override {
+        return BlockMemoryPool::LoadState(reader) && reader.ReadVector(m_freeIndices) && reader.Read(m_freeSorted);
     }
 
 private:
+    // Moves the object at src into the unconstructed slot at dst and destroys the original
+    void Relocate (uint32_t dst, uint32_t src) {
+        if constexpr (std::is_trivially_copyable<T>::value) {
+            memcpy(GetData(dst), GetData(src), sizeof(T));
+        }
+        else {
+            new (GetData(dst)) T(std::move(GetObject(src)));
+            GetObject(src).~T();
+        }
+    }
+
+    // Returns an unconstructed slot, reusing destroyed ones first
+    uint32_t AcquireIndex () {
+        if (!m_freeIndices.empty()) {
+            const uint32_t index = m_freeIndices.back();
+            m_freeIndices.pop_back();
+            return index;
+        }
+        const uint32_t index = GetSize();
+        Resize(index + 1);
+        return index;
+    }
+
+    void DestroyLiveObjects () {
+        if constexpr (!std::is_trivially_destructible<T>::value) {
+            std::vector<bool> isFree(GetSize(), false);
+            for (const uint32_t index : m_freeIndices) {
+                isFree[index] = true;
+            }
+            for (uint32_t i = 0; i < GetSize(); ++i) {
+                if (!isFree[i]) {
+                    GetObject(i).~T();
+                }
+            }
+        }
+    }
+
     std::vector<uint32_t> m_freeIndices{};
+    // Whether m_freeIndices is sorted high to low, the order FillHoles works in
+    bool m_freeSorted{true};
 };
 
 }
\ No newline at end of file
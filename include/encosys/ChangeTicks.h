@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace ecs {
+
+// Orders component writes against system runs. Encosys hands out one tick per system run and one for the
+// code between updates. Ticks wrap around, so they are compared by their difference, which is correct as
+// long as the two ticks are less than 2^31 apart.
+using ChangeTick = uint32_t;
+
+inline bool IsNewerTick (ChangeTick tick, ChangeTick since) {
+    return static_cast<int32_t>(tick - since) > 0;
+}
+
+// When a component was added to its entity and when it was last written. Archetype chunks also keep one
+// per component type that covers every row of the chunk, so unchanged chunks can be skipped as a whole.
+struct ComponentTicks {
+    ChangeTick m_added{0};
+    ChangeTick m_changed{0};
+
+    void Include (const ComponentTicks& other) {
+        if (IsNewerTick(other.m_added, m_added)) {
+            m_added = other.m_added;
+        }
+        if (IsNewerTick(other.m_changed, m_changed)) {
+            m_changed = other.m_changed;
+        }
+    }
+};
+
+// The ticks that cover every row of an archetype chunk. Parallel iteration hands rows of the same chunk
+// to several threads, which all raise them, so each tick only ever moves forward through a compare-exchange.
+struct AtomicComponentTicks {
+    std::atomic<ChangeTick> m_added{0};
+    std::atomic<ChangeTick> m_changed{0};
+
+    ComponentTicks Load () const {
+        return ComponentTicks{m_added.load(std::memory_order_relaxed), m_changed.load(std::memory_order_relaxed)};
+    }
+
+    void Include (const ComponentTicks& other) {
+        IncludeTick(m_added, other.m_added);
+        IncludeTick(m_changed, other.m_changed);
+    }
+
+private:
+    static void IncludeTick (std::atomic<ChangeTick>& tick, ChangeTick other) {
+        ChangeTick current = tick.load(std::memory_order_relaxed);
+        while (IsNewerTick(other, current) && !tick.compare_exchange_weak(current, other, std::memory_order_relaxed)) {
+        }
+    }
+};
+
+// Chunks are laid out, copied and snapshotted as raw bytes
+static_assert(sizeof(AtomicComponentTicks) == sizeof(ComponentTicks), "Chunk ticks must match the layout of the row ticks.");
+static_assert(std::atomic<ChangeTick>::is_always_lock_free, "Chunk ticks must not need a lock.");
+
+}
\ No newline at end of file
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "Archetype.h"
+#include "Soa.h"
+#include <type_traits>
+
+namespace ecs {
+
+// The column of one component type in an archetype chunk, handed to Encosys::ForEachChunk callbacks.
+// A const component type only grants read access.
+template <typename TComponent>
+class ChunkSpan {
+public:
+    using Component = std::remove_const_t<TComponent>;
+    using Layout = SoaLayout<Component>;
+    static constexpr bool c_readOnly = std::is_const<TComponent>::value;
+
+    ChunkSpan (Archetype& archetype, ComponentTypeId typeId, uint32_t chunk) :
+        m_archetype{&archetype},
+        m_typeId{typeId},
+        m_chunk{chunk} {
+    }
+
+    // The packed components of the chunk, for components stored whole
+    TComponent* Data () const {
+        static_assert(!Layout::c_enabled, "SoA components are accessed through Field.");
+        return reinterpret_cast<TComponent*>(m_archetype->GetColumn(m_typeId, m_chunk));
+    }
+
+    // The packed values of one field of an SoA component, aligned to ENCOSYS_SOA_COLUMN_ALIGNMENT_
+    template <auto Member>
+    auto* Field () const {
+        static_assert(Layout::c_enabled, "Only components with an SoaLayout have field columns.");
+        constexpr uint32_t field = Layout::template IndexOf<Member>();
+        static_assert(field < Layout::c_fieldCount, "The member is not listed in the SoaLayout of the component.");
+        using TField = typename MemberTraits<decltype(Member)>::Field;
+        using TResult = std::conditional_t<c_readOnly, const TField, TField>;
+        return reinterpret_cast<TResult*>(m_archetype->GetFieldColumn(m_typeId, field, m_chunk));
+    }
+
+private:
+    Archetype* m_archetype;
+    ComponentTypeId m_typeId;
+    uint32_t m_chunk;
+};
+
+}
\ No newline at end of file
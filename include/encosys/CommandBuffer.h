@@ -0,0 +1,101 @@
+#pragma once
+
+#include "Encosys.h"
+#include <utility>
+#include <vector>
+
+namespace ecs {
+
+// Records structural changes so they can be made while systems iterate or from worker threads.
+// Encosys owns one buffer per thread and plays them all back at the end of Update, applying the
+// commands by phase: creations, component additions and removals, activation changes and finally
+// destructions. Additions and removals of the same component keep the order they were recorded in,
+// buffer by buffer, and adding a component the entity already has replaces it. Commands targeting
+// entities destroyed in the meantime are dropped.
+class CommandBuffer {
+public:
+    explicit CommandBuffer (Encosys& encosys) : m_encosys{encosys} {}
+    ~CommandBuffer ();
+
+    CommandBuffer (const CommandBuffer&) = delete;
+    CommandBuffer& operator= (const CommandBuffer&) = delete;
+
+    // Returns a pending id that can only be used with this buffer until it is played back
+    EntityId Create (bool active = true);
+    void Destroy (EntityId e);
+    void SetActive (EntityId e, bool active);
+
+    template <typename TComponent, typename... TArgs>
+    void AddComponent (EntityId e, TArgs&&... args);
+
+    template <typename TComponent>
+    void RemoveComponent (EntityId e);
+
+    bool IsEmpty () const { return m_commands.empty() && m_pendingActive.empty(); }
+
+    // Drops every recorded command without playing it back
+    void Clear ();
+
+private:
+    friend class Encosys;
+
+    enum class CommandType : uint8_t {
+        RemoveComponent,
+        AddComponent,
+        SetActive,
+        Destroy
+    };
+
+    using PlayFunction = void (*)(Encosys& encosys, EntityId e, uint8_t* data);
+
+    struct Command {
+        CommandType m_type;
+        bool m_active;
+        ComponentTypeId m_typeId;
+        EntityId m_entity;
+        PlayFunction m_play;
+        uint8_t* m_data;
+    };
+
+    template <typename TComponent>
+    static void PlayAddComponent (Encosys& encosys, EntityId e, uint8_t* data) {
+        TComponent& component = *reinterpret_cast<TComponent*>(data);
+        // Another command may have added the component since this one was recorded
+        if (encosys.Get(e).HasComponent<TComponent>()) {
+            encosys.RemoveComponent<TComponent>(e);
+        }
+        encosys.AddComponent<TComponent>(e, std::move(component));
+        component.~TComponent();
+    }
+
+    template <typename TComponent>
+    static void PlayRemoveComponent (Encosys& encosys, EntityId e, uint8_t*) {
+        encosys.RemoveComponent<TComponent>(e);
+    }
+
+    uint8_t* AllocatePayload (uint32_t bytes, uint32_t alignment);
+    EntityId Resolve (EntityId e) const;
+
+    Encosys& m_encosys;
+    std::vector<Command> m_commands{};
+    std::vector<bool> m_pendingActive{};
+    std::vector<EntityId> m_createdIds{};
+    std::vector<uint8_t*> m_blocks{};
+    uint32_t m_blockUsed{0};
+};
+
+template <typename TComponent, typename... TArgs>
+void CommandBuffer::AddComponent (EntityId e, TArgs&&... args) {
+    using TDecayed = std::decay_t<TComponent>;
+    uint8_t* data = AllocatePayload(sizeof(TDecayed), alignof(TDecayed));
+    new (data) TDecayed(std::forward<TArgs>(args)...);
+    m_commands.push_back({CommandType::AddComponent, false, m_encosys.GetComponentTypeId<TDecayed>(), e, &PlayAddComponent<TDecayed>, data});
+}
+
+template <typename TComponent>
+void CommandBuffer::RemoveComponent (EntityId e) {
+    using TDecayed = std::decay_t<TComponent>;
+    m_commands.push_back({CommandType::RemoveComponent, false, m_encosys.GetComponentTypeId<TDecayed>(), e, &PlayRemoveComponent<TDecayed>, nullptr});
+}
+
+}
\ No newline at end of file
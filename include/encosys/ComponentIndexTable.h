@@ -0,0 +1,57 @@
+#pragma once
+
+#include "Allocator.h"
+#include "EncosysConfig.h"
+#include "Snapshot.h"
+#include <vector>
+
+namespace ecs {
+
+// Holds the pool indices of every entity in runs of one, two, four, ... indices, so an entity only pays for
+// the pool components it has. Runs of the same size share one array and are recycled through a free list.
+// Runs are addressed by offset, since growing the array of a size class moves every run of that class.
+class ComponentIndexTable {
+public:
+    using IndexArray = std::vector<uint32_t, StlAllocator<uint32_t>>;
+
+    explicit ComponentIndexTable (Allocator& allocator);
+
+    // Returns the offset of a free run that holds at least count indices and sets its size class
+    uint32_t Allocate (uint32_t count, uint8_t& sizeClass);
+    void Free (uint32_t offset, uint8_t sizeClass);
+    // Releases every run at once
+    void Clear ();
+
+    void Save (SnapshotWriter& writer) const;
+    bool Load (SnapshotReader& reader);
+
+    // Delta snapshots copy the index arrays in blocks and keep their sizes and free lists as state
+    uint8_t GetSizeClassCount () const { return static_cast<uint8_t>(m_sizeClasses.size()); }
+    ArrayBlocks<IndexArray> GetBlocks (uint8_t sizeClass) { return ArrayBlocks<IndexArray>(m_sizeClasses[sizeClass].m_indices, m_sizeClasses[sizeClass].m_dirtyBlocks); }
+    void SaveState (SnapshotWriter& writer) const;
+    bool LoadState (SnapshotReader& reader);
+
+    // Handing out a writable run marks its block, runs never straddle one since blocks are a multiple of every capacity
+    uint32_t* GetRun (uint32_t offset, uint8_t sizeClass) {
+        m_sizeClasses[sizeClass].m_dirtyBlocks.Mark(offset);
+        return m_sizeClasses[sizeClass].m_indices.data() + offset;
+    }
+    const uint32_t* GetRun (uint32_t offset, uint8_t sizeClass) const { return m_sizeClasses[sizeClass].m_indices.data() + offset; }
+
+    static uint32_t Capacity (uint8_t sizeClass) { return 1u << sizeClass; }
+
+private:
+    // Indices per dirty block, 4 KiB
+    static const uint32_t c_blockShift = 10;
+
+    struct SizeClass {
+        explicit SizeClass (Allocator& allocator) : m_indices{StlAllocator<uint32_t>(allocator)} {}
+        IndexArray m_indices;
+        std::vector<uint32_t> m_free{};
+        DirtyBlocks m_dirtyBlocks{c_blockShift};
+    };
+
+    std::vector<SizeClass> m_sizeClasses{};
+};
+
+} // namespace ecs
\ No newline at end of file
@@ -3,15 +3,19 @@
 #include "BlockObjectPool.h"
 #include "ComponentType.h"
 #include "EncosysConfig.h"
+#include "SparseSetPool.h"
+#include "TypeIndex.h"
 #include <array>
 #include <cassert>
 #include <map>
 #include <typeindex>
+#include <vector>
 
 namespace ecs {
 
 class ComponentRegistry {
 public:
+    explicit ComponentRegistry (Allocator& allocator = HeapAllocator::Instance()) : m_allocator{allocator} {}
     virtual ~ComponentRegistry () {
         for (uint32_t i = 0; i < Count(); ++i) {
             delete m_componentPools[i];
@@ -19,24 +23,61 @@ public:
     }
 
     template <typename TComponent>
-    ComponentTypeId Register () {
+    ComponentTypeId Register (ComponentStorage storage = DefaultStorage<TComponent>()) {
         using TDecayed = std::decay_t<TComponent>;
         const ComponentTypeId id = Count();
         assert(id < ENCOSYS_MAX_COMPONENTS_);
         assert(m_typeToId.find(typeid(TDecayed)) == m_typeToId.end());
-        m_componentTypes[id] = ComponentType(id, sizeof(TDecayed));
+        // SoA components only exist as field columns of archetype chunks
+        assert(!SoaLayout<TDecayed>::c_enabled || storage == ComponentStorage::Archetype);
+        if constexpr (SoaLayout<TDecayed>::c_enabled) {
+            static_assert(std::is_same<typename SoaLayout<TDecayed>::Component, TDecayed>::value, "SoaLayout fields must be members of the component.");
+        }
+        // Empty types are tags unless they are meant to split archetypes. A pool asked for anyway is still
+        // created, so the storage is never different from the one requested.
+        ENCOSYS_ASSERT_(IsTagComponent<TDecayed>::value ? storage == ComponentStorage::Tag || storage == ComponentStorage::Archetype : storage != ComponentStorage::Tag);
+        m_componentTypes[id] = ComponentType(id, sizeof(TDecayed), alignof(TDecayed), storage, &ObjectOps<TDecayed>::Instance());
         m_typeToId[typeid(TDecayed)] = id;
 
-        m_componentPools[id] = new BlockObjectPool<TDecayed>();
+        const uint32_t index = TypeIndex<ComponentRegistry>::Get<TDecayed>();
+        if (index >= m_indexToId.size()) {
+            m_indexToId.resize(index + 1, c_invalidIndex);
+        }
+        m_indexToId[index] = id;
+
+        // Archetype components live in the chunks of the ArchetypeRegistry instead of a pool
+        if (storage == ComponentStorage::Archetype) {
+            m_archetypeBitset.set(id);
+            return id;
+        }
+        if (storage == ComponentStorage::Tag) {
+            m_tagBitset.set(id);
+            return id;
+        }
+
+        if (storage == ComponentStorage::SparseSet) {
+            m_componentPools[id] = new SparseSetPool<TDecayed>(ENCOSYS_POOL_BLOCK_SIZE_, alignof(TDecayed), m_allocator);
+            m_sparseSetBitset.set(id);
+        }
+        else {
+            m_componentPools[id] = new BlockObjectPool<TDecayed>(ENCOSYS_POOL_BLOCK_SIZE_, alignof(TDecayed), m_allocator);
+        }
         assert(m_componentPools[id] != nullptr);
+        m_poolBitset.set(id);
         return id;
     }
 
     template <typename TComponent>
     ComponentTypeId GetTypeId () const {
-        auto it = m_typeToId.find(typeid(std::decay_t<TComponent>));
-        assert(it != m_typeToId.cend());
-        return it->second;
+        const uint32_t index = TypeIndex<ComponentRegistry>::Get<std::decay_t<TComponent>>();
+        assert(index < m_indexToId.size() && m_indexToId[index] != c_invalidIndex);
+        return m_indexToId[index];
+    }
+
+    // Slow path for tools that only have runtime type information, returns c_invalidIndex if unregistered
+    ComponentTypeId FindTypeId (std::type_index type) const {
+        auto it = m_typeToId.find(type);
+        return it != m_typeToId.cend() ? it->second : c_invalidIndex;
     }
 
     template <typename TComponent>
@@ -54,26 +95,49 @@ public:
     }
 
     template <typename TComponent>
-    bool HasType () {
-        return HasType(GetTypeId<TComponent>());
+    bool HasType () const {
+        const uint32_t index = TypeIndex<ComponentRegistry>::Get<std::decay_t<TComponent>>();
+        return index < m_indexToId.size() && m_indexToId[index] != c_invalidIndex;
     }
 
     template <typename TComponent>
-    auto& GetStorage () { return static_cast<BlockObjectPool<std::decay_t<TComponent>>&>(GetStorage(GetTypeId<TComponent>())); }
+    auto& GetStorage () { assert(GetType<TComponent>().Storage() == ComponentStorage::Pool); return static_cast<BlockObjectPool<std::decay_t<TComponent>>&>(GetStorage(GetTypeId<TComponent>())); }
+
+    template <typename TComponent>
+    const auto& GetStorage () const { assert(GetType<TComponent>().Storage() == ComponentStorage::Pool); return static_cast<const BlockObjectPool<std::decay_t<TComponent>>&>(GetStorage(GetTypeId<TComponent>())); }
 
     template <typename TComponent>
-    const auto& GetStorage () const { return static_cast<const BlockObjectPool<std::decay_t<TComponent>>&>(GetStorage(GetTypeId<TComponent>())); }
+    auto& GetSparseSet () { assert(GetType<TComponent>().Storage() == ComponentStorage::SparseSet); return static_cast<SparseSetPool<std::decay_t<TComponent>>&>(GetStorage(GetTypeId<TComponent>())); }
+
+    template <typename TComponent>
+    const auto& GetSparseSet () const { assert(GetType<TComponent>().Storage() == ComponentStorage::SparseSet); return static_cast<const SparseSetPool<std::decay_t<TComponent>>&>(GetStorage(GetTypeId<TComponent>())); }
+
+    SparseSetStorage& GetSparseSet (ComponentTypeId id) { assert(GetType(id).Storage() == ComponentStorage::SparseSet); return static_cast<SparseSetStorage&>(GetStorage(id)); }
+    const SparseSetStorage& GetSparseSet (ComponentTypeId id) const { assert(GetType(id).Storage() == ComponentStorage::SparseSet); return static_cast<const SparseSetStorage&>(GetStorage(id)); }
+
+    BlockMemoryPool& GetStorage (ComponentTypeId id) { assert(id < Count() && m_componentPools[id]); return *m_componentPools[id]; }
+    const BlockMemoryPool& GetStorage (ComponentTypeId id) const { assert(id < Count() && m_componentPools[id]); return *m_componentPools[id]; }
 
-    BlockMemoryPool& GetStorage (ComponentTypeId id) { assert(id < Count()); return *m_componentPools[id]; }
-    const BlockMemoryPool& GetStorage (ComponentTypeId id) const { assert(id < Count()); return *m_componentPools[id]; }
+    const ComponentBitset& GetArchetypeBitset () const { return m_archetypeBitset; }
+    const ComponentBitset& GetTagBitset () const { return m_tagBitset; }
+    // Pool and sparse set components, the only ones entities keep a component index for
+    const ComponentBitset& GetPoolBitset () const { return m_poolBitset; }
+    const ComponentBitset& GetSparseSetBitset () const { return m_sparseSetBitset; }
+    Allocator& GetAllocator () const { return m_allocator; }
 
     uint32_t Count () const { return static_cast<uint32_t>(m_typeToId.size()); }
     const ComponentType& operator[] (uint32_t index) const { return m_componentTypes[index]; }
 
 private:
+    Allocator& m_allocator;
     std::array<BlockMemoryPool*, ENCOSYS_MAX_COMPONENTS_> m_componentPools{};
     std::array<ComponentType, ENCOSYS_MAX_COMPONENTS_> m_componentTypes;
     std::map<std::type_index, ComponentTypeId> m_typeToId{};
+    std::vector<ComponentTypeId> m_indexToId{};
+    ComponentBitset m_archetypeBitset{};
+    ComponentBitset m_tagBitset{};
+    ComponentBitset m_poolBitset{};
+    ComponentBitset m_sparseSetBitset{};
 };
 
 } // namespace ecs
\ No newline at end of file
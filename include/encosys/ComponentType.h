@@ -1,23 +1,162 @@
 #pragma once
 
 #include "EncosysConfig.h"
+#include "MemoryUtil.h"
+#include "Soa.h"
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
 
 namespace ecs {
 
+enum class ComponentStorage {
+    Pool,
+    SparseSet,
+    Archetype,
+    // Empty types that only exist as a bit of the entity bitset
+    Tag
+};
+
+// Empty types carry no data and keep no ticks, so they default to tags
+template <typename TComponent>
+struct IsTagComponent : std::integral_constant<bool, std::is_empty<TComponent>::value && alignof(TComponent) <= alignof(std::max_align_t)> {};
+
+template <typename TComponent>
+constexpr ComponentStorage DefaultStorage () {
+    return IsTagComponent<std::decay_t<TComponent>>::value ? ComponentStorage::Tag : ComponentStorage::Pool;
+}
+
+class ComponentOps {
+public:
+    ComponentOps (bool triviallyCopyable, bool triviallyDestructible, const SoaField* fields, uint32_t fieldCount) :
+        m_triviallyCopyable{triviallyCopyable},
+        m_triviallyDestructible{triviallyDestructible},
+        m_fields{fields},
+        m_fieldCount{fieldCount} {
+    }
+    virtual ~ComponentOps () = default;
+
+    bool IsTriviallyCopyable () const { return m_triviallyCopyable; }
+    bool IsTriviallyDestructible () const { return m_triviallyDestructible; }
+    // The fields of an SoA component, none for components stored whole
+    const SoaField* Fields () const { return m_fields; }
+    uint32_t FieldCount () const { return m_fieldCount; }
+
+    virtual void CopyConstruct (uint8_t* dst, const uint8_t* src) const = 0;
+    // Copy constructs count consecutive objects at dst from the one at src
+    virtual void CopyConstructN (uint8_t* dst, const uint8_t* src, uint32_t count) const = 0;
+    // Move constructs into dst and destroys the object left behind in src
+    virtual void Relocate (uint8_t* dst, uint8_t* src) const = 0;
+    virtual void Destroy (uint8_t* data) const = 0;
+
+private:
+    bool m_triviallyCopyable;
+    bool m_triviallyDestructible;
+    const SoaField* m_fields;
+    uint32_t m_fieldCount;
+};
+
+template <typename T>
+class ObjectOps : public ComponentOps {
+public:
+    static const ObjectOps& Instance () {
+        static const ObjectOps s_instance;
+        return s_instance;
+    }
+
+    ObjectOps () : ComponentOps(std::is_trivially_copyable<T>::value, std::is_trivially_destructible<T>::value, SoaLayout<T>::Fields(), SoaLayout<T>::c_fieldCount) {}
+
+    void CopyConstruct (uint8_t* dst, const uint8_t* src) const override {
+        new (dst) T(*reinterpret_cast<const T*>(src));
+    }
+
+    void CopyConstructN (uint8_t* dst, const uint8_t* src, uint32_t count) const override {
+        if constexpr (std::is_trivially_copyable<T>::value) {
+            FillCopies(dst, src, sizeof(T), sizeof(T), count);
+        }
+        else {
+            for (uint32_t i = 0; i < count; ++i) {
+                new (dst + i * sizeof(T)) T(*reinterpret_cast<const T*>(src));
+            }
+        }
+    }
+
+    void Relocate (uint8_t* dst, uint8_t* src) const override {
+        T& object = *reinterpret_cast<T*>(src);
+        new (dst) T(std::move(object));
+        object.~T();
+    }
+
+    void Destroy (uint8_t* data) const override {
+        reinterpret_cast<T*>(data)->~T();
+    }
+};
+
 class ComponentType {
 public:
     ComponentType () {}
-    ComponentType (ComponentTypeId id, uint32_t bytes) :
+    ComponentType (ComponentTypeId id, uint32_t bytes, uint32_t alignment, ComponentStorage storage, const ComponentOps* ops) :
         m_id{ id },
-        m_bytes{ bytes } {
+        m_bytes{ bytes },
+        m_alignment{ alignment },
+        m_storage{ storage },
+        m_ops{ ops },
+        m_triviallyCopyable{ ops != nullptr && ops->IsTriviallyCopyable() },
+        m_triviallyDestructible{ ops != nullptr && ops->IsTriviallyDestructible() },
+        m_fields{ ops != nullptr ? ops->Fields() : nullptr },
+        m_fieldCount{ ops != nullptr ? ops->FieldCount() : 0 } {
     }
 
     ComponentTypeId Id () const { return m_id; }
     uint32_t Bytes () const { return m_bytes; }
+    uint32_t Alignment () const { return m_alignment; }
+    ComponentStorage Storage () const { return m_storage; }
+    // Pool and sparse set components live in a BlockMemoryPool and are addressed through the entity's component index
+    bool HasPool () const { return m_storage == ComponentStorage::Pool || m_storage == ComponentStorage::SparseSet; }
+    const ComponentOps& Ops () const { return *m_ops; }
+    bool IsTriviallyCopyable () const { return m_triviallyCopyable; }
+    bool IsTriviallyDestructible () const { return m_triviallyDestructible; }
+    bool IsSoa () const { return m_fieldCount > 0; }
+    uint32_t FieldCount () const { return m_fieldCount; }
+    const SoaField& GetField (uint32_t field) const { return m_fields[field]; }
+
+    // Forward to the ops, but copy trivially copyable types with memcpy and skip trivial destructors
+    void CopyConstruct (uint8_t* dst, const uint8_t* src) const {
+        if (m_triviallyCopyable) {
+            memcpy(dst, src, m_bytes);
+        }
+        else {
+            m_ops->CopyConstruct(dst, src);
+        }
+    }
+
+    void Relocate (uint8_t* dst, uint8_t* src) const {
+        if (m_triviallyCopyable) {
+            memcpy(dst, src, m_bytes);
+        }
+        else {
+            m_ops->Relocate(dst, src);
+        }
+    }
+
+    void Destroy (uint8_t* data) const {
+        if (!m_triviallyDestructible) {
+            m_ops->Destroy(data);
+        }
+    }
 
 private:
     ComponentTypeId m_id{};
     uint32_t m_bytes{};
+    uint32_t m_alignment{};
+    ComponentStorage m_storage{ComponentStorage::Pool};
+    const ComponentOps* m_ops{nullptr};
+    bool m_triviallyCopyable{false};
+    bool m_triviallyDestructible{false};
+    const SoaField* m_fields{nullptr};
+    uint32_t m_fieldCount{0};
 };
 
 }
\ No newline at end of file
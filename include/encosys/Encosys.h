@@ -1,34 +1,77 @@
 #pragma once
 
+#include "Allocator.h"
+#include "ArchetypeRegistry.h"
+#include "ChangeTicks.h"
+#include "ChunkSpan.h"
+#include "ComponentIndexTable.h"
 #include "ComponentRegistry.h"
 #include "EncosysConfig.h"
 #include "EntityId.h"
+#include "FrameAllocator.h"
 #include "FunctionTraits.h"
+#include "ObserverRegistry.h"
+#include "Prefab.h"
+#include "QueryFilter.h"
+#include "QueryRegistry.h"
+#include "Soa.h"
 #include "SingletonRegistry.h"
+#include "Snapshot.h"
+#include "SortUtil.h"
 #include "SystemRegistry.h"
+#include "SystemScheduler.h"
+#include "ThreadPool.h"
+#include <algorithm>
 #include <array>
-#include <unordered_map>
+#include <chrono>
+#include <functional>
 #include <vector>
 
 namespace ecs {
 
+class CommandBuffer;
+
+// Parallel batches start on multiples of c_batchAlignment entities so packed arrays split on cache line boundaries
+const uint32_t c_batchAlignment = 64;
+
+inline uint32_t AlignGrainSize (uint32_t grainSize) {
+    return (std::max(grainSize, 1u) + c_batchAlignment - 1) / c_batchAlignment * c_batchAlignment;
+}
+
+// AddComponent cannot return a reference to an SoA component since its fields live in separate columns
+template <typename TComponent>
+using ComponentRef = std::conditional_t<SoaLayout<std::decay_t<TComponent>>::c_enabled, void, TComponent&>;
+
 class EntityStorage {
 public:
     explicit EntityStorage        (EntityId id) : m_id{id} {}
 
     EntityId GetId                () const { return m_id; }
+    const ComponentBitset& GetBitset () const { return m_bitset; }
 
     bool     HasComponent         (ComponentTypeId typeId) const { return m_bitset[typeId]; }
     bool     HasComponentBitset   (const ComponentBitset& bitset) const { return (m_bitset & bitset) == bitset; }
 
-    uint32_t GetComponentIndex    (ComponentTypeId typeId) const { return m_components[typeId]; }
-    void     SetComponentIndex    (ComponentTypeId typeId, uint32_t index) { m_bitset.set(typeId); m_components[typeId] = index; }
-    void     RemoveComponentIndex (ComponentTypeId typeId) { m_bitset.set(typeId, false); m_components[typeId] = c_invalidIndex; }
+    // Archetype components and tags are only a bit, pool components also get an index through Encosys::SetComponentIndex
+    void     SetComponentBit      (ComponentTypeId typeId, bool set) { m_bitset.set(typeId, set); }
+
+    // The run of the ComponentIndexTable that holds the pool indices, packed in type order
+    uint32_t GetIndexRun          () const { return m_indexRun; }
+    uint8_t  GetIndexClass        () const { return m_indexClass; }
+    void     SetIndexRun          (uint32_t run, uint8_t sizeClass) { m_indexRun = run; m_indexClass = sizeClass; }
+
+    // Archetype components are all addressed through the same archetype row
+    uint32_t GetArchetype         () const { return m_archetype; }
+    uint32_t GetArchetypeRow      () const { return m_archetypeRow; }
+    void     SetArchetype         (uint32_t archetype, uint32_t row) { m_archetype = archetype; m_archetypeRow = row; }
 
 private:
     EntityId m_id;
     ComponentBitset m_bitset;
-    std::array<uint32_t, ENCOSYS_MAX_COMPONENTS_> m_components;
+    uint32_t m_indexRun{c_invalidIndex};
+    uint8_t m_indexClass{0};
+    uint32_t m_archetype{c_invalidIndex};
+    uint32_t m_archetypeRow{c_invalidIndex};
 };
 
 class Entity {
@@ -39,14 +82,19 @@ public:
     EntityId                                          GetId              () const { return m_storage->GetId(); }
 
     bool                                              HasComponentBitset (const ComponentBitset& bitset) const { return m_storage->HasComponentBitset(bitset); }
-    template <typename TComponent> bool               HasComponent       () const { return m_storage->HasComponent(m_encosys->GetComponentTypeId<TComponent>().Id()); }
+    template <typename TComponent> bool               HasComponent       () const;
 
-    template <typename TComponent, typename... TArgs> TComponent& AddComponent (TArgs&&... args) { return m_encosys->AddComponent<TComponent>(GetId(), std::forward<TArgs>(args)...); }
+    template <typename TComponent, typename... TArgs> ComponentRef<TComponent> AddComponent (TArgs&&... args);
     template <typename TComponent> TComponent*        GetComponent       ();
     template <typename TComponent> const TComponent*  GetComponent       () const;
-    template <typename TComponent> ComponentTypeId    GetComponentTypeId () const { return m_encosys->GetComponentTypeId<TComponent>(); }
+    template <typename TComponent> ComponentTypeId    GetComponentTypeId () const;
 
 private:
+    friend class SystemEntity;
+
+    // Returns the component like GetComponent and records a write at the tick
+    template <typename TComponent> TComponent*        WriteComponent     (ChangeTick tick);
+
     Encosys* m_encosys;
     EntityStorage* m_storage{nullptr};
 };
@@ -54,26 +102,102 @@ private:
 class Encosys {
 public:
     // Constructors
-    Encosys () = default;
+    Encosys () : Encosys(0) {}
+    // Systems that do not conflict run concurrently on the worker threads, none runs them serially
+    explicit Encosys (uint32_t workerCount);
+    // Component pools, archetype chunks and entity storage come from the allocator, which must outlive the Encosys
+    Encosys (uint32_t workerCount, Allocator& allocator);
+    ~Encosys ();
+
+    Encosys (const Encosys&) = delete;
+    Encosys& operator= (const Encosys&) = delete;
 
     // Entity members
     Entity                                                        Create               (bool active = true);
+    // Creates count active entities that each own a copy of the given components, storage is reserved once up front
+    template <typename... TComponents> std::vector<EntityId>      CreateBatch          (uint32_t count, const TComponents&... components);
     EntityId                                                      Copy                 (EntityId e, bool active = true);
     Entity                                                        Get                  (EntityId e);
     void                                                          Destroy              (EntityId e);
     bool                                                          IsValid              (EntityId e) const;
     bool                                                          IsActive             (EntityId e) const;
     void                                                          SetActive            (EntityId e, bool active);
+    // Destroys every entity at once, pools and archetypes of trivially destructible components are emptied in O(blocks)
+    void                                                          Clear                ();
+    // Packs pool components into the front of their pools in entity order and releases the blocks left empty.
+    // Returns false when it ran out of time, and the next call resumes where this one stopped.
+    bool                                                          Compact              (std::chrono::microseconds budget = std::chrono::microseconds::max());
+    // Orders the active entities by a key computed from one of their components, such as a Morton code of the
+    // position or a material id, so iterating them visits neighbors together. Active entities without the
+    // component go last. Incremental sorts assume the keys were in order after the previous sort and only fix
+    // up the entities whose keys changed. Pools and archetype rows are then reordered to follow unless told not to,
+    // which an incremental sort leaves to the next calls of Compact.
+    template <typename TComponent, typename TKeyFunction>
+    void                                                          SortEntities         (TKeyFunction&& key, bool incremental = false, bool sortStorage = true);
     uint32_t                                                      EntityCount          () const;
     uint32_t                                                      ActiveEntityCount    () const;
+    Allocator&                                                    GetAllocator         () const { return m_componentRegistry.GetAllocator(); }
 
     // Component members
-    template <typename TComponent> ComponentTypeId                RegisterComponent    ();
-    template <typename TComponent, typename... TArgs> TComponent& AddComponent         (EntityId e, TArgs&&... args);
+    template <typename TComponent> ComponentTypeId                RegisterComponent    (ComponentStorage storage = DefaultStorage<TComponent>());
+    template <typename TComponent, typename... TArgs> ComponentRef<TComponent> AddComponent (EntityId e, TArgs&&... args);
     template <typename TComponent> void                           RemoveComponent      (EntityId e);
     template <typename TComponent> TComponent*                    GetComponent         (EntityId e);
     template <typename TComponent> const TComponent*              GetComponent         (EntityId e) const;
+    // SoA components have no address, so single entities read and write them by value
+    template <typename TComponent> TComponent                     LoadComponent        (EntityId e) const;
+    template <typename TComponent> void                           StoreComponent       (EntityId e, const TComponent& component);
     template <typename TComponent> ComponentTypeId                GetComponentTypeId   () const;
+    template <typename TComponent> const ComponentType&           GetComponentType     () const;
+    const ComponentType&                                          GetComponentType     (ComponentTypeId typeId) const;
+
+    // Change members
+    // Writes outside systems are recorded at this tick, and every system run gets a newer one
+    ChangeTick                                                    GetChangeTick        () const { return m_changeTick; }
+    // When the component was added and last written, nullptr if the entity does not have it or it is a tag
+    template <typename TComponent> const ComponentTicks*          GetComponentTicks    (EntityId e) const;
+    // Records a write made through a pointer obtained earlier
+    template <typename TComponent> void                           MarkChanged          (EntityId e);
+    // Builds the filter for filter types such as Changed<T> and Added<T>
+    template <typename... TFilters> QueryFilter                   MakeQueryFilter      () const;
+
+    // Observer members
+    // Calls the observer with every entity that had the event happen to the component type since the previous delivery,
+    // once per Update after the commands are played back. OnAdd batches skip entities that lost the component again.
+    template <typename TComponent> void                           Observe              (ComponentEvent event, ObserverCallback observer);
+    // Delivers the pending events now, events raised by the observers are delivered by the next call
+    void                                                          DispatchObservers    ();
+
+    // Prefab members
+    // Freezes a copy of the components the entity has now, the entity itself is left untouched
+    Prefab                                                        CreatePrefab         (EntityId e) const;
+    // Creates count active entities with copies of the prefab components, copying each component type in bulk
+    std::vector<EntityId>                                         Instantiate          (const Prefab& prefab, uint32_t count);
+
+    // Snapshot members
+    // Writes the entities, components, singletons and change ticks to a versioned binary file. Every pool,
+    // archetype and singleton type must be trivially copyable and no commands may be pending. Returns false
+    // when a type cannot be saved or the file cannot be written.
+    bool                                                          SaveSnapshot         (const char* path) const;
+    // Replaces the world with a snapshot saved by a build that registered the same component and singleton
+    // types in the same order. Observers are not notified. Returns false with the world untouched when the
+    // file cannot be opened or was saved with other types, and false with the world empty when it is truncated.
+    bool                                                          LoadSnapshot         (const char* path);
+
+    // Rollback members
+    // Records the world in memory and returns the id of the snapshot. Only the pool blocks, archetype chunks,
+    // entity storage and singletons written since the previous snapshot are copied, the first one and the first
+    // after ClearSnapshots copy everything. The same types and conditions as SaveSnapshot apply, and components
+    // must be written through the paths Changed<T> sees, since those are the ones that mark blocks dirty.
+    // Returns c_invalidIndex when a type cannot be captured.
+    uint32_t                                                      CaptureSnapshot      ();
+    // Rewinds the world to a retained snapshot, copying back only what was written since, and drops the snapshots
+    // taken after it so the next capture reuses their ids. Observers are not notified and queries are rebuilt in
+    // entity order. Returns false when the snapshot is not retained or the registered types changed since.
+    bool                                                          RestoreSnapshot      (uint32_t snapshot);
+    // Snapshots retained for RestoreSnapshot, ENCOSYS_SNAPSHOT_HISTORY_ by default. The oldest are folded into the next.
+    void                                                          SetSnapshotCapacity  (uint32_t capacity);
+    void                                                          ClearSnapshots       ();
 
     // Singleton members
     template <typename TSingleton> SingletonTypeId                RegisterSingleton    ();
@@ -89,37 +213,217 @@ public:
     void                                                          Initialize           ();
     void                                                          Update               (TimeDelta delta);
 
+    // Command members
+    // Returns the command buffer of the calling thread, only one thread outside the pool may record at a time
+    CommandBuffer&                                                GetCommandBuffer     ();
+    // Applies every recorded command, Update does this once all systems have run
+    void                                                          PlaybackCommands     ();
+    // Returns the frame allocator of the calling thread, every frame allocator is reset at the end of Update
+    FrameAllocator&                                               GetFrameAllocator    ();
+
     // Other members
-    template <typename TCallback> void                            ForEach              (TCallback&& callback);
+    // Filter types such as Changed<T> can be given as template arguments, outside systems their ticks are
+    // compared against the end of the Update before last, so they cover the last Update and everything since
+    template <typename... TFilters, typename TCallback> void      ForEach              (TCallback&& callback);
+    // Same as ForEach but batches run concurrently on the worker threads, so the callback must be thread safe
+    template <typename... TFilters, typename TCallback> void      ParallelForEach      (TCallback&& callback, uint32_t grainSize = ENCOSYS_PARALLEL_GRAIN_SIZE_);
+    // Calls the callback once per chunk of the matching archetypes with the row count and a ChunkSpan per component,
+    // which exposes whole columns for vectorized loops. Every requested component must be stored in archetypes.
+    // Tick filters skip the chunks where no row passes, but the rows of a visited chunk are not filtered.
+    template <typename... TFilters, typename TCallback> void      ForEachChunk         (TCallback&& callback);
+    // Same as ForEachChunk but chunks are spread across the worker threads, so the callback must be thread safe
+    template <typename... TFilters, typename TCallback> void      ParallelForEachChunk (TCallback&& callback);
+    // Splits [0, count) into batches of grainSize and runs them on the worker threads, or inline when grainSize is 0
+    void                                                          ParallelFor          (uint32_t count, uint32_t grainSize, const std::function<void(uint32_t, uint32_t)>& batch);
+    // Drops the entity lists cached for ForEach calls, systems keep theirs. Update releases the least recently
+    // used beyond ENCOSYS_MAX_CACHED_QUERIES_ on its own. Must not be called from inside a ForEach.
+    void                                                          ReleaseQueries       ();
     Entity                                                        operator[]           (uint32_t index) { return Entity(this, &m_entities[index]); }
 
 private:
     friend class Entity;
+    friend class SystemEntity;
+    friend class SystemIter;
+    friend class SystemIterType;
+
+    // Where an interrupted Compact resumes: the pool, the next entity to visit and the index it should get.
+    // After an incremental sort it also puts the archetype rows in entity order, handing out the next row of each.
+    struct CompactCursor {
+        ComponentTypeId m_typeId{0};
+        uint32_t m_entityIndex{0};
+        uint32_t m_componentIndex{0};
+        bool m_sortRows{false};
+        std::vector<uint32_t> m_nextRows{};
+    };
+
+    // Maps the index of an EntityId to the position of the entity in m_entities
+    struct EntitySlot {
+        uint32_t m_entityIndex{c_invalidIndex};
+        uint32_t m_generation{0};
+    };
+
     // Helper members
+    EntityId CreateId ();
+    void DestroyId (EntityId e);
+    uint32_t FindEntityIndex (EntityId e) const;
     void IndexSwapEntities (uint32_t lhsIndex, uint32_t rhsIndex);
     bool IndexIsActive (uint32_t index) const;
     void IndexSetActive (uint32_t& index, bool active);
 
+    // Appends count active entities without components, they end up at the back of the active range
+    void CreateEntities (uint32_t count, std::vector<EntityId>& ids);
+    // Gives the entities in [first, first + count) consecutive rows in the archetype for the bitset
+    void AddArchetypeRows (uint32_t first, uint32_t count, const ComponentBitset& bitset);
+    template <typename TComponent>
+    void CreateBatchComponent (uint32_t first, uint32_t count, const TComponent& component);
+
+    // Moves the entity into the archetype that includes the SoA component and scatters it into the new row
+    void AddSoaComponent (EntityId e, ComponentTypeId typeId, const uint8_t* component);
+    void LoadSoaComponent (EntityId e, ComponentTypeId typeId, uint8_t* dst) const;
+    void StoreSoaComponent (EntityId e, ComponentTypeId typeId, const uint8_t* src);
+
+    // Moves the archetype components of an entity into the archetype for the given bitset. Components missing
+    // from the new archetype are destroyed and components missing from the old one are left uninitialized.
+    void ArchetypeMove (EntityStorage& entity, const ComponentBitset& bitset, bool active);
+
+    // Destroys a pool or sparse set component and patches the index of any component moved into its place
+    void DestroyPoolComponent (ComponentTypeId typeId, uint32_t index);
+
+    // Returns the cached query for the bitset, building it from the active entities on first use. Pinned queries
+    // are never released, which systems rely on since they keep a reference.
+    const Query& FindOrCreateQuery (const ComponentBitset& bitset, bool pinned = false);
+    // Must be called whenever the bitset or activity of an entity changes to keep the queries in sync
+    void UpdateQueries (EntityId e, const ComponentBitset& oldBitset, bool oldActive, const ComponentBitset& newBitset, bool newActive);
+
+    // The index of a pool component is found by counting the pool components of the entity with a lower type id
+    uint32_t GetComponentIndex (const EntityStorage& entity, ComponentTypeId typeId) const;
+    // Overwrites the index of a component the entity has, or inserts it and sets the bit
+    void SetComponentIndex (EntityStorage& entity, ComponentTypeId typeId, uint32_t index);
+    // Drops the index and clears the bit, the run is released once it is empty
+    void RemoveComponentIndex (EntityStorage& entity, ComponentTypeId typeId);
+    // Moves the indices into a run that holds at least count of them
+    void ReserveComponentIndices (EntityStorage& entity, uint32_t count);
+    uint32_t ComponentIndexRank (const EntityStorage& entity, ComponentTypeId typeId) const;
+
+    uint8_t* GetComponentData (const EntityStorage& entity, ComponentTypeId typeId);
+    const uint8_t* GetComponentData (const EntityStorage& entity, ComponentTypeId typeId) const;
+
+    // Stamp the ticks of a component, the chunk summary included for archetype components
+    void MarkAdded (const EntityStorage& entity, ComponentTypeId typeId);
+    void MarkChanged (const EntityStorage& entity, ComponentTypeId typeId, ChangeTick tick);
+    const ComponentTicks& GetComponentTicks (const EntityStorage& entity, ComponentTypeId typeId) const;
+
+    // Whether the whole filter passes for an entity, or whether the tick filters pass for an archetype row or for
+    // any row of an archetype chunk, whose masks were already decided for the archetype
+    bool PassesFilter (EntityId e, const QueryFilter& filter, ChangeTick since) const;
+    bool PassesFilter (const EntityStorage& entity, const QueryFilter& filter, ChangeTick since) const;
+    bool PassesFilter (const Archetype& archetype, uint32_t row, const QueryFilter& filter, ChangeTick since) const;
+    bool ChunkPassesFilter (const Archetype& archetype, uint32_t chunk, const QueryFilter& filter, ChangeTick since) const;
+    // Calls visit with the index of every active entity that has the bitset and passes a filter with tick conditions.
+    // Only the pool blocks or archetype chunks of the first filtered component written since the tick are visited,
+    // and the rest are skipped without touching their entities.
+    void ForEachFiltered (const ComponentBitset& bitset, const QueryFilter& filter, ChangeTick since, const std::function<void(uint32_t)>& visit) const;
+
     template <typename TCallback, typename... Args, std::size_t... Seq>
-    void UnpackAndCallback (EntityStorage& entity, TCallback&& callback, TypeList<Args...>, Sequence<Seq...>);
+    void UnpackAndCallback (EntityStorage& entity, const std::array<ComponentTypeId, sizeof...(Args)>& typeIds, ChangeTick tick, TCallback&& callback, TypeList<Args...>, Sequence<Seq...>);
+
+    template <typename... TFilters, typename TCallback>
+    void ForEachBatched (TCallback&& callback, uint32_t grainSize);
+
+    // Snapshots copy raw bytes, so every type with storage must be trivially copyable
+    bool CanSnapshot () const;
+    // The change ticks of the world and of every system, which file and delta snapshots both keep
+    void SaveTicks (SnapshotWriter& writer) const;
+    void LoadTicks (SnapshotReader& reader);
+    // Records a write to an entity for delta snapshots, entities that are not stored in m_entities yet are skipped
+    void MarkEntity (const EntityStorage& entity);
+    // Inserts every active entity into the queries, which are never saved
+    void RebuildQueries ();
+
+    // Moves the active entity at order[i] to position i, then reorders the queries and optionally the storage to match
+    void ApplyEntityOrder (const std::vector<uint32_t>& order, bool incremental, bool sortStorage);
+    // Gives the entities of each archetype their rows in entity order, resuming from the cursor until out of time
+    bool SortArchetypeRows (CompactCursor& cursor, const std::function<bool()>& outOfTime);
+    // Splits the active entities by the last sort: those with unchanged keys, put back in the order it left them in,
+    // those whose key component was written or added since, or that it did not place, and those without the component
+    void SplitSortedEntities (ComponentTypeId typeId, std::vector<uint32_t>& kept, std::vector<uint32_t>& moved, std::vector<uint32_t>& unkeyed) const;
+    // Remembers the position of every keyed active entity, and moves later writes past the tick the sort ran at
+    void RecordSortOrder (ComponentTypeId typeId);
+
+    // Lists the chunks of the active archetypes that store every component of the bitset and pass the masks of the filter
+    void FindArchetypeChunks (const ComponentBitset& bitset, const QueryFilter& filter, std::vector<std::pair<uint32_t, uint32_t>>& chunks) const;
+
+    // Returns the sparse set to drive an iteration over the bitset from, which is the smallest storage of the bitset
+    // when that is a sparse set, and c_invalidIndex otherwise
+    ComponentTypeId FindSparseSetDriver (const ComponentBitset& bitset) const;
+
+    // Visits the chunks that also store the required components and pass the filter since the given tick, stamping writable spans
+    // with the other tick, and checks the span types against the access of the system if any
+    template <typename TCallback>
+    void ForEachChunkBatched (TCallback&& callback, const ComponentBitset& requiredBitset, const QueryFilter& filter, ChangeTick since, ChangeTick tick, bool parallel, const SystemType* systemType);
+
+    template <typename TCallback, typename... Args, std::size_t... Seq>
+    void ChunkSpanCallback (Archetype& archetype, uint32_t chunk, const std::array<ComponentTypeId, sizeof...(Args)>& typeIds, ChangeTick tick, TCallback&& callback, TypeList<Args...>, Sequence<Seq...>);
+
+    // Like UnpackAndCallback, except the component of the driving sparse set is the one at index
+    template <typename TCallback, typename... Args, std::size_t... Seq>
+    void SparseSetUnpackAndCallback (EntityStorage& entity, ComponentTypeId setTypeId, uint32_t index, const std::array<ComponentTypeId, sizeof...(Args)>& typeIds, ChangeTick tick, TCallback&& callback, TypeList<Args...>, Sequence<Seq...>);
+
+    template <typename TCallback, typename... Args, std::size_t... Seq>
+    void ArchetypeChunkForEach (Archetype& archetype, uint32_t chunk, const std::array<ComponentTypeId, sizeof...(Args)>& typeIds, const QueryFilter& filter, ChangeTick since, ChangeTick tick, TCallback&& callback, TypeList<Args...>, Sequence<Seq...>);
 
     // Member variables
     ComponentRegistry m_componentRegistry;
+    ArchetypeRegistry m_archetypeRegistry;
+    QueryRegistry m_queryRegistry;
     SingletonRegistry m_singletonRegistry;
     SystemRegistry m_systemRegistry;
-    std::unordered_map<EntityId, uint32_t> m_idToEntity;
-    std::vector<EntityStorage> m_entities;
-    uint32_t m_entityIdCounter{};
+    ObserverRegistry m_observerRegistry;
+    SystemScheduler m_systemScheduler;
+    ThreadPool m_threadPool;
+    std::vector<CommandBuffer*> m_commandBuffers;
+    std::vector<FrameAllocator*> m_frameAllocators;
+    std::vector<EntitySlot, StlAllocator<EntitySlot>> m_slots;
+    std::vector<uint32_t, StlAllocator<uint32_t>> m_freeSlots;
+    std::vector<EntityStorage, StlAllocator<EntityStorage>> m_entities;
+    ComponentIndexTable m_componentIndices;
     uint32_t m_entityActiveCount{};
+    CompactCursor m_compactCursor{};
+    // The key component of the last SortEntities, the tick it ran at and the position it gave each slot's entity
+    ComponentTypeId m_sortTypeId{c_invalidIndex};
+    ChangeTick m_sortTick{0};
+    std::vector<uint32_t> m_sortRanks{};
+    // Blocks of entities and slots written since the last delta snapshot, 256 entities and 1024 slots each
+    DirtyBlocks m_dirtyEntities{8};
+    DirtyBlocks m_dirtySlots{10};
+    SnapshotHistory m_snapshotHistory{ENCOSYS_SNAPSHOT_HISTORY_};
+    // Tags have no storage, so all of them are read through this address. Empty types have no state to write.
+    alignas(std::max_align_t) static inline uint8_t s_tagData[1]{};
+    // The tick of writes outside systems, the tick ForEach filters compare against and the tick the last Update ended at
+    ChangeTick m_changeTick{1};
+    ChangeTick m_filterTick{0};
+    ChangeTick m_updateEndTick{0};
 };
 
+template <typename TComponent>
+bool Entity::HasComponent () const {
+    return m_storage->HasComponent(m_encosys->GetComponentTypeId<TComponent>());
+}
+
+template <typename TComponent, typename... TArgs>
+ComponentRef<TComponent> Entity::AddComponent (TArgs&&... args) {
+    return m_encosys->AddComponent<TComponent>(GetId(), std::forward<TArgs>(args)...);
+}
+
 template <typename TComponent>
 TComponent* Entity::GetComponent () {
-    return const_cast<TComponent*>(static_cast<const Entity*>(this)->GetComponent<TComponent>());
+    return WriteComponent<TComponent>(m_encosys->m_changeTick);
 }
 
 template <typename TComponent>
 const TComponent* Entity::GetComponent () const {
+    static_assert(!SoaLayout<std::decay_t<TComponent>>::c_enabled, "SoA components are accessed through LoadComponent, StoreComponent and ForEachChunk.");
+
     // Retrieve the registered type of the component
     const ComponentTypeId typeId = m_encosys->GetComponentTypeId<TComponent>();
 
@@ -128,64 +432,318 @@ const TComponent* Entity::GetComponent () const {
         return nullptr;
     }
 
-    // Retrieve the storage for this component type
-    const auto& storage = m_encosys->m_componentRegistry.GetStorage<TComponent>();
-    return &storage.GetObject(m_storage->GetComponentIndex(typeId));
+    return reinterpret_cast<const TComponent*>(m_encosys->GetComponentData(*m_storage, typeId));
 }
 
 template <typename TComponent>
-ComponentTypeId Encosys::RegisterComponent () {
-    return m_componentRegistry.Register<TComponent>();
+ComponentTypeId Entity::GetComponentTypeId () const {
+    return m_encosys->GetComponentTypeId<TComponent>();
 }
 
-template <typename TComponent, typename... TArgs>
-TComponent& Encosys::AddComponent (EntityId e, TArgs&&... args) {
-    // Verify this entity exists
-    auto entityIter = m_idToEntity.find(e);
-    ENCOSYS_ASSERT_(entityIter != m_idToEntity.end());
+template <typename TComponent>
+TComponent* Entity::WriteComponent (ChangeTick tick) {
+    const TComponent* component = static_cast<const Entity*>(this)->GetComponent<TComponent>();
+    if (component != nullptr) {
+        m_encosys->MarkChanged(*m_storage, GetComponentTypeId<TComponent>(), tick);
+    }
+    return const_cast<TComponent*>(component);
+}
 
-    // Retrieve the registered type of the component
+template <typename... TComponents>
+std::vector<EntityId> Encosys::CreateBatch (uint32_t count, const TComponents&... components) {
+    std::vector<EntityId> ids;
+    if (count == 0) {
+        return ids;
+    }
+
+    ComponentBitset bitset{};
+    (bitset.set(m_componentRegistry.GetTypeId<TComponents>()), ...);
+    ENCOSYS_ASSERT_(bitset.count() == sizeof...(TComponents));
+
+    // The new entities occupy the back of the active range, so every component type is filled in one linear pass
+    CreateEntities(count, ids);
+    const uint32_t first = m_entityActiveCount - count;
+    const ComponentBitset archetypeBitset = bitset & m_componentRegistry.GetArchetypeBitset();
+    if (archetypeBitset.any()) {
+        AddArchetypeRows(first, count, archetypeBitset);
+    }
+    const uint32_t indexCount = static_cast<uint32_t>((bitset & m_componentRegistry.GetPoolBitset()).count());
+    if (indexCount > 0) {
+        for (uint32_t i = first; i < first + count; ++i) {
+            ReserveComponentIndices(m_entities[i], indexCount);
+        }
+    }
+    (CreateBatchComponent(first, count, components), ...);
+
+    m_queryRegistry.InsertBatch(ids.data(), count, bitset);
+    (m_observerRegistry.RecordBatch(m_componentRegistry.GetTypeId<TComponents>(), ComponentEvent::OnAdd, ids.data(), count), ...);
+    return ids;
+}
+
+template <typename TComponent>
+void Encosys::CreateBatchComponent (uint32_t first, uint32_t count, const TComponent& component) {
     const ComponentTypeId typeId = m_componentRegistry.GetTypeId<TComponent>();
+    const ComponentStorage storage = m_componentRegistry.GetType(typeId).Storage();
 
-    // Retrieve the storage for this component type
-    auto& storage = m_componentRegistry.GetStorage<TComponent>();
+    if (storage == ComponentStorage::Tag) {
+        for (uint32_t i = first; i < first + count; ++i) {
+            m_entities[i].SetComponentBit(typeId, true);
+        }
+    }
+    else if (storage == ComponentStorage::Archetype) {
+        Archetype& archetype = m_archetypeRegistry[m_entities[first].GetArchetype()];
+        const uint32_t firstRow = m_entities[first].GetArchetypeRow();
+        for (uint32_t i = 0; i < count; ++i) {
+            m_entities[first + i].SetComponentBit(typeId, true);
+            if constexpr (SoaLayout<TComponent>::c_enabled) {
+                archetype.StoreComponent(m_componentRegistry.GetType(typeId), firstRow + i, reinterpret_cast<const uint8_t*>(&component));
+            }
+            else {
+                new (archetype.GetComponentData(typeId, firstRow + i)) TComponent(component);
+            }
+            archetype.MarkAdded(typeId, firstRow + i, m_changeTick);
+        }
+    }
+    else if (storage == ComponentStorage::SparseSet) {
+        auto& pool = m_componentRegistry.GetSparseSet<TComponent>();
+        pool.Reserve(pool.GetSize() + count);
+        for (uint32_t i = first; i < first + count; ++i) {
+            const uint32_t index = pool.Create(m_entities[i].GetId(), component);
+            pool.MarkAdded(index, m_changeTick);
+            SetComponentIndex(m_entities[i], typeId, index);
+        }
+    }
+    else {
+        auto& pool = m_componentRegistry.GetStorage<TComponent>();
+        pool.Reserve(pool.GetSize() + count);
+        for (uint32_t i = first; i < first + count; ++i) {
+            const uint32_t index = pool.Create(m_entities[i].GetId(), component);
+            pool.MarkAdded(index, m_changeTick);
+            SetComponentIndex(m_entities[i], typeId, index);
+        }
+    }
+}
 
-    // Create the component and set the component index for this entity
-    uint32_t componentIndex = storage.Create(std::forward<TArgs>(args)...);
-    m_entities[entityIter->second].SetComponentIndex(typeId, componentIndex);
-    return storage.GetObject(componentIndex);
+template <typename TComponent>
+ComponentTypeId Encosys::RegisterComponent (ComponentStorage storage) {
+    return m_componentRegistry.Register<TComponent>(storage);
+}
+
+template <typename TComponent, typename... TArgs>
+ComponentRef<TComponent> Encosys::AddComponent (EntityId e, TArgs&&... args) {
+    using TDecayed = std::decay_t<TComponent>;
+    // SoA components are scattered into their field columns, so there is no object to return
+    if constexpr (SoaLayout<TDecayed>::c_enabled) {
+        const TDecayed component(std::forward<TArgs>(args)...);
+        AddSoaComponent(e, m_componentRegistry.GetTypeId<TDecayed>(), reinterpret_cast<const uint8_t*>(&component));
+        return;
+    }
+    else {
+        // Verify this entity exists
+        const uint32_t entityIndex = FindEntityIndex(e);
+        ENCOSYS_ASSERT_(entityIndex != c_invalidIndex);
+
+        // Retrieve the registered type of the component
+        const ComponentTypeId typeId = m_componentRegistry.GetTypeId<TComponent>();
+        EntityStorage& entity = m_entities[entityIndex];
+        ENCOSYS_ASSERT_(!entity.HasComponent(typeId));
+        const bool active = IndexIsActive(entityIndex);
+        const ComponentBitset oldBitset = entity.GetBitset();
+        m_dirtyEntities.Mark(entityIndex);
+
+        // Tags are only a bit, and every one of them shares the same empty object
+        if (m_componentRegistry.GetType(typeId).Storage() == ComponentStorage::Tag) {
+            entity.SetComponentBit(typeId, true);
+            UpdateQueries(e, oldBitset, active, entity.GetBitset(), active);
+            m_observerRegistry.Record(typeId, ComponentEvent::OnAdd, e);
+            return *reinterpret_cast<TDecayed*>(s_tagData);
+        }
+
+        // Move the entity into the archetype that includes this component and construct it in the new row
+        if (m_componentRegistry.GetType(typeId).Storage() == ComponentStorage::Archetype) {
+            ComponentBitset archetypeBitset = entity.GetBitset() & m_componentRegistry.GetArchetypeBitset();
+            ArchetypeMove(entity, archetypeBitset.set(typeId), active);
+            entity.SetComponentBit(typeId, true);
+            UpdateQueries(e, oldBitset, active, entity.GetBitset(), active);
+            MarkAdded(entity, typeId);
+            m_observerRegistry.Record(typeId, ComponentEvent::OnAdd, e);
+            return *new (GetComponentData(entity, typeId)) TDecayed(std::forward<TArgs>(args)...);
+        }
+
+        // Sparse sets record the owner of each component next to it
+        if (m_componentRegistry.GetType(typeId).Storage() == ComponentStorage::SparseSet) {
+            auto& storage = m_componentRegistry.GetSparseSet<TComponent>();
+            const uint32_t componentIndex = storage.Create(e, std::forward<TArgs>(args)...);
+            SetComponentIndex(entity, typeId, componentIndex);
+            UpdateQueries(e, oldBitset, active, entity.GetBitset(), active);
+            storage.MarkAdded(componentIndex, m_changeTick);
+            m_observerRegistry.Record(typeId, ComponentEvent::OnAdd, e);
+            return storage.GetObject(componentIndex);
+        }
+
+        // Retrieve the storage for this component type
+        auto& storage = m_componentRegistry.GetStorage<TComponent>();
+
+        // Create the component and set the component index for this entity
+        uint32_t componentIndex = storage.Create(e, std::forward<TArgs>(args)...);
+        SetComponentIndex(entity, typeId, componentIndex);
+        UpdateQueries(e, oldBitset, active, entity.GetBitset(), active);
+        storage.MarkAdded(componentIndex, m_changeTick);
+        m_observerRegistry.Record(typeId, ComponentEvent::OnAdd, e);
+        return storage.GetObject(componentIndex);
+    }
 }
 
 template <typename TComponent>
 void Encosys::RemoveComponent (EntityId e) {
     // Verify this entity exists
-    auto entityIter = m_idToEntity.find(e);
-    ENCOSYS_ASSERT_(entityIter != m_idToEntity.end());
+    const uint32_t entityIndex = FindEntityIndex(e);
+    ENCOSYS_ASSERT_(entityIndex != c_invalidIndex);
 
     // Retrieve the registered type of the component
     const ComponentTypeId typeId = m_componentRegistry.GetTypeId<TComponent>();
 
-    // Retrieve the storage for this component type
-    auto& storage = m_componentRegistry.GetStorage<TComponent>();
+    EntityStorage& entity = m_entities[entityIndex];
+    if (!entity.HasComponent(typeId)) {
+        return;
+    }
+    const bool active = IndexIsActive(entityIndex);
+    const ComponentBitset oldBitset = entity.GetBitset();
+    m_dirtyEntities.Mark(entityIndex);
+    m_observerRegistry.Record(typeId, ComponentEvent::OnRemove, e);
 
-    // Find the component index for this entity and destroy the component
-    EntityStorage& entity = m_entities[entityIter->second];
-    if (entity.HasComponent(typeId)) {
-        storage.Destroy(entity.GetComponentIndex(typeId));
-        entity.RemoveComponentIndex(typeId);
+    if (m_componentRegistry.GetType(typeId).Storage() == ComponentStorage::Tag) {
+        entity.SetComponentBit(typeId, false);
+        UpdateQueries(e, oldBitset, active, entity.GetBitset(), active);
+        return;
     }
+
+    // Move the entity into the archetype without this component, which destroys it
+    if (m_componentRegistry.GetType(typeId).Storage() == ComponentStorage::Archetype) {
+        ComponentBitset archetypeBitset = entity.GetBitset() & m_componentRegistry.GetArchetypeBitset();
+        ArchetypeMove(entity, archetypeBitset.reset(typeId), active);
+        entity.SetComponentBit(typeId, false);
+        UpdateQueries(e, oldBitset, active, entity.GetBitset(), active);
+        return;
+    }
+
+    // Find the component index for this entity and destroy the component
+    const uint32_t componentIndex = GetComponentIndex(entity, typeId);
+    RemoveComponentIndex(entity, typeId);
+    UpdateQueries(e, oldBitset, active, entity.GetBitset(), active);
+    DestroyPoolComponent(typeId, componentIndex);
 }
 
 template <typename TComponent>
 TComponent* Encosys::GetComponent (EntityId e) {
-    return const_cast<TComponent*>(static_cast<const Encosys*>(this)->GetComponent<TComponent>(e));
+    TComponent* component = const_cast<TComponent*>(static_cast<const Encosys*>(this)->GetComponent<TComponent>(e));
+    if (component != nullptr) {
+        MarkChanged(m_entities[FindEntityIndex(e)], m_componentRegistry.GetTypeId<TComponent>(), m_changeTick);
+    }
+    return component;
 }
 
 template <typename TComponent>
 const TComponent* Encosys::GetComponent (EntityId e) const {
-    auto entityIter = m_idToEntity.find(e);
-    ENCOSYS_ASSERT_(entityIter != m_idToEntity.end());
-    return m_entities[entityIter->second].GetComponent<TComponent>(*this);
+    static_assert(!SoaLayout<std::decay_t<TComponent>>::c_enabled, "SoA components are accessed through LoadComponent, StoreComponent and ForEachChunk.");
+    const uint32_t entityIndex = FindEntityIndex(e);
+    ENCOSYS_ASSERT_(entityIndex != c_invalidIndex);
+
+    const EntityStorage& entity = m_entities[entityIndex];
+    const ComponentTypeId typeId = m_componentRegistry.GetTypeId<TComponent>();
+    if (!entity.HasComponent(typeId)) {
+        return nullptr;
+    }
+    return reinterpret_cast<const TComponent*>(GetComponentData(entity, typeId));
+}
+
+template <typename TComponent>
+TComponent Encosys::LoadComponent (EntityId e) const {
+    static_assert(SoaLayout<TComponent>::c_enabled, "Components stored whole are accessed through GetComponent.");
+    TComponent component{};
+    LoadSoaComponent(e, m_componentRegistry.GetTypeId<TComponent>(), reinterpret_cast<uint8_t*>(&component));
+    return component;
+}
+
+template <typename TComponent>
+void Encosys::StoreComponent (EntityId e, const TComponent& component) {
+    static_assert(SoaLayout<TComponent>::c_enabled, "Components stored whole are accessed through GetComponent.");
+    StoreSoaComponent(e, m_componentRegistry.GetTypeId<TComponent>(), reinterpret_cast<const uint8_t*>(&component));
+}
+
+template <typename TComponent, typename TKeyFunction>
+void Encosys::SortEntities (TKeyFunction&& key, bool incremental, bool sortStorage) {
+    using TDecayed = std::decay_t<TComponent>;
+    using TKey = std::decay_t<decltype(key(std::declval<const TDecayed&>()))>;
+    const ComponentTypeId typeId = m_componentRegistry.GetTypeId<TDecayed>();
+
+    const auto keyOf = [this, &key, typeId] (uint32_t entityIndex) -> TKey {
+        const EntityStorage& entity = m_entities[entityIndex];
+        if constexpr (SoaLayout<TDecayed>::c_enabled) {
+            return key(LoadComponent<TDecayed>(entity.GetId()));
+        }
+        else {
+            return key(*reinterpret_cast<const TDecayed*>(GetComponentData(entity, typeId)));
+        }
+    };
+    const auto less = [] (const std::pair<TKey, uint32_t>& lhs, const std::pair<TKey, uint32_t>& rhs) { return lhs.first < rhs.first; };
+
+    std::vector<uint32_t> order;
+    std::vector<uint32_t> unkeyed;
+    order.reserve(m_entityActiveCount);
+    std::vector<uint32_t> kept;
+    std::vector<uint32_t> moved;
+    if (incremental && m_sortTypeId == typeId) {
+        SplitSortedEntities(typeId, kept, moved, unkeyed);
+    }
+
+    // Only the keys written since the last sort are computed, and each of those entities is merged into the
+    // unchanged ones with a binary search. When a system wrote most of them, ranking all of them is cheaper.
+    if (!kept.empty() && moved.size() <= kept.size() / 8) {
+        std::vector<std::pair<TKey, uint32_t>> keyed;
+        keyed.reserve(moved.size());
+        for (const uint32_t entityIndex : moved) {
+            keyed.emplace_back(keyOf(entityIndex), entityIndex);
+        }
+        std::stable_sort(keyed.begin(), keyed.end(), less);
+
+        auto from = kept.begin();
+        for (const auto& entry : keyed) {
+            const auto to = std::upper_bound(from, kept.end(), entry.first, [&keyOf] (const TKey& value, uint32_t entityIndex) {
+                return value < keyOf(entityIndex);
+            });
+            order.insert(order.end(), from, to);
+            order.push_back(entry.second);
+            from = to;
+        }
+        order.insert(order.end(), from, kept.end());
+    }
+    else {
+        std::vector<std::pair<TKey, uint32_t>> keyed;
+        keyed.reserve(m_entityActiveCount);
+        unkeyed.clear();
+        for (uint32_t i = 0; i < m_entityActiveCount; ++i) {
+            if (m_entities[i].HasComponent(typeId)) {
+                keyed.emplace_back(keyOf(i), i);
+            }
+            else {
+                unkeyed.push_back(i);
+            }
+        }
+        if (incremental) {
+            SortNearlySorted(keyed, less);
+        }
+        else {
+            std::stable_sort(keyed.begin(), keyed.end(), less);
+        }
+        for (const auto& entry : keyed) {
+            order.push_back(entry.second);
+        }
+    }
+
+    order.insert(order.end(), unkeyed.begin(), unkeyed.end());
+    ApplyEntityOrder(order, incremental, sortStorage);
+    RecordSortOrder(typeId);
 }
 
 template <typename TComponent>
@@ -193,6 +751,47 @@ ComponentTypeId Encosys::GetComponentTypeId () const {
     return m_componentRegistry.GetTypeId<TComponent>();
 }
 
+template <typename TComponent>
+const ComponentType& Encosys::GetComponentType () const {
+    return m_componentRegistry.GetType<TComponent>();
+}
+
+inline const ComponentType& Encosys::GetComponentType (ComponentTypeId typeId) const {
+    return m_componentRegistry.GetType(typeId);
+}
+
+template <typename TComponent>
+const ComponentTicks* Encosys::GetComponentTicks (EntityId e) const {
+    const uint32_t entityIndex = FindEntityIndex(e);
+    ENCOSYS_ASSERT_(entityIndex != c_invalidIndex);
+    const ComponentTypeId typeId = m_componentRegistry.GetTypeId<TComponent>();
+    if (!m_entities[entityIndex].HasComponent(typeId) || m_componentRegistry.GetTagBitset().test(typeId)) {
+        return nullptr;
+    }
+    return &GetComponentTicks(m_entities[entityIndex], typeId);
+}
+
+template <typename TComponent>
+void Encosys::MarkChanged (EntityId e) {
+    const uint32_t entityIndex = FindEntityIndex(e);
+    ENCOSYS_ASSERT_(entityIndex != c_invalidIndex);
+    const ComponentTypeId typeId = m_componentRegistry.GetTypeId<TComponent>();
+    ENCOSYS_ASSERT_(m_entities[entityIndex].HasComponent(typeId));
+    MarkChanged(m_entities[entityIndex], typeId, m_changeTick);
+}
+
+template <typename... TFilters>
+QueryFilter Encosys::MakeQueryFilter () const {
+    QueryFilter filter;
+    (TFilters::Apply(filter, m_componentRegistry), ...);
+    return filter;
+}
+
+template <typename TComponent>
+void Encosys::Observe (ComponentEvent event, ObserverCallback observer) {
+    m_observerRegistry.Register(m_componentRegistry.GetTypeId<TComponent>(), event, std::move(observer));
+}
+
 template <typename TSingleton>
 SingletonTypeId Encosys::RegisterSingleton () {
     return m_singletonRegistry.Register<TSingleton>();
@@ -218,40 +817,247 @@ void Encosys::RegisterSystem () {
     m_systemRegistry.Register<TSystem>(*this);
 }
 
-template <typename TCallback>
+template <typename... TFilters, typename TCallback>
 void Encosys::ForEach (TCallback&& callback) {
+    ForEachBatched<TFilters...>(callback, 0);
+}
+
+template <typename... TFilters, typename TCallback>
+void Encosys::ParallelForEach (TCallback&& callback, uint32_t grainSize) {
+    ForEachBatched<TFilters...>(callback, std::max(grainSize, 1u));
+}
+
+template <typename... TFilters, typename TCallback>
+void Encosys::ForEachBatched (TCallback&& callback, uint32_t grainSize) {
     using FTraits = FunctionTraits<decltype(callback)>;
-    static_ENCOSYS_ASSERT_(FTraits::ArgCount > 0, "First callback param must be ecs::Entity.");
-    static_ENCOSYS_ASSERT_(std::is_same<std::decay_t<typename FTraits::Arg<0>>, EntityStorage>::value, "First callback param must be ecs::EntityStorage.");
+    static_assert(FTraits::ArgCount > 0, "First callback param must be ecs::Entity.");
+    static_assert(std::is_same<std::decay_t<typename FTraits::template Arg<0>>, Entity>::value, "First callback param must be ecs::Entity.");
     using FComponentArgs = typename FTraits::Args::RemoveFirst;
+    using FSequence = typename GenerateSequence<FComponentArgs::Size>::Type;
 
+    // Resolve the component type ids once instead of once per entity
     ComponentBitset targetMask{};
-    FComponentArgs::ForTypes([this, &targetMask] (auto t) {
+    std::array<ComponentTypeId, FComponentArgs::Size> typeIds{};
+    uint32_t typeCount = 0;
+    FComponentArgs::ForTypes([this, &targetMask, &typeIds, &typeCount] (auto t) {
         (void)t;
+        static_assert(!SoaLayout<std::decay_t<TYPE_OF(t)>>::c_enabled, "SoA components are iterated with ForEachChunk.");
         ENCOSYS_ASSERT_(m_componentRegistry.HasType<TYPE_OF(t)>());
-        targetMask.set(m_componentRegistry.GetTypeId<TYPE_OF(t)>());
+        typeIds[typeCount] = m_componentRegistry.GetTypeId<TYPE_OF(t)>();
+        targetMask.set(typeIds[typeCount++]);
     });
+    const QueryFilter filter = MakeQueryFilter<TFilters...>();
+    targetMask |= filter.m_required;
+    const ChangeTick since = m_filterTick;
+    const ChangeTick tick = m_changeTick;
 
-    for (uint32_t i = 0; i < m_entityActiveCount; ++i) {
-        EntityStorage& entity = m_entities[i];
-        if (entity.HasComponentBitset(targetMask)) {
-            UnpackAndCallback(
-                entity,
-                callback,
-                FComponentArgs{},
-                typename GenerateSequence<FTraits::ArgCount>::Type{}
-            );
+    // Walk the matching archetype chunks linearly when every requested component is stored in archetypes and the
+    // masks can be decided per archetype. Chunks are already cache aligned and sized, so each one is its own batch.
+    const ComponentBitset& archetypeBitset = m_componentRegistry.GetArchetypeBitset();
+    if (targetMask.any() && (targetMask & archetypeBitset) == targetMask && filter.MasksWithin(archetypeBitset)) {
+        std::vector<std::pair<uint32_t, uint32_t>> chunks;
+        FindArchetypeChunks(targetMask, filter, chunks);
+        const uint32_t chunkCount = static_cast<uint32_t>(chunks.size());
+        ParallelFor(chunkCount, grainSize == 0 ? 0 : 1, [&] (uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; ++i) {
+                ArchetypeChunkForEach(m_archetypeRegistry[chunks[i].first], chunks[i].second, typeIds, filter, since, tick, callback, FComponentArgs{}, FSequence{});
+            }
+        });
+        return;
+    }
+
+    if (grainSize != 0) {
+        grainSize = AlignGrainSize(grainSize);
+    }
+
+    // Tick filters only visit the storage that changed since
+    if (filter.HasTickFilters()) {
+        std::vector<uint32_t> entityIndices;
+        ForEachFiltered(targetMask, filter, since, [&entityIndices] (uint32_t entityIndex) { entityIndices.push_back(entityIndex); });
+        ParallelFor(static_cast<uint32_t>(entityIndices.size()), grainSize, [&] (uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; ++i) {
+                UnpackAndCallback(m_entities[entityIndices[i]], typeIds, tick, callback, FComponentArgs{}, FSequence{});
+            }
+        });
+        return;
+    }
+
+    // A sparse set keeps its components next to the ids of their owners, so walking it directly reads each component
+    // of the set in order instead of going through the entity and its component indices
+    const ComponentTypeId setTypeId = FindSparseSetDriver(targetMask);
+    if (setTypeId != c_invalidIndex) {
+        // Every owner has the component of the set, so only the other components need the entity to be read
+        const SparseSetStorage& set = m_componentRegistry.GetSparseSet(setTypeId);
+        const bool setOnly = targetMask.count() == 1;
+        ParallelFor(set.GetSize(), grainSize, [&] (uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; ++i) {
+                const uint32_t entityIndex = FindEntityIndex(set.GetEntityId(i));
+                if (!IndexIsActive(entityIndex)) {
+                    continue;
+                }
+                EntityStorage& entity = m_entities[entityIndex];
+                if ((setOnly || entity.HasComponentBitset(targetMask)) && (!filter.HasConditions() || PassesFilter(entity, filter, since))) {
+                    SparseSetUnpackAndCallback(entity, setTypeId, i, typeIds, tick, callback, FComponentArgs{}, FSequence{});
+                }
+            }
+        });
+        return;
+    }
+
+    // Otherwise visit the cached matches, which are kept up to date as entities change
+    const Query& query = FindOrCreateQuery(targetMask);
+    ParallelFor(query.GetSize(), grainSize, [&] (uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; ++i) {
+            const EntityId id = query.GetEntityId(i);
+            if (id == c_invalidEntityId) {
+                continue;
+            }
+            EntityStorage& entity = m_entities[FindEntityIndex(id)];
+            if (!filter.HasConditions() || PassesFilter(entity, filter, since)) {
+                UnpackAndCallback(entity, typeIds, tick, callback, FComponentArgs{}, FSequence{});
+            }
         }
+    });
+}
+
+template <typename... TFilters, typename TCallback>
+void Encosys::ForEachChunk (TCallback&& callback) {
+    const QueryFilter filter = MakeQueryFilter<TFilters...>();
+    ForEachChunkBatched(callback, filter.m_required, filter, m_filterTick, m_changeTick, false, nullptr);
+}
+
+template <typename... TFilters, typename TCallback>
+void Encosys::ParallelForEachChunk (TCallback&& callback) {
+    const QueryFilter filter = MakeQueryFilter<TFilters...>();
+    ForEachChunkBatched(callback, filter.m_required, filter, m_filterTick, m_changeTick, true, nullptr);
+}
+
+template <typename TCallback>
+void Encosys::ForEachChunkBatched (TCallback&& callback, const ComponentBitset& requiredBitset, const QueryFilter& filter, ChangeTick since, ChangeTick tick, bool parallel, const SystemType* systemType) {
+    using FTraits = FunctionTraits<decltype(callback)>;
+    static_assert(FTraits::ArgCount > 0, "First callback param must be the uint32_t row count.");
+    static_assert(std::is_same<std::decay_t<typename FTraits::template Arg<0>>, uint32_t>::value, "First callback param must be the uint32_t row count.");
+    using FSpanArgs = typename FTraits::Args::RemoveFirst;
+    using FSequence = typename GenerateSequence<FSpanArgs::Size>::Type;
+
+    ComponentBitset targetMask = requiredBitset;
+    std::array<ComponentTypeId, FSpanArgs::Size> typeIds{};
+    uint32_t typeCount = 0;
+    FSpanArgs::ForTypes([this, systemType, &targetMask, &typeIds, &typeCount] (auto t) {
+        (void)t;
+        (void)systemType;
+        using TSpanComponent = typename std::decay_t<TYPE_OF(t)>::Component;
+        ENCOSYS_ASSERT_(m_componentRegistry.HasType<TSpanComponent>());
+        typeIds[typeCount] = m_componentRegistry.GetTypeId<TSpanComponent>();
+        if (systemType != nullptr) {
+            const bool readOnly = std::decay_t<TYPE_OF(t)>::c_readOnly;
+            (void)readOnly;
+            ENCOSYS_ASSERT_(readOnly ? systemType->IsComponentReadAllowed(typeIds[typeCount]) : systemType->IsComponentWriteAllowed(typeIds[typeCount]));
+        }
+        targetMask.set(typeIds[typeCount++]);
+    });
+    ENCOSYS_ASSERT_(targetMask.any() && (targetMask & m_componentRegistry.GetArchetypeBitset()) == targetMask);
+    ENCOSYS_ASSERT_(filter.MasksWithin(m_componentRegistry.GetArchetypeBitset()));
+
+    std::vector<std::pair<uint32_t, uint32_t>> chunks;
+    FindArchetypeChunks(targetMask, filter, chunks);
+    ParallelFor(static_cast<uint32_t>(chunks.size()), parallel ? 1 : 0, [&] (uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; ++i) {
+            Archetype& archetype = m_archetypeRegistry[chunks[i].first];
+            if (!filter.HasTickFilters() || ChunkPassesFilter(archetype, chunks[i].second, filter, since)) {
+                ChunkSpanCallback(archetype, chunks[i].second, typeIds, tick, callback, FSpanArgs{}, FSequence{});
+            }
+        }
+    });
+}
+
+template <typename TCallback, typename... Args, std::size_t... Seq>
+void Encosys::ChunkSpanCallback (Archetype& archetype, uint32_t chunk, const std::array<ComponentTypeId, sizeof...(Args)>& typeIds, ChangeTick tick, TCallback&& callback, TypeList<Args...>, Sequence<Seq...>) {
+    const uint32_t size = archetype.GetChunkSize(chunk);
+    if (size > 0) {
+        // The callback may write any row of a writable span
+        ((std::decay_t<Args>::c_readOnly ? void() : archetype.MarkChunkChanged(typeIds[Seq], chunk, tick)), ...);
+        callback(size, std::decay_t<Args>(archetype, typeIds[Seq], chunk)...);
     }
 }
 
 template <typename TCallback, typename... Args, std::size_t... Seq>
-void Encosys::UnpackAndCallback (EntityStorage& entity, TCallback&& callback, TypeList<Args...>, Sequence<Seq...>) {
-    auto params = std::make_tuple(
-        Entity(*this, entity),
-        std::ref(m_componentRegistry.GetStorage<std::decay_t<Args>>().GetObject(entity.GetComponentIndex(m_componentRegistry.GetTypeId<std::decay_t<Args>>())))...
-    );
-    callback(std::get<Seq>(params)...);
+void Encosys::UnpackAndCallback (EntityStorage& entity, const std::array<ComponentTypeId, sizeof...(Args)>& typeIds, ChangeTick tick, TCallback&& callback, TypeList<Args...>, Sequence<Seq...>) {
+    Entity handle(this, &entity);
+    callback(handle, *reinterpret_cast<std::decay_t<Args>*>(GetComponentData(entity, typeIds[Seq]))...);
+    ((std::is_const<std::remove_reference_t<Args>>::value ? void() : MarkChanged(entity, typeIds[Seq], tick)), ...);
+}
+
+template <typename TCallback, typename... Args, std::size_t... Seq>
+void Encosys::SparseSetUnpackAndCallback (EntityStorage& entity, ComponentTypeId setTypeId, uint32_t index, const std::array<ComponentTypeId, sizeof...(Args)>& typeIds, ChangeTick tick, TCallback&& callback, TypeList<Args...>, Sequence<Seq...>) {
+    BlockMemoryPool& set = m_componentRegistry.GetStorage(setTypeId);
+    Entity handle(this, &entity);
+    callback(handle, *reinterpret_cast<std::decay_t<Args>*>(typeIds[Seq] == setTypeId ? set.GetData(index) : GetComponentData(entity, typeIds[Seq]))...);
+    ((std::is_const<std::remove_reference_t<Args>>::value ? void() : typeIds[Seq] == setTypeId ? set.MarkChanged(index, tick) : MarkChanged(entity, typeIds[Seq], tick)), ...);
+}
+
+template <typename TCallback, typename... Args, std::size_t... Seq>
+void Encosys::ArchetypeChunkForEach (Archetype& archetype, uint32_t chunk, const std::array<ComponentTypeId, sizeof...(Args)>& typeIds, const QueryFilter& filter, ChangeTick since, ChangeTick tick, TCallback&& callback, TypeList<Args...>, Sequence<Seq...>) {
+    const bool filtered = filter.HasTickFilters();
+    if (filtered && !ChunkPassesFilter(archetype, chunk, filter, since)) {
+        return;
+    }
+    const EntityId* ids = archetype.GetEntityIds(chunk);
+    auto columns = std::make_tuple(reinterpret_cast<std::decay_t<Args>*>(archetype.GetColumn(typeIds[Seq], chunk))...);
+    auto ticks = std::make_tuple((std::is_const<std::remove_reference_t<Args>>::value ? nullptr : archetype.GetTicksColumn(typeIds[Seq], chunk))...);
+    (void)columns;
+    (void)ticks;
+    const uint32_t size = archetype.GetChunkSize(chunk);
+    const uint32_t firstRow = chunk * archetype.GetChunkCapacity();
+    // The tick column of the first filtered component rejects most rows, the other conditions are checked after it
+    const bool added = filtered && filter.m_changed.empty();
+    const ComponentTicks* filterTicks = filtered ? archetype.GetTicksColumn(added ? filter.m_added.front() : filter.m_changed.front(), chunk) : nullptr;
+    const bool moreFilters = filter.m_changed.size() + filter.m_added.size() > 1;
+    bool wrote = false;
+    for (uint32_t row = 0; row < size; ++row) {
+        if (filtered && (!IsNewerTick(added ? filterTicks[row].m_added : filterTicks[row].m_changed, since) || (moreFilters && !PassesFilter(archetype, firstRow + row, filter, since)))) {
+            continue;
+        }
+        Entity entity = Get(ids[row]);
+        callback(entity, std::get<Seq>(columns)[row]...);
+        ((std::get<Seq>(ticks) != nullptr ? void(std::get<Seq>(ticks)[row].m_changed = tick) : void()), ...);
+        wrote = true;
+    }
+    if (wrote) {
+        ((std::get<Seq>(ticks) != nullptr ? archetype.IncludeChunkTicks(typeIds[Seq], chunk, ComponentTicks{0, tick}) : void()), ...);
+        ((std::get<Seq>(ticks) != nullptr ? archetype.GetDirtyBlocks().Mark(chunk) : void()), ...);
+    }
+}
+
+inline uint32_t Encosys::FindEntityIndex (EntityId e) const {
+    if (e.Index() < m_slots.size() && m_slots[e.Index()].m_generation == e.Generation()) {
+        return m_slots[e.Index()].m_entityIndex;
+    }
+    return c_invalidIndex;
+}
+
+inline uint8_t* Encosys::GetComponentData (const EntityStorage& entity, ComponentTypeId typeId) {
+    return const_cast<uint8_t*>(static_cast<const Encosys*>(this)->GetComponentData(entity, typeId));
+}
+
+inline const uint8_t* Encosys::GetComponentData (const EntityStorage& entity, ComponentTypeId typeId) const {
+    if (m_componentRegistry.GetArchetypeBitset().test(typeId)) {
+        return m_archetypeRegistry[entity.GetArchetype()].GetComponentData(typeId, entity.GetArchetypeRow());
+    }
+    if (m_componentRegistry.GetTagBitset().test(typeId)) {
+        return s_tagData;
+    }
+    return m_componentRegistry.GetStorage(typeId).GetData(GetComponentIndex(entity, typeId));
+}
+
+inline uint32_t Encosys::ComponentIndexRank (const EntityStorage& entity, ComponentTypeId typeId) const {
+    // Shifting the lower type ids to the top drops every bit from typeId up
+    return static_cast<uint32_t>(((entity.GetBitset() & m_componentRegistry.GetPoolBitset()) << (ENCOSYS_MAX_COMPONENTS_ - typeId)).count());
+}
+
+inline uint32_t Encosys::GetComponentIndex (const EntityStorage& entity, ComponentTypeId typeId) const {
+    ENCOSYS_ASSERT_(entity.HasComponent(typeId) && m_componentRegistry.GetPoolBitset().test(typeId));
+    return m_componentIndices.GetRun(entity.GetIndexRun(), entity.GetIndexClass())[ComponentIndexRank(entity, typeId)];
 }
 
 } // namespace ecs
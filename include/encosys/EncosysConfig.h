@@ -8,6 +8,7 @@
 #include "ecsconfig.h"
 #endif
 
+// Component types a world can register. Each entity pays one bit per type, plus one index per pool component it has.
 #ifndef ENCOSYS_MAX_COMPONENTS_
 #define ENCOSYS_MAX_COMPONENTS_ 64
 #endif
@@ -16,6 +17,49 @@
 #define ENCOSYS_MAX_SINGLETONS_ 32
 #endif
 
+// Number of elements per pool block, must be a power of two
+#ifndef ENCOSYS_POOL_BLOCK_SIZE_
+#define ENCOSYS_POOL_BLOCK_SIZE_ 4096
+#endif
+
+// Minimum alignment of pool blocks and archetype chunks, e.g. 64 for cache lines or 4096 for pages
+#ifndef ENCOSYS_POOL_BLOCK_ALIGNMENT_
+#define ENCOSYS_POOL_BLOCK_ALIGNMENT_ 64
+#endif
+
+#ifndef ENCOSYS_ARCHETYPE_CHUNK_BYTES_
+#define ENCOSYS_ARCHETYPE_CHUNK_BYTES_ 16384
+#endif
+
+// Chunk size of archetypes with SoA components, larger since every field column is a separate stream to prefetch
+#ifndef ENCOSYS_SOA_CHUNK_BYTES_
+#define ENCOSYS_SOA_CHUNK_BYTES_ 65536
+#endif
+
+// Alignment of every field column of an SoA component, 64 lets kernels use aligned loads up to AVX-512
+#ifndef ENCOSYS_SOA_COLUMN_ALIGNMENT_
+#define ENCOSYS_SOA_COLUMN_ALIGNMENT_ 64
+#endif
+
+// Queries built for ForEach calls that Encosys::Update keeps cached, the least recently used beyond it are released
+#ifndef ENCOSYS_MAX_CACHED_QUERIES_
+#define ENCOSYS_MAX_CACHED_QUERIES_ 64
+#endif
+
+#ifndef ENCOSYS_PARALLEL_GRAIN_SIZE_
+#define ENCOSYS_PARALLEL_GRAIN_SIZE_ 1024
+#endif
+
+// Block size of the per-thread frame allocators, larger requests get an allocation of their own
+#ifndef ENCOSYS_FRAME_BLOCK_BYTES_
+#define ENCOSYS_FRAME_BLOCK_BYTES_ 65536
+#endif
+
+// Delta snapshots a world keeps for rollback before folding the oldest together
+#ifndef ENCOSYS_SNAPSHOT_HISTORY_
+#define ENCOSYS_SNAPSHOT_HISTORY_ 8
+#endif
+
 #ifndef ENCOSYS_TIME_TYPE_
 #define ENCOSYS_TIME_TYPE_ float
 #endif
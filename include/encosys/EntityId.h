@@ -5,36 +5,44 @@
 
 namespace ecs {
 
+class CommandBuffer;
 class Encosys;
 
+// Handle to an entity made of a slot index and the generation of that slot. Slots are
+// reused once an entity is destroyed, and bumping the generation invalidates stale handles.
 class EntityId {
 public:
     EntityId () = default;
-    explicit operator uint32_t () const { return m_id; }
-    uint32_t Id () const { return m_id; }
+    uint32_t Index () const { return m_index; }
+    uint32_t Generation () const { return m_generation; }
 
-    friend bool operator== (const EntityId& lhs, const EntityId& rhs) { return lhs.m_id == rhs.m_id; }
-    friend bool operator!= (const EntityId& lhs, const EntityId& rhs) { return lhs.m_id != rhs.m_id; }
-    friend bool operator<  (const EntityId& lhs, const EntityId& rhs) { return lhs.m_id < rhs.m_id; }
-    friend bool operator>  (const EntityId& lhs, const EntityId& rhs) { return lhs.m_id > rhs.m_id; }
-    friend bool operator<= (const EntityId& lhs, const EntityId& rhs) { return lhs.m_id <= rhs.m_id; }
-    friend bool operator>= (const EntityId& lhs, const EntityId& rhs) { return lhs.m_id >= rhs.m_id; }
+    friend bool operator== (const EntityId& lhs, const EntityId& rhs) { return lhs.m_index == rhs.m_index && lhs.m_generation == rhs.m_generation; }
+    friend bool operator!= (const EntityId& lhs, const EntityId& rhs) { return !(lhs == rhs); }
+    friend bool operator<  (const EntityId& lhs, const EntityId& rhs) { return lhs.m_index != rhs.m_index ? lhs.m_index < rhs.m_index : lhs.m_generation < rhs.m_generation; }
+    friend bool operator>  (const EntityId& lhs, const EntityId& rhs) { return rhs < lhs; }
+    friend bool operator<= (const EntityId& lhs, const EntityId& rhs) { return !(rhs < lhs); }
+    friend bool operator>= (const EntityId& lhs, const EntityId& rhs) { return !(lhs < rhs); }
 
 private:
+    friend class CommandBuffer;
     friend class Encosys;
-    explicit EntityId (uint32_t id) : m_id{id} {}
-    uint32_t m_id{static_cast<uint32_t>(-1)};
+    EntityId (uint32_t index, uint32_t generation) : m_index{index}, m_generation{generation} {}
+    uint32_t m_index{static_cast<uint32_t>(-1)};
+    uint32_t m_generation{0};
 };
 
 const EntityId c_invalidEntityId = {};
 
+// Marks the ids a CommandBuffer hands out before their entities exist. Slots retire before reaching it.
+const uint32_t c_pendingGeneration = static_cast<uint32_t>(-1);
+
 }
 
 namespace std {
     template <>
     struct hash<ecs::EntityId> {
         std::size_t operator() (const ecs::EntityId& k) const {
-            return std::hash<uint32_t>()(k.Id());
+            return std::hash<uint64_t>()((static_cast<uint64_t>(k.Generation()) << 32) | k.Index());
         }
     };
-}
+}
\ No newline at end of file
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "Allocator.h"
+#include "EncosysConfig.h"
+#include <vector>
+
+namespace ecs {
+
+// Bump allocator for data that only lives until the end of the frame. Deallocate does nothing and
+// Reset invalidates everything at once while keeping the blocks for the next frame, so a steady
+// frame stops allocating after its first few runs. Blocks come from the heap since every thread
+// owns a frame allocator of its own. Destructors are never run, so only store trivially
+// destructible objects or containers that are destroyed before the reset.
+class FrameAllocator : public Allocator {
+public:
+    explicit FrameAllocator (std::size_t blockBytes = ENCOSYS_FRAME_BLOCK_BYTES_);
+    ~FrameAllocator () override;
+
+    FrameAllocator (const FrameAllocator&) = delete;
+    FrameAllocator& operator= (const FrameAllocator&) = delete;
+
+    void Reset ();
+
+protected:
+    void* DoAllocate (std::size_t bytes, std::size_t alignment) override;
+    void DoDeallocate (void* data, std::size_t bytes, std::size_t alignment) override;
+
+private:
+    struct LargeAllocation {
+        void* m_data;
+        std::size_t m_bytes;
+        std::size_t m_alignment;
+    };
+
+    std::size_t m_blockBytes;
+    std::vector<uint8_t*> m_blocks{};
+    std::size_t m_block{0};
+    std::size_t m_offset{0};
+    // Requests that do not fit in a block get their own allocation, released by Reset
+    std::vector<LargeAllocation> m_largeAllocations{};
+};
+
+// A vector whose storage lives until the end of the frame, see System::FrameStlAllocator
+template <typename T>
+using FrameVector = std::vector<T, StlAllocator<T>>;
+
+}
\ No newline at end of file
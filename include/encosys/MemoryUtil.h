@@ -0,0 +1,24 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace ecs {
+
+// Fills count consecutive elements stride bytes apart at dst with the bytes of the element at src.
+// Each memcpy doubles the filled range, so large fills cost about as much as one copy of the range.
+inline void FillCopies (uint8_t* dst, const uint8_t* src, uint32_t bytes, uint32_t stride, uint32_t count) {
+    if (count == 0) {
+        return;
+    }
+    memcpy(dst, src, bytes);
+    uint32_t filled = 1;
+    while (filled < count) {
+        const uint32_t copies = std::min(filled, count - filled);
+        memcpy(dst + static_cast<std::size_t>(filled) * stride, dst, static_cast<std::size_t>(copies - 1) * stride + bytes);
+        filled += copies;
+    }
+}
+
+}
\ No newline at end of file
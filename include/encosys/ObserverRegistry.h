@@ -0,0 +1,67 @@
+#pragma once
+
+#include "EncosysConfig.h"
+#include "EntityId.h"
+#include <functional>
+#include <vector>
+
+namespace ecs {
+
+class Encosys;
+
+// Lifecycle events of a component type. OnDestroy is raised instead of OnRemove when the component goes
+// away because its entity was destroyed.
+enum class ComponentEvent : uint8_t {
+    OnAdd,
+    OnRemove,
+    OnDestroy,
+    Count
+};
+
+// Receives every entity the event happened to since the previous delivery, in the order it happened
+using ObserverCallback = std::function<void(Encosys&, const std::vector<EntityId>&)>;
+
+struct ObserverBatch {
+    ComponentTypeId m_typeId;
+    ComponentEvent m_event;
+    std::vector<EntityId> m_ids;
+};
+
+// Collects the lifecycle events of observed component types into one batch per type and event, so the
+// cost of an event is a push_back and unobserved types cost a single check
+class ObserverRegistry {
+public:
+    void Register (ComponentTypeId typeId, ComponentEvent event, ObserverCallback callback);
+
+    bool IsObserved (ComponentTypeId typeId, ComponentEvent event) const {
+        const uint32_t slot = Slot(typeId, event);
+        return slot < m_slots.size() && !m_slots[slot].m_observers.empty();
+    }
+
+    void Record (ComponentTypeId typeId, ComponentEvent event, EntityId id) {
+        if (IsObserved(typeId, event)) {
+            m_slots[Slot(typeId, event)].m_pending.push_back(id);
+        }
+    }
+    void RecordBatch (ComponentTypeId typeId, ComponentEvent event, const EntityId* ids, uint32_t count);
+
+    // Moves every pending event into one batch per type and event, ordered by type and then OnAdd, OnRemove, OnDestroy
+    void TakePending (std::vector<ObserverBatch>& batches);
+    // Calls every observer of the type and event of the batch
+    void Notify (const ObserverBatch& batch, Encosys& encosys);
+
+private:
+    struct ObserverSlot {
+        std::vector<ObserverCallback> m_observers{};
+        std::vector<EntityId> m_pending{};
+    };
+
+    static uint32_t Slot (ComponentTypeId typeId, ComponentEvent event) {
+        return typeId * static_cast<uint32_t>(ComponentEvent::Count) + static_cast<uint32_t>(event);
+    }
+
+    std::vector<ObserverSlot> m_slots{};
+    bool m_notifying{false};
+};
+
+} // namespace ecs
\ No newline at end of file
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "ComponentType.h"
+#include "EncosysConfig.h"
+#include <vector>
+
+namespace ecs {
+
+// A frozen copy of the components of an entity, created by Encosys::CreatePrefab and spawned
+// with Encosys::Instantiate. Every component is stored once so instantiating many entities can
+// copy each component type into its storage in bulk. A prefab only belongs to the Encosys that
+// created it.
+class Prefab {
+public:
+    Prefab (Prefab&& other);
+    Prefab& operator= (Prefab&& other);
+    ~Prefab ();
+
+    Prefab (const Prefab&) = delete;
+    Prefab& operator= (const Prefab&) = delete;
+
+    const ComponentBitset& GetBitset () const { return m_bitset; }
+    const std::vector<ComponentType>& GetTypes () const { return m_types; }
+    const uint8_t* GetComponentData (uint32_t index) const { return m_data + m_offsets[index]; }
+
+private:
+    friend class Encosys;
+
+    // The components are left uninitialized and must all be constructed by the caller
+    explicit Prefab (const std::vector<ComponentType>& types);
+
+    uint8_t* GetComponentData (uint32_t index) { return m_data + m_offsets[index]; }
+    void Release ();
+
+    ComponentBitset m_bitset{};
+    std::vector<ComponentType> m_types{};
+    std::vector<uint32_t> m_offsets{};
+    uint32_t m_alignment{1};
+    uint8_t* m_data{nullptr};
+};
+
+}
\ No newline at end of file
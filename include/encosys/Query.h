@@ -0,0 +1,110 @@
+#pragma once
+
+#include "EncosysConfig.h"
+#include "EntityId.h"
+#include "SortUtil.h"
+#include <utility>
+#include <vector>
+
+namespace ecs {
+
+// Cached list of the active entities whose component bitset contains the query bitset.
+// The ids are kept dense for iteration and each one's position is looked up by the index
+// of its EntityId, so entities enter and leave the query in constant time.
+class Query {
+public:
+    explicit Query (const ComponentBitset& bitset) : m_bitset{bitset} {}
+
+    const ComponentBitset& GetBitset () const { return m_bitset; }
+    bool Matches (const ComponentBitset& bitset) const { return (bitset & m_bitset) == m_bitset; }
+
+    // Removed entities leave a hole holding c_invalidEntityId until enough of them pile up, so iteration
+    // over [0, GetSize()) has to skip invalid ids
+    uint32_t GetSize () const { return static_cast<uint32_t>(m_entityIds.size()); }
+    uint32_t GetCount () const { return GetSize() - m_holeCount; }
+    EntityId GetEntityId (uint32_t index) const { ENCOSYS_ASSERT_(index < GetSize()); return m_entityIds[index]; }
+
+    void Insert (EntityId id) {
+        if (id.Index() >= m_positions.size()) {
+            m_positions.resize(id.Index() + 1, c_invalidIndex);
+        }
+        ENCOSYS_ASSERT_(m_positions[id.Index()] == c_invalidIndex);
+        m_positions[id.Index()] = GetSize();
+        m_entityIds.push_back(id);
+    }
+
+    // Keeps the order of the remaining ids, swapping the last id into the hole would let the query drift
+    // away from the order of the entities
+    void Remove (EntityId id) {
+        const uint32_t position = m_positions[id.Index()];
+        ENCOSYS_ASSERT_(position != c_invalidIndex);
+        m_positions[id.Index()] = c_invalidIndex;
+        m_entityIds[position] = c_invalidEntityId;
+        ++m_holeCount;
+        while (!m_entityIds.empty() && m_entityIds.back() == c_invalidEntityId) {
+            m_entityIds.pop_back();
+            --m_holeCount;
+        }
+        if (m_holeCount > 32 && m_holeCount * 4 > GetSize()) {
+            CloseHoles();
+        }
+    }
+
+    // Reorders the ids by a rank such as the position of each entity in Encosys. Incremental sorts
+    // assume the ranks were in order before and only a few of them changed.
+    template <typename TRank>
+    void Sort (TRank&& rank, bool incremental) {
+        CloseHoles();
+        std::vector<std::pair<uint32_t, EntityId>> ranked;
+        ranked.reserve(m_entityIds.size());
+        for (const EntityId id : m_entityIds) {
+            ranked.emplace_back(rank(id), id);
+        }
+        const auto less = [] (const std::pair<uint32_t, EntityId>& lhs, const std::pair<uint32_t, EntityId>& rhs) {
+            return lhs.first < rhs.first;
+        };
+        if (incremental) {
+            SortNearlySorted(ranked, less);
+        }
+        else {
+            std::sort(ranked.begin(), ranked.end(), less);
+        }
+        for (uint32_t i = 0; i < GetSize(); ++i) {
+            m_entityIds[i] = ranked[i].second;
+            m_positions[ranked[i].second.Index()] = i;
+        }
+    }
+
+    void Clear () {
+        m_entityIds.clear();
+        m_positions.clear();
+        m_holeCount = 0;
+    }
+
+private:
+    friend class QueryRegistry;
+
+    // Shifts the ids down over the holes, in order
+    void CloseHoles () {
+        uint32_t count = 0;
+        for (const EntityId id : m_entityIds) {
+            if (id != c_invalidEntityId) {
+                m_positions[id.Index()] = count;
+                m_entityIds[count++] = id;
+            }
+        }
+        m_entityIds.resize(count);
+        m_holeCount = 0;
+    }
+
+    ComponentBitset m_bitset;
+    std::vector<EntityId> m_entityIds{};
+    std::vector<uint32_t> m_positions{};
+    uint32_t m_holeCount{0};
+    // Bookkeeping of QueryRegistry
+    bool m_pinned{false};
+    uint32_t m_lastUse{0};
+    uint32_t m_visit{0};
+};
+
+}
\ No newline at end of file
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "ChangeTicks.h"
+#include "ComponentRegistry.h"
+#include "EncosysConfig.h"
+#include <type_traits>
+#include <vector>
+
+namespace ecs {
+
+// Conditions a query checks on top of its required components, built from filter types such as Changed<T>.
+// The tick conditions are checked against the tick a system last ran at, or against the end of the
+// previous Update outside systems.
+struct QueryFilter {
+    // Components an entity needs for the filters to apply to it
+    ComponentBitset m_required{};
+    // Components an entity must not have, and groups it must have at least one component of
+    ComponentBitset m_excluded{};
+    std::vector<ComponentBitset> m_anyOf{};
+    // Components that must have been written, or added, after the tick
+    std::vector<ComponentTypeId> m_changed{};
+    std::vector<ComponentTypeId> m_added{};
+
+    bool HasMaskFilters () const { return m_excluded.any() || !m_anyOf.empty(); }
+    bool HasTickFilters () const { return !m_changed.empty() || !m_added.empty(); }
+    bool HasConditions () const { return HasMaskFilters() || HasTickFilters(); }
+
+    // Checks the exclusions and any-of groups a word at a time, the required components are left to the query
+    bool PassesMasks (const ComponentBitset& bitset) const {
+        if ((bitset & m_excluded).any()) {
+            return false;
+        }
+        for (const ComponentBitset& anyOf : m_anyOf) {
+            if ((bitset & anyOf).none()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Whether every component the masks mention is in the bitset, e.g. so they can be decided per archetype
+    bool MasksWithin (const ComponentBitset& bitset) const {
+        if ((m_excluded & ~bitset).any()) {
+            return false;
+        }
+        for (const ComponentBitset& anyOf : m_anyOf) {
+            if ((anyOf & ~bitset).any()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void Merge (const QueryFilter& other) {
+        m_required |= other.m_required;
+        m_excluded |= other.m_excluded;
+        m_anyOf.insert(m_anyOf.end(), other.m_anyOf.begin(), other.m_anyOf.end());
+        m_changed.insert(m_changed.end(), other.m_changed.begin(), other.m_changed.end());
+        m_added.insert(m_added.end(), other.m_added.begin(), other.m_added.end());
+    }
+};
+
+// Matches entities that have the component without passing it to the callback, which suits tags
+template <typename TComponent>
+struct With {
+    static void Apply (QueryFilter& filter, const ComponentRegistry& registry) {
+        filter.m_required.set(registry.GetTypeId<TComponent>());
+    }
+};
+
+// Matches entities that do not have the component
+template <typename TComponent>
+struct Without {
+    static void Apply (QueryFilter& filter, const ComponentRegistry& registry) {
+        filter.m_excluded.set(registry.GetTypeId<TComponent>());
+    }
+};
+
+// Matches entities that have at least one of the components
+template <typename... TComponents>
+struct AnyOf {
+    static_assert(sizeof...(TComponents) > 0, "AnyOf needs at least one component.");
+    static void Apply (QueryFilter& filter, const ComponentRegistry& registry) {
+        ComponentBitset anyOf{};
+        (anyOf.set(registry.GetTypeId<TComponents>()), ...);
+        filter.m_anyOf.push_back(anyOf);
+    }
+};
+
+// Matches entities whose component was added or written since the tick. Any access that can modify the
+// component counts as a write: non-const GetComponent, SystemEntity::WriteComponent, StoreComponent, and
+// non-const ForEach parameters and ChunkSpans.
+template <typename TComponent>
+struct Changed {
+    static_assert(!std::is_empty<std::decay_t<TComponent>>::value, "Empty components keep no ticks.");
+    static void Apply (QueryFilter& filter, const ComponentRegistry& registry) {
+        const ComponentTypeId typeId = registry.GetTypeId<TComponent>();
+        filter.m_required.set(typeId);
+        filter.m_changed.push_back(typeId);
+    }
+};
+
+// Matches entities that gained the component since the tick
+template <typename TComponent>
+struct Added {
+    static_assert(!std::is_empty<std::decay_t<TComponent>>::value, "Empty components keep no ticks.");
+    static void Apply (QueryFilter& filter, const ComponentRegistry& registry) {
+        const ComponentTypeId typeId = registry.GetTypeId<TComponent>();
+        filter.m_required.set(typeId);
+        filter.m_added.push_back(typeId);
+    }
+};
+
+}
\ No newline at end of file
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "EncosysConfig.h"
+#include "Query.h"
+#include <array>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace ecs {
+
+class QueryRegistry {
+public:
+    QueryRegistry () = default;
+    virtual ~QueryRegistry ();
+
+    QueryRegistry (const QueryRegistry&) = delete;
+    QueryRegistry& operator= (const QueryRegistry&) = delete;
+
+    // Returns the query for the given bitset, calling populate to fill it with the current matches on first use.
+    // Systems running concurrently may call this, queries are never moved once created. Pinned queries are
+    // never released, the others stay cached until Release drops them.
+    Query& FindOrCreate (const ComponentBitset& bitset, const std::function<void(Query&)>& populate, bool pinned = false);
+
+    // Deletes the least recently used queries that are not pinned until at most keep of them are left.
+    // Must not overlap any use of the queries.
+    void Release (uint32_t keep);
+
+    // Empties every query, the queries themselves stay registered
+    void Clear ();
+
+    // Reorders the entities of every query by rank, see Query::Sort
+    void Sort (const std::function<uint32_t(EntityId)>& rank, bool incremental);
+
+    // Adds new active entities that all share the same bitset to every query they match
+    void InsertBatch (const EntityId* ids, uint32_t count, const ComponentBitset& bitset);
+
+    // Adds or removes the entity from every query whose match changed, must not overlap FindOrCreate
+    void Update (EntityId id, const ComponentBitset& oldBitset, bool oldActive, const ComponentBitset& newBitset, bool newActive);
+
+private:
+    // Calls the callback once for every query whose bitset shares a bit with the given bitset, which
+    // includes every query matching it. Queries with an empty bitset are visited when includeEmpty is set.
+    template <typename TCallback>
+    void ForEachOverlapping (const ComponentBitset& bitset, bool includeEmpty, TCallback&& callback);
+
+    std::vector<Query*> m_queries{};
+    std::unordered_map<ComponentBitset, Query*> m_lookup{};
+    // Every query is listed under each of its components, so a change only visits the queries it can affect
+    std::array<std::vector<Query*>, ENCOSYS_MAX_COMPONENTS_> m_componentQueries{};
+    std::vector<Query*> m_emptyQueries{};
+    // No query includes a type id from here on
+    ComponentTypeId m_typeIdLimit{0};
+    uint32_t m_useCounter{0};
+    uint32_t m_visitCounter{0};
+    std::mutex m_mutex;
+};
+
+} // namespace ecs
\ No newline at end of file
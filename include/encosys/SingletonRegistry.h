@@ -1,11 +1,13 @@
 #pragma once
 
 #include "EncosysConfig.h"
+#include "TypeIndex.h"
 #include "VirtualObject.h"
 #include <array>
 #include <cassert>
 #include <map>
 #include <typeindex>
+#include <vector>
 
 namespace ecs {
 
@@ -25,14 +27,26 @@ public:
         assert(m_typeToId.find(typeid(TDecayed)) == m_typeToId.end());
         m_typeToId[typeid(TDecayed)] = id;
         m_singletons[id] = VirtualObject(TDecayed());
+
+        const uint32_t index = TypeIndex<SingletonRegistry>::Get<TDecayed>();
+        if (index >= m_indexToId.size()) {
+            m_indexToId.resize(index + 1, c_invalidIndex);
+        }
+        m_indexToId[index] = id;
         return id;
     }
 
     template <typename TSingleton>
     SingletonTypeId GetTypeId () const {
-        auto it = m_typeToId.find(typeid(std::decay_t<TSingleton>));
-        assert(it != m_typeToId.cend());
-        return it->second;
+        const uint32_t index = TypeIndex<SingletonRegistry>::Get<std::decay_t<TSingleton>>();
+        assert(index < m_indexToId.size() && m_indexToId[index] != c_invalidIndex);
+        return m_indexToId[index];
+    }
+
+    // Slow path for tools that only have runtime type information, returns c_invalidIndex if unregistered
+    SingletonTypeId FindTypeId (std::type_index type) const {
+        auto it = m_typeToId.find(type);
+        return it != m_typeToId.cend() ? it->second : c_invalidIndex;
     }
 
     bool HasType (SingletonTypeId id) const {
@@ -40,15 +54,16 @@ public:
     }
 
     template <typename TSingleton>
-    bool HasType () {
-        return HasType(GetTypeId<TSingleton>());
+    bool HasType () const {
+        const uint32_t index = TypeIndex<SingletonRegistry>::Get<std::decay_t<TSingleton>>();
+        return index < m_indexToId.size() && m_indexToId[index] != c_invalidIndex;
     }
 
     template <typename TSingleton>
-    auto& GetSingleton () { return GetSingleton(GetTypeId<TSingleton>()).Get<std::decay_t<TSingleton>>(); }
+    auto& GetSingleton () { return GetSingleton(GetTypeId<TSingleton>()).template Get<std::decay_t<TSingleton>>(); }
 
     template <typename TSingleton>
-    const auto& GetSingleton () const { return GetSingleton(GetTypeId<TSingleton>()).Get<const std::decay_t<TSingleton>>(); }
+    const auto& GetSingleton () const { return GetSingleton(GetTypeId<TSingleton>()).template Get<std::decay_t<TSingleton>>(); }
 
     VirtualObject& GetSingleton (SingletonTypeId id) { assert(id < Count()); return m_singletons[id]; }
     const VirtualObject& GetSingleton (SingletonTypeId id) const { assert(id < Count()); return m_singletons[id]; }
@@ -58,6 +73,7 @@ public:
 private:
     std::array<VirtualObject, ENCOSYS_MAX_SINGLETONS_> m_singletons{};
     std::map<std::type_index, SingletonTypeId> m_typeToId{};
+    std::vector<SingletonTypeId> m_indexToId{};
 };
 
 } // namespace ecs
\ No newline at end of file
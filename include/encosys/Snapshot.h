@@ -0,0 +1,260 @@
+#pragma once
+
+#include "EncosysConfig.h"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace ecs {
+
+// Identifies snapshot files, and the version changes whenever the layout of the data does
+const uint32_t c_snapshotMagic = 0x53534345;
+const uint32_t c_snapshotVersion = 1;
+
+// Streams the raw bytes of a snapshot into a file, or appends them to a buffer. Values are written in the
+// layout of the running build, so snapshots only load into builds with the same types, configuration and byte order.
+class SnapshotWriter {
+public:
+    SnapshotWriter () = default;
+    explicit SnapshotWriter (std::vector<uint8_t>& buffer) : m_buffer{&buffer} {}
+    ~SnapshotWriter ();
+
+    SnapshotWriter (const SnapshotWriter&) = delete;
+    SnapshotWriter& operator= (const SnapshotWriter&) = delete;
+
+    bool Open (const char* path);
+    // Flushes and closes the file, returns false if any write failed
+    bool Close ();
+
+    void Write (const void* data, std::size_t bytes);
+
+    template <typename T>
+    void Write (const T& value) {
+        static_assert(std::is_trivially_copyable<T>::value, "Snapshots hold raw bytes.");
+        Write(&value, sizeof(T));
+    }
+
+    // Writes the element count followed by the elements
+    template <typename TVector>
+    void WriteVector (const TVector& values) {
+        static_assert(std::is_trivially_copyable<typename TVector::value_type>::value, "Snapshots hold raw bytes.");
+        Write(static_cast<uint64_t>(values.size()));
+        Write(values.data(), values.size() * sizeof(typename TVector::value_type));
+    }
+
+private:
+    std::vector<uint8_t>* m_buffer{nullptr};
+    std::FILE* m_file{nullptr};
+    bool m_failed{false};
+};
+
+// Reads a snapshot straight out of a read-only mapping of the file, so bulk data is copied once from the
+// page cache into its destination, or out of a buffer. Reads past the end fail without touching the
+// destination and every later read fails as well, so callers can check once after a group of reads.
+class SnapshotReader {
+public:
+    SnapshotReader () = default;
+    SnapshotReader (const uint8_t* data, std::size_t size) : m_data{data}, m_size{size} {}
+    ~SnapshotReader ();
+
+    SnapshotReader (const SnapshotReader&) = delete;
+    SnapshotReader& operator= (const SnapshotReader&) = delete;
+
+    bool Open (const char* path);
+    void Close ();
+
+    bool Read (void* data, std::size_t bytes);
+
+    template <typename T>
+    bool Read (T& value) {
+        static_assert(std::is_trivially_copyable<T>::value, "Snapshots hold raw bytes.");
+        return Read(&value, sizeof(T));
+    }
+
+    // Replaces the contents with the elements written by WriteVector, new elements start as copies of fill
+    template <typename TVector>
+    bool ReadVector (TVector& values, const typename TVector::value_type& fill = {}) {
+        uint64_t count = 0;
+        if (!Read(count) || count > GetRemainingBytes() / sizeof(typename TVector::value_type)) {
+            return Fail();
+        }
+        values.assign(static_cast<std::size_t>(count), fill);
+        return Read(values.data(), values.size() * sizeof(typename TVector::value_type));
+    }
+
+    std::size_t GetRemainingBytes () const { return m_failed ? 0 : m_size - m_offset; }
+    bool HasFailed () const { return m_failed; }
+    bool Fail () { m_failed = true; return false; }
+
+private:
+    const uint8_t* m_data{nullptr};
+    std::size_t m_size{0};
+    std::size_t m_offset{0};
+    bool m_failed{false};
+    bool m_mapped{false};
+#if defined(_WIN32)
+    void* m_file{nullptr};
+    void* m_mapping{nullptr};
+#endif
+};
+
+// One flag per block of an array, set by every write and cleared once a delta snapshot copied the block.
+// Blocks are 1 << blockShift elements. Flags are atomic since parallel iteration marks the blocks of
+// different elements from several threads, but only marks may run concurrently.
+class DirtyBlocks {
+public:
+    explicit DirtyBlocks (uint32_t blockShift = 0) : m_blockShift{blockShift} {}
+
+    DirtyBlocks (const DirtyBlocks&) = delete;
+    DirtyBlocks& operator= (const DirtyBlocks&) = delete;
+    DirtyBlocks (DirtyBlocks&&) = default;
+    DirtyBlocks& operator= (DirtyBlocks&&) = default;
+
+    uint32_t GetBlockShift () const { return m_blockShift; }
+    void SetBlockShift (uint32_t blockShift) { m_blockShift = blockShift; }
+
+    // Marks the block of the element at index, the flags grow to cover it
+    void Mark (uint32_t index) {
+        const uint32_t block = index >> m_blockShift;
+        if (block >= m_count) {
+            Grow(block + 1);
+        }
+        m_flags[block].store(1, std::memory_order_relaxed);
+    }
+
+    // Marks the blocks of the elements in [first, end)
+    void MarkRange (uint32_t first, uint32_t end) {
+        if (first >= end) {
+            return;
+        }
+        const uint32_t lastBlock = (end - 1) >> m_blockShift;
+        if (lastBlock >= m_count) {
+            Grow(lastBlock + 1);
+        }
+        for (uint32_t block = first >> m_blockShift; block <= lastBlock; ++block) {
+            m_flags[block].store(1, std::memory_order_relaxed);
+        }
+    }
+
+    // Covers the blocks up to count without marking them, marks of covered blocks never allocate
+    void Reserve (uint32_t count) {
+        if (count > m_count) {
+            Grow(count);
+        }
+    }
+
+    bool IsDirty (uint32_t block) const { return block < m_count && m_flags[block].load(std::memory_order_relaxed) != 0; }
+
+    void Clear () {
+        for (uint32_t block = 0; block < m_count; ++block) {
+            m_flags[block].store(0, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    void Grow (uint32_t count) {
+        if (count > m_capacity) {
+            const uint32_t capacity = std::max(count, m_capacity * 2);
+            std::unique_ptr<std::atomic<uint8_t>[]> flags(new std::atomic<uint8_t>[capacity]);
+            for (uint32_t block = 0; block < capacity; ++block) {
+                flags[block].store(block < m_count ? m_flags[block].load(std::memory_order_relaxed) : 0, std::memory_order_relaxed);
+            }
+            m_flags = std::move(flags);
+            m_capacity = capacity;
+        }
+        m_count = count;
+    }
+
+    std::unique_ptr<std::atomic<uint8_t>[]> m_flags{};
+    uint32_t m_count{0};
+    uint32_t m_capacity{0};
+    uint32_t m_blockShift;
+};
+
+// Exposes a plain array to delta snapshots in blocks of its DirtyBlocks, whose flags the writes to the array must set
+template <typename TVector>
+class ArrayBlocks {
+public:
+    ArrayBlocks (TVector& values, DirtyBlocks& dirtyBlocks) : m_values{values}, m_dirtyBlocks{dirtyBlocks} {}
+
+    DirtyBlocks& GetDirtyBlocks () { return m_dirtyBlocks; }
+    std::size_t GetSize () const { return m_values.size(); }
+    uint32_t GetUsedBlockCount () const { return static_cast<uint32_t>((m_values.size() + GetBlockSize() - 1) >> m_dirtyBlocks.GetBlockShift()); }
+
+    void SaveBlock (uint32_t block, std::vector<uint8_t>& bytes) const {
+        const std::size_t first = static_cast<std::size_t>(block) << m_dirtyBlocks.GetBlockShift();
+        const std::size_t count = std::min<std::size_t>(GetBlockSize(), m_values.size() - first);
+        bytes.resize(count * sizeof(typename TVector::value_type));
+        memcpy(bytes.data(), m_values.data() + first, bytes.size());
+    }
+
+    // The copy may have been taken when the block held more elements than the array does now
+    void LoadBlock (uint32_t block, const std::vector<uint8_t>& bytes) {
+        const std::size_t first = static_cast<std::size_t>(block) << m_dirtyBlocks.GetBlockShift();
+        const std::size_t count = std::min(bytes.size() / sizeof(typename TVector::value_type), m_values.size() - first);
+        memcpy(m_values.data() + first, bytes.data(), count * sizeof(typename TVector::value_type));
+    }
+
+private:
+    std::size_t GetBlockSize () const { return std::size_t{1} << m_dirtyBlocks.GetBlockShift(); }
+
+    TVector& m_values;
+    DirtyBlocks& m_dirtyBlocks;
+};
+
+// Delta snapshots kept for rollback. Each holds the small state that is always copied whole and a copy of every
+// block written since the snapshot before it, keyed by the storage the block belongs to and its index there.
+// The oldest snapshot holds every block, and once more than the capacity are held the next oldest is folded
+// into it, so any retained snapshot can be rebuilt from the newest copy of each block taken at or before it.
+class SnapshotHistory {
+public:
+    struct Snapshot {
+        uint32_t m_id{0};
+        std::vector<uint8_t> m_state{};
+        std::unordered_map<uint64_t, std::vector<uint8_t>> m_blocks{};
+    };
+
+    static uint64_t BlockKey (uint32_t storage, uint32_t block) { return (static_cast<uint64_t>(storage) << 32) | block; }
+
+    explicit SnapshotHistory (uint32_t capacity) : m_capacity{std::max(capacity, 1u)} {}
+
+    uint32_t GetCapacity () const { return m_capacity; }
+    void SetCapacity (uint32_t capacity);
+
+    bool IsEmpty () const { return m_snapshots.empty(); }
+    uint32_t GetOldestId () const { ENCOSYS_ASSERT_(!IsEmpty()); return m_snapshots.front().m_id; }
+    uint32_t GetNewestId () const { ENCOSYS_ASSERT_(!IsEmpty()); return m_snapshots.back().m_id; }
+    bool Contains (uint32_t id) const { return !IsEmpty() && id >= GetOldestId() && id <= GetNewestId(); }
+    const Snapshot& Get (uint32_t id) const { ENCOSYS_ASSERT_(Contains(id)); return m_snapshots[id - GetOldestId()]; }
+
+    // Appends an empty snapshot with the next id, folding the oldest ones together while over capacity.
+    // The new snapshot may already hold folded blocks, which its own copies replace.
+    Snapshot& Push ();
+
+    // The newest copy of the block taken at or before the snapshot, nullptr if it was never copied
+    const std::vector<uint8_t>* FindBlock (uint32_t id, uint64_t key) const;
+    // The keys of every block copied after the snapshot
+    void CollectNewerBlocks (uint32_t id, std::unordered_set<uint64_t>& keys) const;
+    // Drops the snapshots taken after the snapshot, whose ids the next ones reuse
+    void DropNewer (uint32_t id);
+    // Drops every snapshot, the next one holds every block again but keeps counting ids
+    void Clear ();
+
+private:
+    void FoldOldest ();
+
+    std::deque<Snapshot> m_snapshots{};
+    uint32_t m_capacity;
+    uint32_t m_nextId{0};
+};
+
+} // namespace ecs
\ No newline at end of file
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+
+namespace ecs {
+
+// Where one field of a structure-of-arrays component lives inside the component
+struct SoaField {
+    uint32_t m_offset;
+    uint32_t m_bytes;
+    uint32_t m_alignment;
+};
+
+template <typename T>
+struct MemberTraits;
+
+template <typename C, typename F>
+struct MemberTraits<F C::*> {
+    using Class = C;
+    using Field = F;
+};
+
+template <auto Member>
+struct SoaFieldTag {};
+
+// Specialize for an archetype component to store each of its fields in a column of its own:
+//     template <> struct ecs::SoaLayout<Position> : ecs::SoaFields<&Position::x, &Position::y> {};
+// Every data member has to be listed, and the component must be trivially copyable.
+template <typename T>
+struct SoaLayout {
+    static constexpr bool c_enabled = false;
+    static constexpr uint32_t c_fieldCount = 0;
+    static const SoaField* Fields () { return nullptr; }
+};
+
+template <auto First, auto... Rest>
+struct SoaFields {
+    using Component = typename MemberTraits<decltype(First)>::Class;
+
+    static_assert((std::is_same<typename MemberTraits<decltype(Rest)>::Class, Component>::value && ...), "SoA fields must belong to the same component.");
+    static_assert(std::is_trivially_copyable<Component>::value, "SoA components must be trivially copyable.");
+    static_assert((sizeof(typename MemberTraits<decltype(First)>::Field) + ... + sizeof(typename MemberTraits<decltype(Rest)>::Field)) <= sizeof(Component), "SoA fields must be listed once.");
+
+    static constexpr bool c_enabled = true;
+    static constexpr uint32_t c_fieldCount = 1 + sizeof...(Rest);
+
+    static const SoaField* Fields () {
+        static const SoaField s_fields[] = { MakeField<First>(), MakeField<Rest>()... };
+        return s_fields;
+    }
+
+    // Returns the column of the member, or c_fieldCount if it is not listed
+    template <auto Member>
+    static constexpr uint32_t IndexOf () {
+        constexpr bool matches[] = { std::is_same<SoaFieldTag<Member>, SoaFieldTag<First>>::value, std::is_same<SoaFieldTag<Member>, SoaFieldTag<Rest>>::value... };
+        for (uint32_t i = 0; i < c_fieldCount; ++i) {
+            if (matches[i]) {
+                return i;
+            }
+        }
+        return c_fieldCount;
+    }
+
+private:
+    template <auto Member>
+    static SoaField MakeField () {
+        using TField = typename MemberTraits<decltype(Member)>::Field;
+        alignas(Component) uint8_t storage[sizeof(Component)];
+        const Component* component = reinterpret_cast<const Component*>(storage);
+        const uint32_t offset = static_cast<uint32_t>(reinterpret_cast<const uint8_t*>(&(component->*Member)) - storage);
+        return SoaField{offset, static_cast<uint32_t>(sizeof(TField)), static_cast<uint32_t>(alignof(TField))};
+    }
+};
+
+}
\ No newline at end of file
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <algorithm>
+#include <iterator>
+#include <vector>
+
+namespace ecs {
+
+// Sorts values that were sorted before a few of them changed. Values out of place next to their neighbors
+// are pulled out, sorted on their own and merged back, which is O(n + k log k) for k changed values.
+template <typename T, typename TLess>
+void SortNearlySorted (std::vector<T>& values, TLess less) {
+    std::vector<T> kept;
+    std::vector<T> moved;
+    kept.reserve(values.size());
+    for (T& value : values) {
+        if (kept.empty() || !less(value, kept.back())) {
+            kept.push_back(std::move(value));
+        }
+        // When the value still fits after the one before the last, the last is the one that moved up
+        else if (kept.size() > 1 && !less(value, kept[kept.size() - 2])) {
+            moved.push_back(std::move(kept.back()));
+            kept.back() = std::move(value);
+        }
+        else {
+            moved.push_back(std::move(value));
+        }
+    }
+    if (moved.empty()) {
+        values = std::move(kept);
+        return;
+    }
+    std::stable_sort(moved.begin(), moved.end(), less);
+    values.clear();
+    std::merge(std::make_move_iterator(kept.begin()), std::make_move_iterator(kept.end()),
+               std::make_move_iterator(moved.begin()), std::make_move_iterator(moved.end()),
+               std::back_inserter(values), less);
+}
+
+}
\ No newline at end of file
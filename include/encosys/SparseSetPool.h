@@ -0,0 +1,136 @@
+#pragma once
+
+#include "BlockMemoryPool.h"
+#include "EntityId.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace ecs {
+
+// Packed component storage where the components and the ids of the entities that own them
+// are kept dense in the same order, so there are never holes to fill. The component indices in EntityStorage act as the sparse
+// side of the set, and removal moves the last component into the hole so the pool never
+// fragments. Callers must patch the component index of the entity returned by GetEntityId
+// for the destroyed index when it is still within the pool.
+class SparseSetStorage : public BlockMemoryPool {
+public:
+    explicit SparseSetStorage (uint32_t elementSize, uint32_t blockSize, uint32_t alignment, Allocator& allocator)
+        : BlockMemoryPool(elementSize, blockSize, alignment, allocator) {}
+
+protected:
+    uint32_t Push (EntityId id) {
+        const uint32_t index = GetSize();
+        Resize(index + 1);
+        m_elements[index] = Element{id, ComponentTicks{}};
+        return index;
+    }
+
+    void Pop () {
+        Resize(GetSize() - 1);
+    }
+};
+
+template <typename T>
+class SparseSetPool : public SparseSetStorage {
+public:
+    explicit SparseSetPool (uint32_t blockSize = ENCOSYS_POOL_BLOCK_SIZE_, uint32_t alignment = alignof(T), Allocator& allocator = HeapAllocator::Instance())
+        : SparseSetStorage(sizeof(T), blockSize, std::max<uint32_t>(alignment, alignof(T)), allocator) {}
+
+    ~SparseSetPool () override {
+        DestroyObjects();
+    }
+
+    template <typename... Args>
+    uint32_t Create (EntityId owner, Args&&... args) {
+        const uint32_t index = Push(owner);
+        new (GetData(index)) T(std::forward<Args>(args)...);
+        return index;
+    }
+
+    T& GetObject (uint32_t index) {
+        return *reinterpret_cast<T*>(BlockMemoryPool::GetData(index));
+    }
+
+    const T& GetObject (uint32_t index) const {
+        return *reinterpret_cast<const T*>(BlockMemoryPool::GetData(index));
+    }
+
+    // The owner of the copy must be assigned through SetEntityId
+    uint32_t CreateFromCopy (uint32_t index) override {
+        const uint32_t copyIndex = Push(c_invalidEntityId);
+        new (GetData(copyIndex)) T(GetObject(index));
+        return copyIndex;
+    }
+
+    // The owners of the copies must be assigned through SetEntityId
+    uint32_t CreateCopies (const uint8_t* source, uint32_t count) override {
+        uint32_t first = GetSize();
+        if constexpr (std::is_trivially_copyable<T>::value) {
+            first = BlockMemoryPool::CreateCopies(source, count);
+        }
+        else {
+            Resize(first + count);
+            for (uint32_t index = first; index < first + count; ++index) {
+                new (GetData(index)) T(*reinterpret_cast<const T*>(source));
+            }
+        }
+        return first;
+    }
+
+    void Destroy (uint32_t index) override {
+        const uint32_t last = GetSize() - 1;
+        if constexpr (std::is_trivially_copyable<T>::value) {
+            if (index != last) {
+                memcpy(GetData(index), GetData(last), sizeof(T));
+            }
+        }
+        else {
+            T& object = GetObject(index);
+            object.~T();
+            if (index != last) {
+                T& lastObject = GetObject(last);
+                new (&object) T(std::move(lastObject));
+                lastObject.~T();
+            }
+        }
+        if (index != last) {
+            MoveElement(index, last);
+        }
+        Pop();
+    }
+
+    // Trivially destructible objects are dropped without touching them, so this is O(blocks)
+    void Clear () override {
+        DestroyObjects();
+        BlockMemoryPool::Clear();
+    }
+
+    void Swap (uint32_t a, uint32_t b) override {
+        if constexpr (std::is_trivially_copyable<T>::value) {
+            BlockMemoryPool::Swap(a, b);
+        }
+        else {
+            T temp(std::move(GetObject(a)));
+            GetObject(a).~T();
+            new (GetData(a)) T(std::move(GetObject(b)));
+            GetObject(b).~T();
+            new (GetData(b)) T(std::move(temp));
+            SwapElements(a, b);
+        }
+    }
+
+private:
+    void DestroyObjects () {
+        if constexpr (!std::is_trivially_destructible<T>::value) {
+            for (uint32_t i = 0; i < GetSize(); ++i) {
+                GetObject(i).~T();
+            }
+        }
+    }
+};
+
+}
\ No newline at end of file
@@ -1,8 +1,11 @@
 #pragma once
 
+#include "CommandBuffer.h"
 #include "Encosys.h"
 #include "SystemIter.h"
 #include "SystemType.h"
+#include <new>
+#include <type_traits>
 
 namespace ecs {
 
@@ -28,10 +31,37 @@ protected:
         type.RequiredSingleton(m_encosys->GetSingletonTypeId<TSingleton>(), access);
     }
 
+    // Narrows SystemIterator to the entities that pass a filter such as Changed<T> or Added<T>
+    template <typename TFilter> void Filter (SystemType& type) {
+        type.AddFilter(m_encosys->MakeQueryFilter<TFilter>());
+    }
+
+    void RequireExclusiveAccess (SystemType& type) {
+        type.RequireExclusive();
+    }
+
     SystemIter SystemIterator () { return SystemIter(*m_encosys, *m_type); }
 
     SystemEntity GetEntity (ecs::EntityId id) { return SystemEntity(*m_type, m_encosys->Get(id)); }
 
+    // Structural changes made during Update must be recorded and are applied once every system has run
+    CommandBuffer& Commands () { return m_encosys->GetCommandBuffer(); }
+
+    // Scratch memory of the calling thread that is released wholesale at the end of Encosys::Update
+    template <typename T>
+    T* FrameAlloc (uint32_t count) {
+        static_assert(std::is_trivially_destructible<T>::value, "Frame allocations are never destroyed.");
+        T* data = static_cast<T*>(m_encosys->GetFrameAllocator().Allocate(count * sizeof(T), alignof(T)));
+        for (uint32_t i = 0; i < count; ++i) {
+            new (data + i) T;
+        }
+        return data;
+    }
+
+    // For containers such as FrameVector, which must be destroyed before Update returns
+    template <typename T>
+    StlAllocator<T> FrameStlAllocator () { return StlAllocator<T>(m_encosys->GetFrameAllocator()); }
+
     template <typename TSingleton>
     TSingleton& WriteSingleton () {
         ENCOSYS_ASSERT_(m_type->IsSingletonWriteAllowed(m_encosys->GetSingletonTypeId<TSingleton>()));
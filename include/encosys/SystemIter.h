@@ -13,17 +13,20 @@ public:
     }
 
     bool IsValid () const { return m_entity.IsValid(); }
+    EntityId GetId () const { return m_entity.GetId(); }
 
+    // Records the write at the tick of the running system
     template <typename TComponent>
     TComponent* WriteComponent () {
         ENCOSYS_ASSERT_(m_type.IsComponentWriteAllowed(m_entity.GetComponentTypeId<TComponent>()));
-        return m_entity.GetComponent<TComponent>();
+        return m_entity.WriteComponent<TComponent>(m_type.GetRunTick());
     }
 
     template <typename TComponent>
     const TComponent* ReadComponent () const {
         ENCOSYS_ASSERT_(m_type.IsComponentReadAllowed(m_entity.GetComponentTypeId<TComponent>()));
-        return m_entity.GetComponent<TComponent>();
+        const Entity& entity = m_entity;
+        return entity.GetComponent<TComponent>();
     }
 
 private:
@@ -31,47 +34,128 @@ private:
     Entity m_entity;
 };
 
+// Walks the cached query of the SystemType, so only matching entities are visited, and skips the entities
+// rejected by the filters of the SystemType. With tick filters it walks the entities SystemIter collected instead.
 class SystemIterType {
 public:
-    SystemIterType (Encosys& encosys, const SystemType& type, uint32_t index) :
+    SystemIterType (Encosys& encosys, const SystemType& type, const FrameVector<uint32_t>* filtered, uint32_t index) :
         m_encosys{encosys},
         m_type{type},
+        m_filtered{filtered},
         m_index{index} {
-        Next();
+        SkipFiltered();
     }
 
     bool operator== (SystemIterType rhs) { return m_index == rhs.m_index; }
     bool operator!= (SystemIterType rhs) { return m_index != rhs.m_index; }
-    SystemEntity operator* () { return SystemEntity(m_type, m_encosys[m_index]); }
-    void operator++ () { ++m_index; Next(); }
+    SystemEntity operator* () {
+        if (m_filtered != nullptr) {
+            return SystemEntity(m_type, m_encosys[(*m_filtered)[m_index]]);
+        }
+        return SystemEntity(m_type, m_encosys.Get(m_type.GetQuery().GetEntityId(m_index)));
+    }
+    void operator++ () { ++m_index; SkipFiltered(); }
 
 private:
-
-    void Next () {
-        while (m_index < m_encosys.ActiveEntityCount()) {
-            Entity entity = m_encosys[m_index];
-            if (entity.HasComponentBitset(m_type.GetRequiredBitset())) {
+    // Also steps over the holes left by entities removed from the query
+    void SkipFiltered () {
+        if (m_filtered != nullptr) {
+            return;
+        }
+        const QueryFilter& filter = m_type.GetFilter();
+        const Query& query = m_type.GetQuery();
+        for (; m_index < query.GetSize(); ++m_index) {
+            const EntityId id = query.GetEntityId(m_index);
+            if (id != c_invalidEntityId && (!filter.HasMaskFilters() || m_encosys.PassesFilter(id, filter, m_type.GetLastRunTick()))) {
                 break;
             }
-            ++m_index;
         }
     }
 
     Encosys& m_encosys;
     const SystemType& m_type;
+    const FrameVector<uint32_t>* m_filtered;
     uint32_t m_index;
 };
 
 class SystemIter {
 public:
-    explicit SystemIter (Encosys& encosys, const SystemType& type) : m_encosys{encosys}, m_type{type} {}
+    explicit SystemIter (Encosys& encosys, const SystemType& type) :
+        m_encosys{encosys},
+        m_type{type},
+        m_filtered{StlAllocator<uint32_t>(encosys.GetFrameAllocator())} {
+    }
+
+    SystemIterType begin () {
+        CollectFiltered();
+        return SystemIterType(m_encosys, m_type, GetFiltered(), 0);
+    }
+    SystemIterType end () {
+        CollectFiltered();
+        return SystemIterType(m_encosys, m_type, GetFiltered(), GetFiltered() != nullptr ? static_cast<uint32_t>(m_filtered.size()) : m_type.GetQuery().GetSize());
+    }
+
+    // Calls the callback with every matching SystemEntity, split into batches across the worker threads.
+    // The callback must be thread safe, and component access is still checked against the SystemType.
+    template <typename TCallback>
+    void ParallelForEach (TCallback&& callback, uint32_t grainSize = ENCOSYS_PARALLEL_GRAIN_SIZE_) {
+        const QueryFilter& filter = m_type.GetFilter();
+        if (filter.HasTickFilters()) {
+            CollectFiltered();
+            m_encosys.ParallelFor(static_cast<uint32_t>(m_filtered.size()), AlignGrainSize(grainSize), [&] (uint32_t begin, uint32_t end) {
+                for (uint32_t i = begin; i < end; ++i) {
+                    SystemEntity systemEntity(m_type, m_encosys[m_filtered[i]]);
+                    callback(systemEntity);
+                }
+            });
+            return;
+        }
+
+        const Query& query = m_type.GetQuery();
+        m_encosys.ParallelFor(query.GetSize(), AlignGrainSize(grainSize), [&] (uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; ++i) {
+                const EntityId id = query.GetEntityId(i);
+                if (id == c_invalidEntityId || (filter.HasMaskFilters() && !m_encosys.PassesFilter(id, filter, m_type.GetLastRunTick()))) {
+                    continue;
+                }
+                SystemEntity systemEntity(m_type, m_encosys.Get(id));
+                callback(systemEntity);
+            }
+        });
+    }
 
-    SystemIterType begin () { return SystemIterType(m_encosys, m_type, 0); }
-    SystemIterType end () { return SystemIterType(m_encosys, m_type, m_encosys.ActiveEntityCount()); }
+    // Calls the callback once per archetype chunk of matching entities, like Encosys::ForEachChunk. Every required
+    // component must be stored in archetypes, and the span types are checked against the access of the SystemType.
+    template <typename TCallback>
+    void ForEachChunk (TCallback&& callback) {
+        m_encosys.ForEachChunkBatched(callback, m_type.GetRequiredBitset(), m_type.GetFilter(), m_type.GetLastRunTick(), m_type.GetRunTick(), false, &m_type);
+    }
+
+    template <typename TCallback>
+    void ParallelForEachChunk (TCallback&& callback) {
+        m_encosys.ForEachChunkBatched(callback, m_type.GetRequiredBitset(), m_type.GetFilter(), m_type.GetLastRunTick(), m_type.GetRunTick(), true, &m_type);
+    }
 
 private:
+    // Tick filters skip the blocks and chunks written before the previous run instead of checking every entity
+    // of the query, so the matches are gathered up front into frame memory
+    void CollectFiltered () {
+        const QueryFilter& filter = m_type.GetFilter();
+        if (!filter.HasTickFilters() || m_collected) {
+            return;
+        }
+        m_encosys.ForEachFiltered(m_type.GetRequiredBitset(), filter, m_type.GetLastRunTick(), [this] (uint32_t entityIndex) {
+            m_filtered.push_back(entityIndex);
+        });
+        m_collected = true;
+    }
+
+    const FrameVector<uint32_t>* GetFiltered () const { return m_type.GetFilter().HasTickFilters() ? &m_filtered : nullptr; }
+
     Encosys& m_encosys;
     const SystemType& m_type;
+    FrameVector<uint32_t> m_filtered;
+    bool m_collected{false};
 };
 
 }
\ No newline at end of file
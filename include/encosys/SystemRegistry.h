@@ -26,7 +26,7 @@ public:
         systemType = SystemType(id);
         m_typeToId[typeid(TDecayed)] = id;
 
-        System* system = new TSystem();
+        TSystem* system = new TSystem();
         system->m_encosys = &encosys;
         system->m_type = &systemType;
         ENCOSYS_ASSERT_(system != nullptr);
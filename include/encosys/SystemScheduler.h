@@ -0,0 +1,28 @@
+#pragma once
+
+#include "EncosysConfig.h"
+#include <vector>
+
+namespace ecs {
+
+class SystemRegistry;
+class ThreadPool;
+
+// Orders systems into a dependency graph using their read/write declarations. A system depends
+// on every earlier registered system it conflicts with, and systems without a path between them
+// run concurrently.
+class SystemScheduler {
+public:
+    void Build (const SystemRegistry& systemRegistry);
+    void Run (ThreadPool& threadPool, SystemRegistry& systemRegistry, TimeDelta delta) const;
+
+    uint32_t Count () const { return static_cast<uint32_t>(m_dependencyCounts.size()); }
+    const std::vector<uint32_t>& GetDependents (uint32_t system) const { return m_dependents[system]; }
+
+private:
+    std::vector<uint32_t> m_dependencyCounts{};
+    std::vector<std::vector<uint32_t>> m_dependents{};
+    std::vector<uint32_t> m_roots{};
+};
+
+}
\ No newline at end of file
@@ -1,6 +1,9 @@
 #pragma once
 
+#include "ChangeTicks.h"
 #include "EncosysConfig.h"
+#include "Query.h"
+#include "QueryFilter.h"
 
 namespace ecs {
 
@@ -31,8 +34,48 @@ public:
         m_writeSingletons.set(type, access == Access::Write);
     }
 
+    // Narrows the entities of the system, the components the filter needs become required and tick
+    // filters read the ticks of their components
+    void AddFilter (const QueryFilter& filter) {
+        m_filter.Merge(filter);
+        m_requiredComponents |= filter.m_required;
+        for (const ComponentTypeId type : filter.m_changed) {
+            m_readComponents.set(type);
+        }
+        for (const ComponentTypeId type : filter.m_added) {
+            m_readComponents.set(type);
+        }
+    }
+
+    const QueryFilter& GetFilter () const { return m_filter; }
+
+    // Encosys::Update gives each run a new tick, writes of the system are recorded at it and its tick
+    // filters see what changed after the previous one
+    void BeginRun (ChangeTick tick) { m_lastRunTick = m_runTick; m_runTick = tick; }
+    ChangeTick GetRunTick () const { return m_runTick; }
+    ChangeTick GetLastRunTick () const { return m_lastRunTick; }
+    // Restores the ticks of a snapshot, or resets them so every component looks new to the next run
+    void SetRunTicks (ChangeTick runTick, ChangeTick lastRunTick) { m_runTick = runTick; m_lastRunTick = lastRunTick; }
+
+    // Exclusive systems never run alongside another system, e.g. because they create or destroy entities
+    void RequireExclusive () { m_exclusive = true; }
+    bool IsExclusive () const { return m_exclusive; }
+
+    // Two systems conflict when either one writes data the other accesses
+    bool ConflictsWith (const SystemType& other) const {
+        return m_exclusive || other.m_exclusive
+            || (m_writeComponents & other.m_readComponents).any()
+            || (other.m_writeComponents & m_readComponents).any()
+            || (m_writeSingletons & other.m_readSingletons).any()
+            || (other.m_writeSingletons & m_readSingletons).any();
+    }
+
     const ComponentBitset& GetRequiredBitset () const { return m_requiredComponents; }
 
+    // The cached entities matching the required components, assigned by Encosys::Initialize
+    void SetQuery (const Query* query) { m_query = query; }
+    const Query& GetQuery () const { ENCOSYS_ASSERT_(m_query != nullptr); return *m_query; }
+
     bool IsComponentReadAllowed (ComponentTypeId typeId) const { return m_readComponents.test(typeId); }
     bool IsComponentWriteAllowed (ComponentTypeId typeId) const { return m_writeComponents.test(typeId); }
 
@@ -46,6 +89,11 @@ private:
     ComponentBitset m_writeComponents{};
     SingletonBitset m_readSingletons{};
     SingletonBitset m_writeSingletons{};
+    bool m_exclusive{false};
+    const Query* m_query{nullptr};
+    QueryFilter m_filter{};
+    ChangeTick m_runTick{0};
+    ChangeTick m_lastRunTick{0};
 };
 
 }
\ No newline at end of file
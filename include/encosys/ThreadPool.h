@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ecs {
+
+// Work stealing thread pool. Every worker owns a task queue, tasks submitted from a worker
+// go to its own queue, and idle workers steal from the other queues. Threads outside the pool
+// share an extra queue and help run tasks while they wait.
+class ThreadPool {
+public:
+    explicit ThreadPool (uint32_t workerCount = 0);
+    ~ThreadPool ();
+
+    ThreadPool (const ThreadPool&) = delete;
+    ThreadPool& operator= (const ThreadPool&) = delete;
+
+    uint32_t WorkerCount () const { return static_cast<uint32_t>(m_threads.size()); }
+
+    void Submit (std::function<void()> task);
+
+    // Runs queued tasks on the calling thread until the counter drops to zero
+    void Wait (const std::atomic<uint32_t>& counter);
+
+    // Index of the calling worker in [1, WorkerCount()], or 0 for threads outside the pool
+    uint32_t CurrentQueueIndex () const;
+
+private:
+    struct TaskQueue {
+        std::mutex m_mutex;
+        std::deque<std::function<void()>> m_tasks;
+    };
+
+    void WorkerMain (uint32_t queueIndex);
+    bool TryRunTask (uint32_t queueIndex);
+
+    std::vector<std::unique_ptr<TaskQueue>> m_queues{};
+    std::vector<std::thread> m_threads{};
+    std::mutex m_sleepMutex{};
+    std::condition_variable m_wake{};
+    std::atomic<uint32_t> m_queuedCount{0};
+    bool m_running{true};
+};
+
+}
\ No newline at end of file
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
+
+namespace ecs {
+
+// Hands out a dense index per type within a family the first time the type is queried.
+// Registries map these indices to their own type ids, so resolving a type id on the hot
+// path is a cached static read followed by a single array lookup.
+template <typename TFamily>
+class TypeIndex {
+public:
+    template <typename T>
+    static uint32_t Get () {
+        static const uint32_t s_index = s_next++;
+        return s_index;
+    }
+
+private:
+    static std::atomic<uint32_t> s_next;
+};
+
+template <typename TFamily>
+std::atomic<uint32_t> TypeIndex<TFamily>::s_next{0};
+
+}
\ No newline at end of file
@@ -57,16 +57,13 @@ struct TypeList {
     };
 
     // Remove first type from type list
-    template <typename T>
-    struct _RemoveFirst;
-
-    template <>
-    struct _RemoveFirst<TypeList<>> {
+    template <typename T, typename = void>
+    struct _RemoveFirst {
         using Type = TypeList<>;
     };
 
     template <typename T, typename... Types>
-    struct _RemoveFirst<TypeList<T, Types...>> {
+    struct _RemoveFirst<TypeList<T, Types...>, void> {
         using Type = TypeList<Types...>;
     };
 
@@ -95,7 +92,7 @@ struct TypeList {
     };
 
     template <template <typename> class TWrapper, typename T, typename... T1s, typename TResult>
-    struct _WrapTypes<TWrapper, TypeList<T, T1s...>, typename TResult> {
+    struct _WrapTypes<TWrapper, TypeList<T, T1s...>, TResult> {
         using Type = typename _WrapTypes<TWrapper, TypeList<T1s...>, typename TResult::template Append<TWrapper<T>>::Type>::Type;
     };
 
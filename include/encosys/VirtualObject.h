@@ -1,11 +1,17 @@
 #pragma once
 
+#include <cstddef>
+#include <type_traits>
+
 namespace ecs {
 
 class VirtualObject {
     struct HolderBase {
         virtual ~HolderBase () {}
         virtual HolderBase* Clone () const = 0;
+        virtual void* Data () = 0;
+        virtual std::size_t Bytes () const = 0;
+        virtual bool IsTriviallyCopyable () const = 0;
     };
 
     template <typename T>
@@ -14,6 +20,9 @@ class VirtualObject {
         Holder (const T& t) : m_held{t} {}
         virtual ~Holder () {};
         virtual HolderBase* Clone () const { return new Holder<T>(*this); }
+        virtual void* Data () { return &m_held; }
+        virtual std::size_t Bytes () const { return sizeof(T); }
+        virtual bool IsTriviallyCopyable () const { return std::is_trivially_copyable<T>::value; }
         T m_held;
     };
 
@@ -45,6 +54,12 @@ public:
         }
     }
 
+    // Raw access to the held object for snapshots, which only copy trivially copyable ones
+    void* GetData () { return m_storage->Data(); }
+    const void* GetData () const { return m_storage->Data(); }
+    std::size_t GetBytes () const { return m_storage->Bytes(); }
+    bool IsTriviallyCopyable () const { return m_storage->IsTriviallyCopyable(); }
+
     template <typename T> T& Get () { return static_cast<Holder<T>*>(m_storage)->m_held; }
     template <typename T> const T& Get () const { return static_cast<Holder<T>*>(m_storage)->m_held; }
 
@@ -1,18 +1,8 @@
 workspace "encosys"
     configurations { "Debug", "Release" }
-    platforms { "Win32", "Win64" }
+    platforms { "Win32", "Win64", "Linux64" }
     location "build"
 
-project "encosys"
-    kind "StaticLib"
-    language "C++"
-    location "build"
-    targetdir "bin/%{cfg.buildcfg}"
-    includedirs { "include/encosys/" }
-    defines { "ENCOSYS_DISABLE_INCLUDE_ECSCONFIG_H" }
-
-    files { "include/**.h", "source/**.cpp" }
-
     filter "configurations:Debug"
         symbols "On"
         defines { "DEBUG" }
@@ -28,3 +18,35 @@ project "encosys"
     filter { "platforms:Win64" }
         system "Windows"
         architecture "x64"
+
+    filter { "platforms:Linux64" }
+        system "Linux"
+        architecture "x64"
+
+    filter {}
+
+project "encosys"
+    kind "StaticLib"
+    language "C++"
+    cppdialect "C++17"
+    location "build"
+    targetdir "bin/%{cfg.buildcfg}"
+    includedirs { "include/encosys/" }
+    defines { "ENCOSYS_DISABLE_INCLUDE_ECSCONFIG_H" }
+
+    files { "include/**.h", "source/**.cpp" }
+
+project "encosys-bench"
+    kind "ConsoleApp"
+    language "C++"
+    cppdialect "C++17"
+    location "build"
+    targetdir "bin/%{cfg.buildcfg}"
+    includedirs { "include/encosys/" }
+    defines { "ENCOSYS_DISABLE_INCLUDE_ECSCONFIG_H" }
+
+    files { "bench/**.h", "bench/**.cpp" }
+    links { "encosys" }
+
+    filter "system:Linux"
+        links { "pthread" }
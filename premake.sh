@@ -0,0 +1,2 @@
+#!/bin/sh
+premake5 --file=premake.lua gmake2
\ No newline at end of file
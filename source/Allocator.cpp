@@ -0,0 +1,236 @@
+#include "Allocator.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+#include <new>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace ecs {
+
+namespace {
+
+const std::size_t c_hugePageBytes = 2 * 1024 * 1024;
+const std::size_t c_regionAlignment = 4096;
+
+std::size_t AlignUp (std::size_t value, std::size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+}
+
+void* Allocator::Allocate (std::size_t bytes, std::size_t alignment) {
+    assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+    void* data = DoAllocate(bytes, alignment);
+    const std::size_t allocated = m_allocatedBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    std::size_t peak = m_peakBytes.load(std::memory_order_relaxed);
+    while (allocated > peak && !m_peakBytes.compare_exchange_weak(peak, allocated, std::memory_order_relaxed)) {}
+    return data;
+}
+
+void Allocator::Deallocate (void* data, std::size_t bytes, std::size_t alignment) {
+    if (data == nullptr) {
+        return;
+    }
+    m_allocatedBytes.fetch_sub(bytes, std::memory_order_relaxed);
+    DoDeallocate(data, bytes, alignment);
+}
+
+HeapAllocator& HeapAllocator::Instance () {
+    static HeapAllocator s_instance;
+    return s_instance;
+}
+
+void* HeapAllocator::DoAllocate (std::size_t bytes, std::size_t alignment) {
+    return ::operator new(bytes, std::align_val_t{alignment});
+}
+
+void HeapAllocator::DoDeallocate (void* data, std::size_t /*bytes*/, std::size_t alignment) {
+    ::operator delete(data, std::align_val_t{alignment});
+}
+
+MmapAllocator::MmapAllocator (Pages pages, bool populate) :
+    m_pages{pages},
+    m_populate{populate} {
+#if defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    m_pageBytes = info.dwAllocationGranularity;
+    if (pages != Pages::Normal) {
+        m_pageBytes = std::max<std::size_t>(m_pageBytes, GetLargePageMinimum());
+    }
+#else
+    m_pageBytes = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    if (pages != Pages::Normal) {
+        m_pageBytes = std::max(m_pageBytes, c_hugePageBytes);
+    }
+#endif
+}
+
+std::size_t MmapAllocator::MappedBytes (std::size_t bytes) const {
+    return AlignUp(std::max<std::size_t>(bytes, 1), m_pageBytes);
+}
+
+void* MmapAllocator::DoAllocate (std::size_t bytes, std::size_t alignment) {
+    const std::size_t mapped = MappedBytes(bytes);
+#if defined(_WIN32)
+    assert(alignment <= m_pageBytes);
+    void* data = nullptr;
+    if (m_pages == Pages::Huge) {
+        // Large pages need the lock pages privilege, so fall back to normal pages without it
+        data = VirtualAlloc(nullptr, mapped, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+    }
+    if (data == nullptr) {
+        data = VirtualAlloc(nullptr, mapped, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    }
+    if (data == nullptr) {
+        throw std::bad_alloc();
+    }
+    return data;
+#else
+#if defined(MAP_HUGETLB)
+    // Explicit huge pages come from the reserved pool already aligned to their size
+    if (m_pages == Pages::Huge && alignment <= c_hugePageBytes) {
+        void* data = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (m_populate ? MAP_POPULATE : 0), -1, 0);
+        if (data != MAP_FAILED) {
+            return data;
+        }
+    }
+#endif
+
+    // Map enough to move the start up to the alignment, which for huge pages lets the kernel back the whole range with them
+    const std::size_t osPageBytes = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    const std::size_t start = std::max(alignment, m_pageBytes);
+    const std::size_t slack = start > osPageBytes ? start : 0;
+    void* base = mmap(nullptr, mapped + slack, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+    uint8_t* data = reinterpret_cast<uint8_t*>(AlignUp(reinterpret_cast<std::uintptr_t>(base), start));
+    const std::size_t head = static_cast<std::size_t>(data - static_cast<uint8_t*>(base));
+    if (head > 0) {
+        munmap(base, head);
+    }
+    if (slack > head) {
+        munmap(data + mapped, slack - head);
+    }
+
+#if defined(MADV_HUGEPAGE)
+    if (m_pages != Pages::Normal) {
+        madvise(data, mapped, MADV_HUGEPAGE);
+    }
+#endif
+    // Touch every page after the advice so the faults already take huge pages
+    if (m_populate) {
+        for (std::size_t offset = 0; offset < mapped; offset += osPageBytes) {
+            data[offset] = 0;
+        }
+    }
+    return data;
+#endif
+}
+
+void MmapAllocator::DoDeallocate (void* data, std::size_t bytes, std::size_t /*alignment*/) {
+#if defined(_WIN32)
+    (void)bytes;
+    VirtualFree(data, 0, MEM_RELEASE);
+#else
+    munmap(data, MappedBytes(bytes));
+#endif
+}
+
+ArenaAllocator::ArenaAllocator (std::size_t capacity, Allocator& upstream) :
+    m_upstream{upstream},
+    m_capacity{capacity} {
+    m_region = static_cast<uint8_t*>(m_upstream.Allocate(m_capacity, c_regionAlignment));
+}
+
+ArenaAllocator::~ArenaAllocator () {
+    m_upstream.Deallocate(m_region, m_capacity, c_regionAlignment);
+}
+
+void* ArenaAllocator::DoAllocate (std::size_t bytes, std::size_t alignment) {
+    // The smallest free range that still fits once its start is aligned, the part before and after goes back
+    for (auto it = m_freeBySize.lower_bound(bytes); it != m_freeBySize.end(); ++it) {
+        uint8_t* const start = it->second;
+        const std::size_t size = it->first;
+        uint8_t* const data = reinterpret_cast<uint8_t*>(AlignUp(reinterpret_cast<std::uintptr_t>(start), alignment));
+        if (data + bytes > start + size) {
+            continue;
+        }
+        EraseFree(m_freeByAddress.find(start));
+        if (data > start) {
+            InsertFree(start, static_cast<std::size_t>(data - start));
+        }
+        if (data + bytes < start + size) {
+            InsertFree(data + bytes, static_cast<std::size_t>(start + size - data - bytes));
+        }
+        return data;
+    }
+
+    const std::uintptr_t region = reinterpret_cast<std::uintptr_t>(m_region);
+    const std::size_t offset = AlignUp(region + m_used, alignment) - region;
+    if (offset > m_capacity || bytes > m_capacity - offset) {
+        throw std::bad_alloc();
+    }
+    if (offset > m_used) {
+        InsertFree(m_region + m_used, offset - m_used);
+    }
+    m_used = offset + bytes;
+    return m_region + offset;
+}
+
+void ArenaAllocator::DoDeallocate (void* data, std::size_t bytes, std::size_t /*alignment*/) {
+    assert(data >= m_region && static_cast<uint8_t*>(data) + bytes <= m_region + m_used);
+    uint8_t* start = static_cast<uint8_t*>(data);
+    std::size_t size = bytes;
+
+    // Merge with the free ranges on either side
+    auto next = m_freeByAddress.lower_bound(start);
+    if (next != m_freeByAddress.begin()) {
+        auto previous = std::prev(next);
+        if (previous->first + previous->second == start) {
+            start = previous->first;
+            size += previous->second;
+            EraseFree(previous);
+        }
+    }
+    if (next != m_freeByAddress.end() && start + size == next->first) {
+        size += next->second;
+        EraseFree(next);
+    }
+
+    // A range that ends at the top of the used part is handed back to the rest of the region
+    if (start + size == m_region + m_used) {
+        m_used = static_cast<std::size_t>(start - m_region);
+        return;
+    }
+    InsertFree(start, size);
+}
+
+void ArenaAllocator::InsertFree (uint8_t* data, std::size_t bytes) {
+    m_freeByAddress.emplace(data, bytes);
+    m_freeBySize.emplace(bytes, data);
+}
+
+void ArenaAllocator::EraseFree (std::map<uint8_t*, std::size_t>::iterator it) {
+    auto range = m_freeBySize.equal_range(it->second);
+    for (auto sized = range.first; sized != range.second; ++sized) {
+        if (sized->second == it->first) {
+            m_freeBySize.erase(sized);
+            break;
+        }
+    }
+    m_freeByAddress.erase(it);
+}
+
+}
\ No newline at end of file
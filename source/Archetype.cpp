@@ -0,0 +1,394 @@
+#include "Archetype.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <new>
+
+namespace ecs {
+
+namespace {
+
+const uint32_t c_pageBytes = 4096;
+
+uint32_t AlignUp (uint32_t offset, uint32_t alignment) {
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+}
+
+Archetype::Archetype (const ComponentBitset& bitset, bool active, const std::vector<ComponentType>& types, Allocator& allocator) :
+    m_allocator{allocator},
+    m_bitset{bitset},
+    m_active{active},
+    m_types{types} {
+    m_columnOffsets.fill(c_invalidIndex);
+
+    uint32_t rowBytes = sizeof(EntityId);
+    for (const ComponentType& type : m_types) {
+        m_typeIndices[type.Id()] = static_cast<uint32_t>(&type - m_types.data());
+        m_columnBytes[type.Id()] = type.Bytes();
+        m_chunkAlignment = std::max(m_chunkAlignment, type.Alignment());
+        m_triviallyDestructible = m_triviallyDestructible && type.IsTriviallyDestructible();
+        rowBytes += type.Bytes() + static_cast<uint32_t>(sizeof(ComponentTicks));
+        if (type.IsSoa()) {
+            m_soaBitset.set(type.Id());
+            m_firstField[type.Id()] = static_cast<uint32_t>(m_fieldOffsets.size());
+            m_fieldOffsets.resize(m_fieldOffsets.size() + type.FieldCount());
+            m_chunkAlignment = std::max(m_chunkAlignment, static_cast<uint32_t>(ENCOSYS_SOA_COLUMN_ALIGNMENT_));
+        }
+    }
+
+    // Fit as many rows as possible into a chunk once column padding is accounted for
+    const uint32_t chunkBytes = m_soaBitset.any() ? ENCOSYS_SOA_CHUNK_BYTES_ : ENCOSYS_ARCHETYPE_CHUNK_BYTES_;
+    m_chunkCapacity = std::max(chunkBytes / rowBytes, 1u);
+    while (m_chunkCapacity > 1 && ComputeLayout(m_chunkCapacity) > chunkBytes) {
+        --m_chunkCapacity;
+    }
+    m_chunkBytes = std::max(ComputeLayout(m_chunkCapacity), chunkBytes);
+}
+
+Archetype::~Archetype () {
+    Clear();
+    while (!m_chunks.empty()) {
+        ReleaseChunk();
+    }
+}
+
+uint32_t Archetype::GetChunkSize (uint32_t chunk) const {
+    assert(chunk < GetChunkCount());
+    const uint32_t first = chunk * m_chunkCapacity;
+    return m_size > first ? std::min(m_size - first, m_chunkCapacity) : 0;
+}
+
+uint8_t* Archetype::GetColumn (ComponentTypeId typeId, uint32_t chunk) {
+    assert(m_bitset.test(typeId) && !m_soaBitset.test(typeId));
+    return m_chunks[chunk] + m_columnOffsets[typeId];
+}
+
+const uint8_t* Archetype::GetColumn (ComponentTypeId typeId, uint32_t chunk) const {
+    assert(m_bitset.test(typeId) && !m_soaBitset.test(typeId));
+    return m_chunks[chunk] + m_columnOffsets[typeId];
+}
+
+uint8_t* Archetype::GetComponentData (ComponentTypeId typeId, uint32_t row) {
+    assert(row < m_size);
+    return GetColumn(typeId, row / m_chunkCapacity) + (row % m_chunkCapacity) * m_columnBytes[typeId];
+}
+
+const uint8_t* Archetype::GetComponentData (ComponentTypeId typeId, uint32_t row) const {
+    assert(row < m_size);
+    return GetColumn(typeId, row / m_chunkCapacity) + (row % m_chunkCapacity) * m_columnBytes[typeId];
+}
+
+uint8_t* Archetype::GetFieldColumn (ComponentTypeId typeId, uint32_t field, uint32_t chunk) {
+    assert(m_soaBitset.test(typeId));
+    return m_chunks[chunk] + m_fieldOffsets[m_firstField[typeId] + field];
+}
+
+const uint8_t* Archetype::GetFieldColumn (ComponentTypeId typeId, uint32_t field, uint32_t chunk) const {
+    assert(m_soaBitset.test(typeId));
+    return m_chunks[chunk] + m_fieldOffsets[m_firstField[typeId] + field];
+}
+
+ComponentTicks* Archetype::GetTicksColumn (ComponentTypeId typeId, uint32_t chunk) {
+    assert(m_bitset.test(typeId));
+    return reinterpret_cast<ComponentTicks*>(m_chunks[chunk] + m_tickOffsets[typeId]);
+}
+
+const ComponentTicks* Archetype::GetTicksColumn (ComponentTypeId typeId, uint32_t chunk) const {
+    assert(m_bitset.test(typeId));
+    return reinterpret_cast<const ComponentTicks*>(m_chunks[chunk] + m_tickOffsets[typeId]);
+}
+
+const ComponentTicks& Archetype::GetTicks (ComponentTypeId typeId, uint32_t row) const {
+    assert(row < m_size);
+    return GetTicksColumn(typeId, row / m_chunkCapacity)[row % m_chunkCapacity];
+}
+
+ComponentTicks Archetype::GetChunkTicks (ComponentTypeId typeId, uint32_t chunk) const {
+    assert(m_bitset.test(typeId));
+    return reinterpret_cast<const AtomicComponentTicks*>(m_chunks[chunk] + m_chunkTicksOffset)[m_typeIndices[typeId]].Load();
+}
+
+void Archetype::IncludeChunkTicks (ComponentTypeId typeId, uint32_t chunk, const ComponentTicks& ticks) {
+    assert(m_bitset.test(typeId));
+    reinterpret_cast<AtomicComponentTicks*>(m_chunks[chunk] + m_chunkTicksOffset)[m_typeIndices[typeId]].Include(ticks);
+}
+
+void Archetype::MarkAdded (ComponentTypeId typeId, uint32_t row, ChangeTick tick) {
+    assert(row < m_size);
+    const ComponentTicks ticks{tick, tick};
+    m_dirtyChunks.Mark(row / m_chunkCapacity);
+    GetTicksColumn(typeId, row / m_chunkCapacity)[row % m_chunkCapacity] = ticks;
+    IncludeChunkTicks(typeId, row / m_chunkCapacity, ticks);
+}
+
+void Archetype::MarkChanged (ComponentTypeId typeId, uint32_t row, ChangeTick tick) {
+    assert(row < m_size);
+    m_dirtyChunks.Mark(row / m_chunkCapacity);
+    GetTicksColumn(typeId, row / m_chunkCapacity)[row % m_chunkCapacity].m_changed = tick;
+    IncludeChunkTicks(typeId, row / m_chunkCapacity, ComponentTicks{0, tick});
+}
+
+void Archetype::MarkChunkChanged (ComponentTypeId typeId, uint32_t chunk, ChangeTick tick) {
+    m_dirtyChunks.Mark(chunk);
+    ComponentTicks* ticks = GetTicksColumn(typeId, chunk);
+    const uint32_t size = GetChunkSize(chunk);
+    for (uint32_t i = 0; i < size; ++i) {
+        ticks[i].m_changed = tick;
+    }
+    IncludeChunkTicks(typeId, chunk, ComponentTicks{0, tick});
+}
+
+void Archetype::LoadComponent (const ComponentType& type, uint32_t row, uint8_t* dst) const {
+    assert(row < m_size);
+    for (uint32_t f = 0; f < type.FieldCount(); ++f) {
+        const SoaField& field = type.GetField(f);
+        memcpy(dst + field.m_offset, GetFieldColumn(type.Id(), f, row / m_chunkCapacity) + (row % m_chunkCapacity) * field.m_bytes, field.m_bytes);
+    }
+}
+
+void Archetype::StoreComponent (const ComponentType& type, uint32_t row, const uint8_t* src) {
+    assert(row < m_size);
+    m_dirtyChunks.Mark(row / m_chunkCapacity);
+    for (uint32_t f = 0; f < type.FieldCount(); ++f) {
+        const SoaField& field = type.GetField(f);
+        memcpy(GetFieldColumn(type.Id(), f, row / m_chunkCapacity) + (row % m_chunkCapacity) * field.m_bytes, src + field.m_offset, field.m_bytes);
+    }
+}
+
+void Archetype::CopyComponent (const ComponentType& type, uint32_t row, const Archetype& source, uint32_t sourceRow) {
+    CopyTicks(type.Id(), row, source, sourceRow);
+    if (type.IsSoa()) {
+        CopyFields(type, row, source, sourceRow);
+    }
+    else {
+        type.CopyConstruct(GetComponentData(type.Id(), row), source.GetComponentData(type.Id(), sourceRow));
+    }
+}
+
+void Archetype::RelocateComponent (const ComponentType& type, uint32_t row, Archetype& source, uint32_t sourceRow) {
+    CopyTicks(type.Id(), row, source, sourceRow);
+    if (type.IsSoa()) {
+        CopyFields(type, row, source, sourceRow);
+    }
+    else {
+        type.Relocate(GetComponentData(type.Id(), row), source.GetComponentData(type.Id(), sourceRow));
+    }
+}
+
+void Archetype::Reserve (uint32_t rows) {
+    while (GetChunkCount() * m_chunkCapacity < rows) {
+        AllocateChunk();
+    }
+}
+
+uint32_t Archetype::AddRow (EntityId id) {
+    const uint32_t row = m_size;
+    if (row == GetChunkCount() * m_chunkCapacity) {
+        AllocateChunk();
+    }
+    ++m_size;
+    m_dirtyChunks.Mark(row / m_chunkCapacity);
+    GetEntityIds(row / m_chunkCapacity)[row % m_chunkCapacity] = id;
+    return row;
+}
+
+void Archetype::FillColumn (const ComponentType& type, uint32_t firstRow, uint32_t count, const uint8_t* source) {
+    if (count > 0) {
+        m_dirtyChunks.MarkRange(firstRow / m_chunkCapacity, (firstRow + count - 1) / m_chunkCapacity + 1);
+    }
+    for (uint32_t row = firstRow; row < firstRow + count;) {
+        const uint32_t span = std::min(m_chunkCapacity - row % m_chunkCapacity, firstRow + count - row);
+        if (type.IsSoa()) {
+            for (uint32_t f = 0; f < type.FieldCount(); ++f) {
+                const SoaField& field = type.GetField(f);
+                uint8_t* dst = GetFieldColumn(type.Id(), f, row / m_chunkCapacity) + (row % m_chunkCapacity) * field.m_bytes;
+                FillCopies(dst, source + field.m_offset, field.m_bytes, field.m_bytes, span);
+            }
+        }
+        else {
+            type.Ops().CopyConstructN(GetComponentData(type.Id(), row), source, span);
+        }
+        row += span;
+    }
+}
+
+void Archetype::DestroyComponents (uint32_t row) {
+    if (m_triviallyDestructible) {
+        return;
+    }
+    m_dirtyChunks.Mark(row / m_chunkCapacity);
+    for (const ComponentType& type : m_types) {
+        if (!type.IsTriviallyDestructible()) {
+            type.Destroy(GetComponentData(type.Id(), row));
+        }
+    }
+}
+
+void Archetype::Clear () {
+    if (!m_triviallyDestructible) {
+        for (uint32_t row = 0; row < m_size; ++row) {
+            DestroyComponents(row);
+        }
+    }
+    m_size = 0;
+    while (GetChunkCount() > 1) {
+        ReleaseChunk();
+    }
+}
+
+void Archetype::Save (SnapshotWriter& writer) const {
+    writer.Write(m_chunkBytes);
+    writer.Write(m_chunkCapacity);
+    writer.Write(m_size);
+    for (uint32_t chunk = 0; chunk * m_chunkCapacity < m_size; ++chunk) {
+        writer.Write(m_chunks[chunk], m_chunkBytes);
+    }
+}
+
+bool Archetype::Load (SnapshotReader& reader) {
+    Clear();
+    uint32_t chunkBytes = 0;
+    uint32_t chunkCapacity = 0;
+    uint32_t size = 0;
+    if (!reader.Read(chunkBytes) || !reader.Read(chunkCapacity) || !reader.Read(size)) {
+        return false;
+    }
+    if (chunkBytes != m_chunkBytes || chunkCapacity != m_chunkCapacity || size / m_chunkCapacity > reader.GetRemainingBytes() / m_chunkBytes) {
+        return reader.Fail();
+    }
+    Reserve(size);
+    for (uint32_t chunk = 0; chunk * m_chunkCapacity < size; ++chunk) {
+        if (!reader.Read(m_chunks[chunk], m_chunkBytes)) {
+            return false;
+        }
+    }
+    m_size = size;
+    return true;
+}
+
+void Archetype::SaveBlock (uint32_t chunk, std::vector<uint8_t>& bytes) const {
+    bytes.resize(m_chunkBytes);
+    memcpy(bytes.data(), m_chunks[chunk], m_chunkBytes);
+}
+
+void Archetype::LoadBlock (uint32_t chunk, const std::vector<uint8_t>& bytes) {
+    assert(chunk < GetChunkCount() && bytes.size() == m_chunkBytes);
+    memcpy(m_chunks[chunk], bytes.data(), m_chunkBytes);
+}
+
+void Archetype::RestoreSize (uint32_t size) {
+    assert(m_triviallyDestructible);
+    Reserve(size);
+    m_size = size;
+}
+
+void Archetype::SwapRows (uint32_t a, uint32_t b) {
+    assert(a < m_size && b < m_size);
+    if (a == b) {
+        return;
+    }
+    // The row past the end holds the components of a while b moves into its place
+    const EntityId idA = GetEntityId(a);
+    const uint32_t spare = AddRow(idA);
+    for (const ComponentType& type : m_types) {
+        RelocateComponent(type, spare, *this, a);
+        RelocateComponent(type, a, *this, b);
+        RelocateComponent(type, b, *this, spare);
+    }
+    GetEntityIds(a / m_chunkCapacity)[a % m_chunkCapacity] = GetEntityId(b);
+    GetEntityIds(b / m_chunkCapacity)[b % m_chunkCapacity] = idA;
+    --m_size;
+}
+
+EntityId Archetype::RemoveRow (uint32_t row) {
+    assert(row < m_size);
+    const uint32_t last = m_size - 1;
+    EntityId movedId = c_invalidEntityId;
+    if (row != last) {
+        for (const ComponentType& type : m_types) {
+            RelocateComponent(type, row, *this, last);
+        }
+        movedId = GetEntityId(last);
+        GetEntityIds(row / m_chunkCapacity)[row % m_chunkCapacity] = movedId;
+    }
+    --m_size;
+
+    // Keep at most one empty chunk around so a row toggling across a chunk boundary does not thrash the allocator
+    const uint32_t usedChunks = (m_size + m_chunkCapacity - 1) / m_chunkCapacity;
+    while (GetChunkCount() > usedChunks + 1) {
+        ReleaseChunk();
+    }
+    return movedId;
+}
+
+uint32_t Archetype::ComputeLayout (uint32_t capacity) {
+    uint32_t offset = capacity * static_cast<uint32_t>(sizeof(EntityId));
+    std::vector<uint32_t> pageOffsets;
+    for (const ComponentType& type : m_types) {
+        if (type.IsSoa()) {
+            for (uint32_t f = 0; f < type.FieldCount(); ++f) {
+                const SoaField& field = type.GetField(f);
+                const uint32_t alignment = std::max(field.m_alignment, static_cast<uint32_t>(ENCOSYS_SOA_COLUMN_ALIGNMENT_));
+                offset = AlignUp(offset, alignment);
+                // Columns starting at the same offset within a page make loads wait on unrelated stores (4K aliasing)
+                while (std::any_of(pageOffsets.begin(), pageOffsets.end(), [offset] (uint32_t pageOffset) { return pageOffset == offset % c_pageBytes; })) {
+                    offset += alignment;
+                }
+                pageOffsets.push_back(offset % c_pageBytes);
+                m_fieldOffsets[m_firstField[type.Id()] + f] = offset;
+                offset += capacity * field.m_bytes;
+            }
+            continue;
+        }
+        offset = AlignUp(offset, type.Alignment());
+        m_columnOffsets[type.Id()] = offset;
+        offset += capacity * type.Bytes();
+    }
+
+    // The tick columns come after the components, so they do not dilute the component columns in the cache
+    for (const ComponentType& type : m_types) {
+        offset = AlignUp(offset, alignof(ComponentTicks));
+        m_tickOffsets[type.Id()] = offset;
+        offset += capacity * static_cast<uint32_t>(sizeof(ComponentTicks));
+    }
+    m_chunkTicksOffset = offset;
+    offset += static_cast<uint32_t>(m_types.size() * sizeof(AtomicComponentTicks));
+    return offset;
+}
+
+void Archetype::AllocateChunk () {
+    m_chunks.push_back(static_cast<uint8_t*>(m_allocator.Allocate(m_chunkBytes, m_chunkAlignment)));
+    AtomicComponentTicks* chunkTicks = reinterpret_cast<AtomicComponentTicks*>(m_chunks.back() + m_chunkTicksOffset);
+    for (std::size_t i = 0; i < m_types.size(); ++i) {
+        new (chunkTicks + i) AtomicComponentTicks();
+    }
+    // Parallel iteration marks chunks concurrently, which is only safe once the flags cover every chunk
+    m_dirtyChunks.Reserve(GetChunkCount());
+    m_dirtyChunks.Mark(GetChunkCount() - 1);
+}
+
+void Archetype::ReleaseChunk () {
+    m_allocator.Deallocate(m_chunks.back(), m_chunkBytes, m_chunkAlignment);
+    m_chunks.pop_back();
+}
+
+void Archetype::CopyTicks (ComponentTypeId typeId, uint32_t row, const Archetype& source, uint32_t sourceRow) {
+    const ComponentTicks& ticks = source.GetTicks(typeId, sourceRow);
+    m_dirtyChunks.Mark(row / m_chunkCapacity);
+    GetTicksColumn(typeId, row / m_chunkCapacity)[row % m_chunkCapacity] = ticks;
+    IncludeChunkTicks(typeId, row / m_chunkCapacity, ticks);
+}
+
+void Archetype::CopyFields (const ComponentType& type, uint32_t row, const Archetype& source, uint32_t sourceRow) {
+    assert(row < m_size && sourceRow < source.m_size);
+    for (uint32_t f = 0; f < type.FieldCount(); ++f) {
+        const uint32_t bytes = type.GetField(f).m_bytes;
+        const uint8_t* src = source.GetFieldColumn(type.Id(), f, sourceRow / source.m_chunkCapacity) + (sourceRow % source.m_chunkCapacity) * bytes;
+        memcpy(GetFieldColumn(type.Id(), f, row / m_chunkCapacity) + (row % m_chunkCapacity) * bytes, src, bytes);
+    }
+}
+
+}
\ No newline at end of file
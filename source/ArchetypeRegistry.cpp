@@ -0,0 +1,87 @@
+#include "ArchetypeRegistry.h"
+
+#include "ComponentRegistry.h"
+
+namespace ecs {
+
+ArchetypeRegistry::~ArchetypeRegistry () {
+    for (Archetype* archetype : m_archetypes) {
+        delete archetype;
+    }
+}
+
+void ArchetypeRegistry::Clear () {
+    for (Archetype* archetype : m_archetypes) {
+        archetype->Clear();
+    }
+}
+
+void ArchetypeRegistry::Truncate (uint32_t count) {
+    while (Count() > count) {
+        Archetype* archetype = m_archetypes.back();
+        (archetype->IsActive() ? m_activeLookup : m_inactiveLookup).erase(archetype->GetBitset());
+        delete archetype;
+        m_archetypes.pop_back();
+    }
+}
+
+void ArchetypeRegistry::Save (SnapshotWriter& writer) const {
+    writer.Write(Count());
+    for (const Archetype* archetype : m_archetypes) {
+        writer.Write(archetype->GetBitset());
+        writer.Write(static_cast<uint8_t>(archetype->IsActive()));
+        archetype->Save(writer);
+    }
+}
+
+bool ArchetypeRegistry::Load (SnapshotReader& reader, const ComponentRegistry& componentRegistry) {
+    for (Archetype* archetype : m_archetypes) {
+        delete archetype;
+    }
+    m_archetypes.clear();
+    m_activeLookup.clear();
+    m_inactiveLookup.clear();
+
+    uint32_t count = 0;
+    if (!reader.Read(count)) {
+        return false;
+    }
+    for (uint32_t id = 0; id < count; ++id) {
+        ComponentBitset bitset;
+        uint8_t active = 0;
+        if (!reader.Read(bitset) || !reader.Read(active)) {
+            return false;
+        }
+        // Every archetype is new, so a known bitset means the data is corrupt
+        const auto& lookup = active != 0 ? m_activeLookup : m_inactiveLookup;
+        if ((bitset & ~componentRegistry.GetArchetypeBitset()).any() || lookup.count(bitset) != 0) {
+            return reader.Fail();
+        }
+        if (!m_archetypes[FindOrCreate(bitset, active != 0, componentRegistry)]->Load(reader)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint32_t ArchetypeRegistry::FindOrCreate (const ComponentBitset& bitset, bool active, const ComponentRegistry& componentRegistry) {
+    auto& lookup = active ? m_activeLookup : m_inactiveLookup;
+    auto it = lookup.find(bitset);
+    if (it != lookup.end()) {
+        return it->second;
+    }
+
+    std::vector<ComponentType> types;
+    for (uint32_t i = 0; i < componentRegistry.Count(); ++i) {
+        if (bitset.test(i)) {
+            types.push_back(componentRegistry[i]);
+        }
+    }
+
+    const uint32_t id = Count();
+    m_archetypes.push_back(new Archetype(bitset, active, types, componentRegistry.GetAllocator()));
+    lookup[bitset] = id;
+    return id;
+}
+
+}
\ No newline at end of file
@@ -1,47 +1,162 @@
 #include "BlockMemoryPool.h"
 
-#include <cassert>
+#include "MemoryUtil.h"
+#include <algorithm>
+#include <cstring>
 
 namespace ecs {
 
+BlockMemoryPool::BlockMemoryPool (uint32_t elementSize, uint32_t blockSize, uint32_t alignment, Allocator& allocator) :
+    m_allocator{&allocator},
+    m_elementSize{elementSize},
+    m_alignment{std::max(alignment, 1u)} {
+    assert(blockSize > 0 && (blockSize & (blockSize - 1)) == 0);
+    assert((m_alignment & (m_alignment - 1)) == 0);
+    m_stride = (elementSize + m_alignment - 1) / m_alignment * m_alignment;
+    m_blockMask = blockSize - 1;
+    while ((1u << m_blockShift) < blockSize) {
+        ++m_blockShift;
+    }
+    m_dirtyBlocks.SetBlockShift(m_blockShift);
+}
+
 BlockMemoryPool::~BlockMemoryPool () {
     for (uint8_t* block : m_blocks) {
-        delete[] block;
+        m_allocator->Deallocate(block, GetBlockBytes(), GetBlockAlignment());
     }
 }
 
 void BlockMemoryPool::Resize (uint32_t size) {
     Reserve(size);
+    // Growing hands out elements that may hold the data of destroyed ones
+    m_dirtyBlocks.MarkRange(m_size, size);
     m_size = size;
+    m_elements.resize(size);
 }
 
 void BlockMemoryPool::Reserve (uint32_t capacity) {
     while (m_capacity < capacity) {
-        m_blocks.push_back(new uint8_t[m_elementSize * m_blockSize]);
-        m_capacity += m_blockSize;
+        m_blocks.push_back(static_cast<uint8_t*>(m_allocator->Allocate(GetBlockBytes(), GetBlockAlignment())));
+        m_blockTicks.emplace_back();
+        m_capacity += GetBlockSize();
     }
+    // Parallel iteration marks blocks concurrently, which is only safe once the flags cover every block
+    m_dirtyBlocks.Reserve(static_cast<uint32_t>(m_blocks.size()));
 }
 
-uint8_t* BlockMemoryPool::GetData (uint32_t index) {
-    assert(index < m_size);
-    return m_blocks[index / m_blockSize] + (index % m_blockSize) * m_elementSize;
-}
-
-const uint8_t* BlockMemoryPool::GetData (uint32_t index) const {
-    assert(index < m_size);
-    return m_blocks[index / m_blockSize] + (index % m_blockSize) * m_elementSize;
+void BlockMemoryPool::ReleaseUnusedBlocks () {
+    const std::size_t usedBlocks = (static_cast<std::size_t>(m_size) + m_blockMask) >> m_blockShift;
+    while (m_blocks.size() > usedBlocks) {
+        m_allocator->Deallocate(m_blocks.back(), GetBlockBytes(), GetBlockAlignment());
+        m_blocks.pop_back();
+        m_blockTicks.pop_back();
+        m_capacity -= GetBlockSize();
+    }
+    m_elements.shrink_to_fit();
 }
 
 uint32_t BlockMemoryPool::CreateFromCopy (uint32_t index) {
     assert(index < m_size);
-    uint32_t newIndex = m_size;
+    const uint32_t newIndex = m_size;
+    Resize(m_size + 1);
     memcpy(GetData(newIndex), GetData(index), m_elementSize);
     return newIndex;
 }
 
+uint32_t BlockMemoryPool::CreateCopies (const uint8_t* source, uint32_t count) {
+    const uint32_t first = m_size;
+    Resize(m_size + count);
+
+    // Fill block by block since consecutive indices are only contiguous within a block
+    for (uint32_t index = first; index < first + count;) {
+        const uint32_t span = std::min(GetBlockSize() - (index & m_blockMask), first + count - index);
+        FillCopies(GetData(index), source, m_elementSize, m_stride, span);
+        index += span;
+    }
+    return first;
+}
+
 void BlockMemoryPool::Destroy (uint32_t index) {
     assert(index < m_size);
     memset(GetData(index), 0, m_elementSize);
+    m_elements[index].m_entityId = c_invalidEntityId;
+}
+
+void BlockMemoryPool::Clear () {
+    m_size = 0;
+    m_elements.clear();
+}
+
+void BlockMemoryPool::Swap (uint32_t a, uint32_t b) {
+    std::swap_ranges(GetData(a), GetData(a) + m_elementSize, GetData(b));
+    SwapElements(a, b);
+}
+
+bool BlockMemoryPool::FillHoles (uint32_t /*maxMoves*/, std::vector<uint32_t>& /*filled*/) {
+    return true;
+}
+
+void BlockMemoryPool::Save (SnapshotWriter& writer) const {
+    writer.WriteVector(m_elements);
+    for (uint32_t index = 0; index < m_size; index += GetBlockSize()) {
+        writer.Write(m_blocks[index >> m_blockShift], static_cast<std::size_t>(std::min(GetBlockSize(), m_size - index)) * m_stride);
+    }
+}
+
+bool BlockMemoryPool::Load (SnapshotReader& reader) {
+    Clear();
+    if (!reader.ReadVector(m_elements)) {
+        return false;
+    }
+    const uint32_t size = static_cast<uint32_t>(m_elements.size());
+    Reserve(size);
+    m_size = size;
+    // One copy per block straight out of the file mapping
+    for (uint32_t index = 0; index < m_size; index += GetBlockSize()) {
+        if (!reader.Read(m_blocks[index >> m_blockShift], static_cast<std::size_t>(std::min(GetBlockSize(), m_size - index)) * m_stride)) {
+            m_size = 0;
+            m_elements.clear();
+            return false;
+        }
+    }
+    for (uint32_t index = 0; index < m_size; ++index) {
+        m_blockTicks[index >> m_blockShift].Include(m_elements[index].m_ticks);
+    }
+    return true;
+}
+
+void BlockMemoryPool::SaveBlock (uint32_t block, std::vector<uint8_t>& bytes) const {
+    const uint32_t first = block << m_blockShift;
+    const uint32_t count = std::min(GetBlockSize(), m_size - first);
+    const std::size_t dataBytes = static_cast<std::size_t>(count) * m_stride;
+    bytes.resize(dataBytes + count * sizeof(Element));
+    memcpy(bytes.data(), m_blocks[block], dataBytes);
+    memcpy(bytes.data() + dataBytes, m_elements.data() + first, count * sizeof(Element));
+}
+
+void BlockMemoryPool::LoadBlock (uint32_t block, const std::vector<uint8_t>& bytes) {
+    // The copy may have been taken when the block held more elements than the pool does now
+    const uint32_t first = block << m_blockShift;
+    const uint32_t count = std::min(static_cast<uint32_t>(bytes.size() / (m_stride + sizeof(Element))), m_size - first);
+    const std::size_t dataBytes = bytes.size() / (m_stride + sizeof(Element)) * m_stride;
+    memcpy(m_blocks[block], bytes.data(), static_cast<std::size_t>(count) * m_stride);
+    memcpy(m_elements.data() + first, bytes.data() + dataBytes, count * sizeof(Element));
+    for (uint32_t index = first; index < first + count; ++index) {
+        m_blockTicks[block].Include(m_elements[index].m_ticks);
+    }
+}
+
+void BlockMemoryPool::SaveState (SnapshotWriter& writer) const {
+    writer.Write(m_size);
+}
+
+bool BlockMemoryPool::LoadState (SnapshotReader& reader) {
+    uint32_t size = 0;
+    if (!reader.Read(size)) {
+        return false;
+    }
+    Resize(size);
+    return true;
 }
 
 }
\ No newline at end of file
@@ -0,0 +1,75 @@
+#include "CommandBuffer.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace ecs {
+
+namespace {
+
+const uint32_t c_commandBlockBytes = 16384;
+const uint32_t c_commandBlockAlignment = 64;
+
+}
+
+CommandBuffer::~CommandBuffer () {
+    Clear();
+    for (uint8_t* block : m_blocks) {
+        ::operator delete(block, std::align_val_t{c_commandBlockAlignment});
+    }
+}
+
+EntityId CommandBuffer::Create (bool active) {
+    m_pendingActive.push_back(active);
+    return EntityId(static_cast<uint32_t>(m_pendingActive.size() - 1), c_pendingGeneration);
+}
+
+void CommandBuffer::Destroy (EntityId e) {
+    m_commands.push_back({CommandType::Destroy, false, c_invalidIndex, e, nullptr, nullptr});
+}
+
+void CommandBuffer::SetActive (EntityId e, bool active) {
+    m_commands.push_back({CommandType::SetActive, active, c_invalidIndex, e, nullptr, nullptr});
+}
+
+void CommandBuffer::Clear () {
+    // Destroy the payloads of additions that were never played back
+    for (Command& command : m_commands) {
+        if (command.m_data) {
+            m_encosys.GetComponentType(command.m_typeId).Destroy(command.m_data);
+        }
+    }
+    m_commands.clear();
+    m_pendingActive.clear();
+    m_createdIds.clear();
+
+    // Keep the first block around for the next frame
+    while (m_blocks.size() > 1) {
+        ::operator delete(m_blocks.back(), std::align_val_t{c_commandBlockAlignment});
+        m_blocks.pop_back();
+    }
+    m_blockUsed = 0;
+}
+
+uint8_t* CommandBuffer::AllocatePayload (uint32_t bytes, uint32_t alignment) {
+    // Payloads never move once constructed, so they are bump allocated from fixed blocks and
+    // oversized payloads get a block of their own
+    assert(alignment <= c_commandBlockAlignment);
+    uint32_t offset = (m_blockUsed + alignment - 1) / alignment * alignment;
+    if (m_blocks.empty() || offset + bytes > c_commandBlockBytes) {
+        const uint32_t blockBytes = std::max(bytes, c_commandBlockBytes);
+        m_blocks.push_back(static_cast<uint8_t*>(::operator new(blockBytes, std::align_val_t{c_commandBlockAlignment})));
+        offset = 0;
+    }
+    m_blockUsed = offset + bytes;
+    return m_blocks.back() + offset;
+}
+
+EntityId CommandBuffer::Resolve (EntityId e) const {
+    if (e.Generation() == c_pendingGeneration) {
+        return e.Index() < m_createdIds.size() ? m_createdIds[e.Index()] : c_invalidEntityId;
+    }
+    return e;
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,77 @@
+#include "ComponentIndexTable.h"
+
+namespace ecs {
+
+ComponentIndexTable::ComponentIndexTable (Allocator& allocator) {
+    // Enough classes for a run that holds an index for every component type
+    for (uint32_t capacity = 1; capacity < 2 * ENCOSYS_MAX_COMPONENTS_; capacity *= 2) {
+        m_sizeClasses.emplace_back(allocator);
+    }
+}
+
+uint32_t ComponentIndexTable::Allocate (uint32_t count, uint8_t& sizeClass) {
+    sizeClass = 0;
+    while (Capacity(sizeClass) < count) {
+        ++sizeClass;
+    }
+    ENCOSYS_ASSERT_(sizeClass < m_sizeClasses.size());
+
+    SizeClass& runs = m_sizeClasses[sizeClass];
+    if (!runs.m_free.empty()) {
+        const uint32_t offset = runs.m_free.back();
+        runs.m_free.pop_back();
+        return offset;
+    }
+    const uint32_t offset = static_cast<uint32_t>(runs.m_indices.size());
+    runs.m_indices.resize(offset + Capacity(sizeClass), c_invalidIndex);
+    runs.m_dirtyBlocks.Mark(offset);
+    return offset;
+}
+
+void ComponentIndexTable::Free (uint32_t offset, uint8_t sizeClass) {
+    m_sizeClasses[sizeClass].m_free.push_back(offset);
+}
+
+void ComponentIndexTable::Clear () {
+    for (SizeClass& runs : m_sizeClasses) {
+        runs.m_indices.clear();
+        runs.m_free.clear();
+    }
+}
+
+void ComponentIndexTable::Save (SnapshotWriter& writer) const {
+    for (const SizeClass& runs : m_sizeClasses) {
+        writer.WriteVector(runs.m_indices);
+        writer.WriteVector(runs.m_free);
+    }
+}
+
+bool ComponentIndexTable::Load (SnapshotReader& reader) {
+    for (SizeClass& runs : m_sizeClasses) {
+        if (!reader.ReadVector(runs.m_indices) || !reader.ReadVector(runs.m_free)) {
+            Clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+void ComponentIndexTable::SaveState (SnapshotWriter& writer) const {
+    for (const SizeClass& runs : m_sizeClasses) {
+        writer.Write(static_cast<uint32_t>(runs.m_indices.size()));
+        writer.WriteVector(runs.m_free);
+    }
+}
+
+bool ComponentIndexTable::LoadState (SnapshotReader& reader) {
+    for (SizeClass& runs : m_sizeClasses) {
+        uint32_t size = 0;
+        if (!reader.Read(size) || !reader.ReadVector(runs.m_free)) {
+            return false;
+        }
+        runs.m_indices.resize(size, c_invalidIndex);
+    }
+    return true;
+}
+
+}
\ No newline at end of file
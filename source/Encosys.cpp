@@ -1,28 +1,284 @@
 #include "Encosys.h"
 
 #include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <unordered_set>
+#include "CommandBuffer.h"
 #include "ComponentRegistry.h"
 #include "System.h"
 
 namespace ecs {
 
+namespace {
+
+// Everything that decides the layout of the saved data, a snapshot only loads when all of it matches
+struct SnapshotHeader {
+    uint32_t m_magic;
+    uint32_t m_version;
+    uint32_t m_maxComponents;
+    uint32_t m_entityBytes;
+    uint32_t m_poolBlockSize;
+    uint32_t m_componentCount;
+    uint32_t m_singletonCount;
+};
+
+struct SnapshotType {
+    uint32_t m_bytes;
+    uint32_t m_alignment;
+    uint32_t m_storage;
+
+    friend bool operator== (const SnapshotType& lhs, const SnapshotType& rhs) { return lhs.m_bytes == rhs.m_bytes && lhs.m_alignment == rhs.m_alignment && lhs.m_storage == rhs.m_storage; }
+};
+
+// Singletons are told apart from components by a storage no component has
+const uint32_t c_singletonStorage = static_cast<uint32_t>(-1);
+
+std::vector<SnapshotType> DescribeSnapshotTypes (const ComponentRegistry& componentRegistry, const SingletonRegistry& singletonRegistry) {
+    std::vector<SnapshotType> types;
+    for (uint32_t i = 0; i < componentRegistry.Count(); ++i) {
+        types.push_back({componentRegistry[i].Bytes(), componentRegistry[i].Alignment(), static_cast<uint32_t>(componentRegistry[i].Storage())});
+    }
+    for (uint32_t i = 0; i < singletonRegistry.Count(); ++i) {
+        types.push_back({static_cast<uint32_t>(singletonRegistry.GetSingleton(i).GetBytes()), 0, c_singletonStorage});
+    }
+    return types;
+}
+
+// Delta snapshot blocks are keyed by the kind of storage they belong to and the id of the storage within its kind
+enum class SnapshotStorage : uint32_t { Slots, Entities, Indices, Pool, Archetype, Singleton };
+
+uint32_t SnapshotStorageKey (SnapshotStorage kind, uint32_t id) {
+    return static_cast<uint32_t>(kind) << 24 | id;
+}
+
+// Copies the blocks written since the previous snapshot, or every block for the first one
+template <typename TBlocks>
+void CaptureBlocks (SnapshotHistory::Snapshot& snapshot, uint32_t storage, TBlocks&& blocks, bool full) {
+    DirtyBlocks& dirtyBlocks = blocks.GetDirtyBlocks();
+    for (uint32_t block = 0; block < blocks.GetUsedBlockCount(); ++block) {
+        if (full || dirtyBlocks.IsDirty(block)) {
+            blocks.SaveBlock(block, snapshot.m_blocks[SnapshotHistory::BlockKey(storage, block)]);
+        }
+    }
+    dirtyBlocks.Clear();
+}
+
+struct RestoreContext {
+    const SnapshotHistory& m_history;
+    uint32_t m_snapshot;
+    const std::unordered_set<uint64_t>& m_newer;
+};
+
+// Copies back the newest copy taken at or before the snapshot of every block written since, the storage must already
+// have the size it had then. Blocks from firstStale on held elements the storage dropped while it was smaller.
+template <typename TBlocks>
+void RestoreBlocks (const RestoreContext& context, uint32_t storage, TBlocks&& blocks, uint32_t firstStale) {
+    DirtyBlocks& dirtyBlocks = blocks.GetDirtyBlocks();
+    for (uint32_t block = 0; block < blocks.GetUsedBlockCount(); ++block) {
+        const uint64_t key = SnapshotHistory::BlockKey(storage, block);
+        if (block >= firstStale || dirtyBlocks.IsDirty(block) || context.m_newer.count(key) != 0) {
+            const std::vector<uint8_t>* bytes = context.m_history.FindBlock(context.m_snapshot, key);
+            ENCOSYS_ASSERT_(bytes != nullptr);
+            if (bytes != nullptr) {
+                blocks.LoadBlock(block, *bytes);
+            }
+        }
+    }
+    dirtyBlocks.Clear();
+}
+
+}
+
+Encosys::Encosys (uint32_t workerCount) : Encosys(workerCount, HeapAllocator::Instance()) {}
+
+Encosys::Encosys (uint32_t workerCount, Allocator& allocator) :
+    m_componentRegistry{allocator},
+    m_threadPool{workerCount},
+    m_slots{StlAllocator<EntitySlot>(allocator)},
+    m_freeSlots{StlAllocator<uint32_t>(allocator)},
+    m_entities{StlAllocator<EntityStorage>(allocator)},
+    m_componentIndices{allocator} {
+    // One command buffer for threads outside the pool plus one per worker
+    for (uint32_t i = 0; i <= workerCount; ++i) {
+        m_commandBuffers.push_back(new CommandBuffer(*this));
+        m_frameAllocators.push_back(new FrameAllocator());
+    }
+}
+
+Encosys::~Encosys () {
+    for (CommandBuffer* commandBuffer : m_commandBuffers) {
+        delete commandBuffer;
+    }
+    for (FrameAllocator* frameAllocator : m_frameAllocators) {
+        delete frameAllocator;
+    }
+}
+
 void Encosys::Initialize () {
     for (uint32_t i = 0; i < m_systemRegistry.Count(); ++i) {
-        m_systemRegistry.GetSystem(i)->Initialize(m_systemRegistry.GetSystemType(i));
+        SystemType& type = m_systemRegistry.GetSystemType(i);
+        m_systemRegistry.GetSystem(i)->Initialize(type);
+        type.SetQuery(&FindOrCreateQuery(type.GetRequiredBitset(), true));
     }
+    m_systemScheduler.Build(m_systemRegistry);
 }
 
 void Encosys::Update (TimeDelta delta) {
+    // Nothing iterates the queries between updates, so this is where ForEach queries that fell out of use go
+    m_queryRegistry.Release(ENCOSYS_MAX_CACHED_QUERIES_);
+
+    // Every system run gets a tick of its own, so a system sees the writes made since its previous run,
+    // including those of the systems that run after it
     for (uint32_t i = 0; i < m_systemRegistry.Count(); ++i) {
-        m_systemRegistry.GetSystem(i)->Update(delta);
+        m_systemRegistry.GetSystemType(i).BeginRun(++m_changeTick);
+    }
+
+    if (m_threadPool.WorkerCount() > 0) {
+        m_systemScheduler.Run(m_threadPool, m_systemRegistry, delta);
+    }
+    else {
+        for (uint32_t i = 0; i < m_systemRegistry.Count(); ++i) {
+            m_systemRegistry.GetSystem(i)->Update(delta);
+        }
+    }
+
+    // Components added by the commands, and anything written until the next Update, are newer than every run so far
+    ++m_changeTick;
+    PlaybackCommands();
+    DispatchObservers();
+    m_filterTick = m_updateEndTick;
+    m_updateEndTick = m_changeTick++;
+
+    for (FrameAllocator* frameAllocator : m_frameAllocators) {
+        frameAllocator->Reset();
     }
 }
 
-Entity Encosys::Create (bool active) {
-    EntityId id(m_entityIdCounter);
-    ++m_entityIdCounter;
+CommandBuffer& Encosys::GetCommandBuffer () {
+    return *m_commandBuffers[m_threadPool.CurrentQueueIndex()];
+}
 
-    uint32_t& index = m_idToEntity[id];
+FrameAllocator& Encosys::GetFrameAllocator () {
+    return *m_frameAllocators[m_threadPool.CurrentQueueIndex()];
+}
+
+void Encosys::PlaybackCommands () {
+    // Create the pending entities first so every other command can resolve them
+    uint32_t createCount = 0;
+    for (CommandBuffer* commandBuffer : m_commandBuffers) {
+        createCount += static_cast<uint32_t>(commandBuffer->m_pendingActive.size());
+    }
+    m_entities.reserve(m_entities.size() + createCount);
+    for (CommandBuffer* commandBuffer : m_commandBuffers) {
+        for (const bool active : commandBuffer->m_pendingActive) {
+            commandBuffer->m_createdIds.push_back(Create(active).GetId());
+        }
+    }
+
+    // Order the remaining commands by phase and then by component type so each pool is visited in one run.
+    // Additions and removals share a phase, so the sort keeps them in the order they were recorded.
+    using BufferedCommand = std::pair<CommandBuffer*, CommandBuffer::Command*>;
+    std::vector<BufferedCommand> commands;
+    std::array<uint32_t, ENCOSYS_MAX_COMPONENTS_> addCounts{};
+    for (CommandBuffer* commandBuffer : m_commandBuffers) {
+        for (CommandBuffer::Command& command : commandBuffer->m_commands) {
+            commands.emplace_back(commandBuffer, &command);
+            if (command.m_type == CommandBuffer::CommandType::AddComponent) {
+                ++addCounts[command.m_typeId];
+            }
+        }
+    }
+    auto phase = [] (CommandBuffer::CommandType type) {
+        return type == CommandBuffer::CommandType::RemoveComponent ? CommandBuffer::CommandType::AddComponent : type;
+    };
+    std::stable_sort(commands.begin(), commands.end(), [&phase] (const BufferedCommand& lhs, const BufferedCommand& rhs) {
+        if (phase(lhs.second->m_type) != phase(rhs.second->m_type)) {
+            return phase(lhs.second->m_type) < phase(rhs.second->m_type);
+        }
+        return lhs.second->m_typeId < rhs.second->m_typeId;
+    });
+
+    // Grow each pool once up front rather than block by block
+    for (uint32_t i = 0; i < m_componentRegistry.Count(); ++i) {
+        if (addCounts[i] > 0 && m_componentRegistry[i].HasPool()) {
+            BlockMemoryPool& storage = m_componentRegistry.GetStorage(i);
+            storage.Reserve(storage.GetSize() + addCounts[i]);
+        }
+    }
+
+    for (const BufferedCommand& bufferedCommand : commands) {
+        CommandBuffer::Command& command = *bufferedCommand.second;
+        const EntityId e = bufferedCommand.first->Resolve(command.m_entity);
+        if (!IsValid(e)) {
+            continue;
+        }
+        switch (command.m_type) {
+        case CommandBuffer::CommandType::RemoveComponent:
+            command.m_play(*this, e, command.m_data);
+            break;
+        case CommandBuffer::CommandType::AddComponent:
+            // The payload is consumed by the play function
+            command.m_play(*this, e, command.m_data);
+            command.m_data = nullptr;
+            break;
+        case CommandBuffer::CommandType::SetActive:
+            SetActive(e, command.m_active);
+            break;
+        case CommandBuffer::CommandType::Destroy:
+            Destroy(e);
+            break;
+        }
+    }
+
+    for (CommandBuffer* commandBuffer : m_commandBuffers) {
+        commandBuffer->Clear();
+    }
+}
+
+void Encosys::DispatchObservers () {
+    std::vector<ObserverBatch> batches;
+    m_observerRegistry.TakePending(batches);
+    for (ObserverBatch& batch : batches) {
+        // Entities added and then removed or destroyed before delivery are left out, so observers can read the component
+        if (batch.m_event == ComponentEvent::OnAdd) {
+            batch.m_ids.erase(std::remove_if(batch.m_ids.begin(), batch.m_ids.end(), [this, &batch] (EntityId e) {
+                const uint32_t entityIndex = FindEntityIndex(e);
+                return entityIndex == c_invalidIndex || !m_entities[entityIndex].HasComponent(batch.m_typeId);
+            }), batch.m_ids.end());
+            if (batch.m_ids.empty()) {
+                continue;
+            }
+        }
+        m_observerRegistry.Notify(batch, *this);
+    }
+}
+
+void Encosys::ParallelFor (uint32_t count, uint32_t grainSize, const std::function<void(uint32_t, uint32_t)>& batch) {
+    if (grainSize == 0 || count <= grainSize || m_threadPool.WorkerCount() == 0) {
+        batch(0, count);
+        return;
+    }
+
+    const uint32_t batchCount = (count + grainSize - 1) / grainSize;
+    std::atomic<uint32_t> remainingBatches{batchCount};
+    for (uint32_t begin = 0; begin < count; begin += grainSize) {
+        const uint32_t end = std::min(begin + grainSize, count);
+        m_threadPool.Submit([&batch, &remainingBatches, begin, end] {
+            batch(begin, end);
+            remainingBatches.fetch_sub(1, std::memory_order_release);
+        });
+    }
+    m_threadPool.Wait(remainingBatches);
+}
+
+void Encosys::ReleaseQueries () {
+    m_queryRegistry.Release(0);
+}
+
+Entity Encosys::Create (bool active) {
+    const EntityId id = CreateId();
+    uint32_t& index = m_slots[id.Index()].m_entityIndex;
 
     if (active) {
         if (m_entityActiveCount == EntityCount()) {
@@ -31,7 +287,8 @@ Entity Encosys::Create (bool active) {
         }
         else {
             const EntityStorage& firstInactiveEntity = m_entities[m_entityActiveCount];
-            m_idToEntity[firstInactiveEntity.GetId()] = EntityCount();
+            m_slots[firstInactiveEntity.GetId().Index()].m_entityIndex = EntityCount();
+            m_dirtySlots.Mark(firstInactiveEntity.GetId().Index());
             m_entities.push_back(firstInactiveEntity);
             index = m_entityActiveCount;
             m_entities[m_entityActiveCount] = EntityStorage(id);
@@ -42,105 +299,806 @@ Entity Encosys::Create (bool active) {
         index = EntityCount();
         m_entities.push_back(EntityStorage(id));
     }
+    m_dirtyEntities.Mark(index);
+    m_dirtyEntities.Mark(EntityCount() - 1);
 
+    UpdateQueries(id, ComponentBitset{}, false, ComponentBitset{}, active);
     return Entity(this, &m_entities[index]);
 }
 
+void Encosys::CreateEntities (uint32_t count, std::vector<EntityId>& ids) {
+    ids.reserve(count);
+    m_slots.reserve(m_slots.size() + (count > m_freeSlots.size() ? count - m_freeSlots.size() : 0));
+
+    // The new entities take the place of the first inactive ones, which move to the back
+    const uint32_t first = m_entityActiveCount;
+    const uint32_t entityCount = EntityCount();
+    const uint32_t moveCount = std::min(count, entityCount - first);
+    m_entities.resize(entityCount + count, EntityStorage(c_invalidEntityId));
+    m_dirtyEntities.MarkRange(first, entityCount + count);
+    for (uint32_t i = 0; i < moveCount; ++i) {
+        const uint32_t index = entityCount + count - moveCount + i;
+        m_slots[m_entities[first + i].GetId().Index()].m_entityIndex = index;
+        m_dirtySlots.Mark(m_entities[first + i].GetId().Index());
+        m_entities[index] = m_entities[first + i];
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+        const EntityId id = CreateId();
+        m_slots[id.Index()].m_entityIndex = first + i;
+        m_entities[first + i] = EntityStorage(id);
+        ids.push_back(id);
+    }
+    m_entityActiveCount += count;
+}
+
+void Encosys::AddArchetypeRows (uint32_t first, uint32_t count, const ComponentBitset& bitset) {
+    const uint32_t archetypeId = m_archetypeRegistry.FindOrCreate(bitset, true, m_componentRegistry);
+    Archetype& archetype = m_archetypeRegistry[archetypeId];
+    archetype.Reserve(archetype.GetSize() + count);
+    m_dirtyEntities.MarkRange(first, first + count);
+    for (uint32_t i = first; i < first + count; ++i) {
+        m_entities[i].SetArchetype(archetypeId, archetype.AddRow(m_entities[i].GetId()));
+    }
+}
+
 EntityId Encosys::Copy (EntityId e, bool active) {
     // Cache off the information about the entity to copy
-    auto entityIter = m_idToEntity.find(e);
-    ENCOSYS_ASSERT_(entityIter != m_idToEntity.end());
-    const EntityStorage& entityToCopy = m_entities[entityIter->second];
+    const uint32_t entityToCopyIndex = FindEntityIndex(e);
+    ENCOSYS_ASSERT_(entityToCopyIndex != c_invalidIndex);
+    const EntityStorage& entityToCopy = m_entities[entityToCopyIndex];
 
-    EntityId id(m_entityIdCounter);
-    ++m_entityIdCounter;
+    const EntityId id = CreateId();
 
     EntityStorage entity(id);
     for (uint32_t i = 0; i < m_componentRegistry.Count(); ++i) {
         const ComponentTypeId typeId = m_componentRegistry[i].Id();
         if (entityToCopy.HasComponent(typeId)) {
+            if (!m_componentRegistry[i].HasPool()) {
+                entity.SetComponentBit(typeId, true);
+                continue;
+            }
             auto& storage = m_componentRegistry.GetStorage(typeId);
-            entity.SetComponentIndex(typeId, storage.CreateFromCopy(entityToCopy.GetComponentIndex(typeId)));
+            const uint32_t componentIndex = storage.CreateFromCopy(GetComponentIndex(entityToCopy, typeId));
+            storage.SetEntityId(componentIndex, id);
+            storage.MarkAdded(componentIndex, m_changeTick);
+            SetComponentIndex(entity, typeId, componentIndex);
+        }
+    }
+
+    // Copy the archetype components into a new row of the matching archetype
+    if (entityToCopy.GetArchetype() != c_invalidIndex) {
+        const Archetype& source = m_archetypeRegistry[entityToCopy.GetArchetype()];
+        const uint32_t archetypeId = m_archetypeRegistry.FindOrCreate(source.GetBitset(), active, m_componentRegistry);
+        Archetype& archetype = m_archetypeRegistry[archetypeId];
+        const uint32_t row = archetype.AddRow(id);
+        for (const ComponentType& type : archetype.GetTypes()) {
+            archetype.CopyComponent(type, row, source, entityToCopy.GetArchetypeRow());
+            archetype.MarkAdded(type.Id(), row, m_changeTick);
         }
+        entity.SetArchetype(archetypeId, row);
     }
 
     if (active) {
         if (m_entityActiveCount == EntityCount()) {
-            m_idToEntity[id] = EntityCount();
+            m_slots[id.Index()].m_entityIndex = EntityCount();
             m_entities.push_back(entity);
         }
         else {
             const EntityStorage& firstInactiveEntity = m_entities[m_entityActiveCount];
-            m_idToEntity[firstInactiveEntity.GetId()] = EntityCount();
+            m_slots[firstInactiveEntity.GetId().Index()].m_entityIndex = EntityCount();
+            m_dirtySlots.Mark(firstInactiveEntity.GetId().Index());
             m_entities.push_back(firstInactiveEntity);
-            m_idToEntity[id] = m_entityActiveCount;
+            m_slots[id.Index()].m_entityIndex = m_entityActiveCount;
             m_entities[m_entityActiveCount] = entity;
         }
         ++m_entityActiveCount;
     }
     else {
-        m_idToEntity[id] = EntityCount();
+        m_slots[id.Index()].m_entityIndex = EntityCount();
         m_entities.push_back(entity);
     }
+    m_dirtyEntities.Mark(m_slots[id.Index()].m_entityIndex);
+    m_dirtyEntities.Mark(EntityCount() - 1);
 
+    UpdateQueries(id, ComponentBitset{}, false, entity.GetBitset(), active);
+    for (uint32_t i = 0; i < m_componentRegistry.Count(); ++i) {
+        if (entity.HasComponent(m_componentRegistry[i].Id())) {
+            m_observerRegistry.Record(m_componentRegistry[i].Id(), ComponentEvent::OnAdd, id);
+        }
+    }
     return id;
 }
 
+Prefab Encosys::CreatePrefab (EntityId e) const {
+    const uint32_t entityIndex = FindEntityIndex(e);
+    ENCOSYS_ASSERT_(entityIndex != c_invalidIndex);
+    const EntityStorage& entity = m_entities[entityIndex];
+
+    std::vector<ComponentType> types;
+    for (uint32_t i = 0; i < m_componentRegistry.Count(); ++i) {
+        if (entity.HasComponent(m_componentRegistry[i].Id())) {
+            types.push_back(m_componentRegistry[i]);
+        }
+    }
+
+    Prefab prefab(types);
+    for (uint32_t i = 0; i < types.size(); ++i) {
+        if (types[i].IsSoa()) {
+            m_archetypeRegistry[entity.GetArchetype()].LoadComponent(types[i], entity.GetArchetypeRow(), prefab.GetComponentData(i));
+        }
+        else {
+            types[i].CopyConstruct(prefab.GetComponentData(i), GetComponentData(entity, types[i].Id()));
+        }
+    }
+    return prefab;
+}
+
+std::vector<EntityId> Encosys::Instantiate (const Prefab& prefab, uint32_t count) {
+    std::vector<EntityId> ids;
+    if (count == 0) {
+        return ids;
+    }
+
+    // The new entities occupy the back of the active range, so every component type is filled in one bulk copy
+    CreateEntities(count, ids);
+    const uint32_t first = m_entityActiveCount - count;
+    const ComponentBitset archetypeBitset = prefab.GetBitset() & m_componentRegistry.GetArchetypeBitset();
+    if (archetypeBitset.any()) {
+        AddArchetypeRows(first, count, archetypeBitset);
+    }
+
+    const uint32_t indexCount = static_cast<uint32_t>((prefab.GetBitset() & m_componentRegistry.GetPoolBitset()).count());
+    if (indexCount > 0) {
+        for (uint32_t i = first; i < first + count; ++i) {
+            ReserveComponentIndices(m_entities[i], indexCount);
+        }
+    }
+
+    for (uint32_t t = 0; t < prefab.GetTypes().size(); ++t) {
+        const ComponentType& type = prefab.GetTypes()[t];
+        ENCOSYS_ASSERT_(&type.Ops() == &m_componentRegistry.GetType(type.Id()).Ops());
+        const uint8_t* source = prefab.GetComponentData(t);
+
+        if (type.Storage() == ComponentStorage::Tag) {
+            for (uint32_t i = first; i < first + count; ++i) {
+                m_entities[i].SetComponentBit(type.Id(), true);
+            }
+            continue;
+        }
+
+        if (type.Storage() == ComponentStorage::Archetype) {
+            Archetype& archetype = m_archetypeRegistry[m_entities[first].GetArchetype()];
+            archetype.FillColumn(type, m_entities[first].GetArchetypeRow(), count, source);
+            for (uint32_t i = first; i < first + count; ++i) {
+                m_entities[i].SetComponentBit(type.Id(), true);
+                archetype.MarkAdded(type.Id(), m_entities[i].GetArchetypeRow(), m_changeTick);
+            }
+            continue;
+        }
+
+        BlockMemoryPool& storage = m_componentRegistry.GetStorage(type.Id());
+        const uint32_t firstIndex = storage.CreateCopies(source, count);
+        for (uint32_t i = 0; i < count; ++i) {
+            SetComponentIndex(m_entities[first + i], type.Id(), firstIndex + i);
+            storage.SetEntityId(firstIndex + i, ids[i]);
+            storage.MarkAdded(firstIndex + i, m_changeTick);
+        }
+    }
+
+    m_queryRegistry.InsertBatch(ids.data(), count, prefab.GetBitset());
+    for (const ComponentType& type : prefab.GetTypes()) {
+        m_observerRegistry.RecordBatch(type.Id(), ComponentEvent::OnAdd, ids.data(), count);
+    }
+    return ids;
+}
+
 Entity Encosys::Get (EntityId e) {
-    auto entityIter = m_idToEntity.find(e);
-    if (entityIter != m_idToEntity.end()) {
-        return Entity(this, &m_entities[entityIter->second]);
+    const uint32_t entityIndex = FindEntityIndex(e);
+    if (entityIndex != c_invalidIndex) {
+        return Entity(this, &m_entities[entityIndex]);
     }
     return Entity(this, nullptr);
 }
 
 void Encosys::Destroy (EntityId e) {
     // Verify this entity exists
-    auto entityIter = m_idToEntity.find(e);
-    ENCOSYS_ASSERT_(entityIter != m_idToEntity.end());
+    uint32_t entityIndex = FindEntityIndex(e);
+    ENCOSYS_ASSERT_(entityIndex != c_invalidIndex);
 
     // Cache off the information about this entity
-    uint32_t entityIndex = entityIter->second;
     EntityStorage& entity = m_entities[entityIndex];
+    m_dirtyEntities.Mark(entityIndex);
+    UpdateQueries(e, entity.GetBitset(), IndexIsActive(entityIndex), ComponentBitset{}, false);
 
     // Destroy the components for this entity
+    ArchetypeMove(entity, ComponentBitset{}, IndexIsActive(entityIndex));
     for (uint32_t i = 0; i < m_componentRegistry.Count(); ++i) {
         const ComponentTypeId typeId = m_componentRegistry[i].Id();
         if (entity.HasComponent(typeId)) {
-            auto& storage = m_componentRegistry.GetStorage(typeId);
-            storage.Destroy(entity.GetComponentIndex(typeId));
-            entity.RemoveComponentIndex(typeId);
+            m_observerRegistry.Record(typeId, ComponentEvent::OnDestroy, e);
+            if (!m_componentRegistry[i].HasPool()) {
+                entity.SetComponentBit(typeId, false);
+                continue;
+            }
+            const uint32_t componentIndex = GetComponentIndex(entity, typeId);
+            RemoveComponentIndex(entity, typeId);
+            DestroyPoolComponent(typeId, componentIndex);
         }
     }
 
     // Move the entity to the end of the vector and erase it
     IndexSetActive(entityIndex, false);
     IndexSwapEntities(entityIndex, EntityCount() - 1);
-    m_idToEntity.erase(entityIter);
+    DestroyId(e);
     m_entities.pop_back();
 }
 
 bool Encosys::IsValid (EntityId e) const {
-    return m_idToEntity.find(e) != m_idToEntity.end();
+    return FindEntityIndex(e) != c_invalidIndex;
 }
 
 bool Encosys::IsActive (EntityId e) const {
     // Verify this entity exists
-    auto entityIter = m_idToEntity.find(e);
-    ENCOSYS_ASSERT_(entityIter != m_idToEntity.end());
+    const uint32_t entityIndex = FindEntityIndex(e);
+    ENCOSYS_ASSERT_(entityIndex != c_invalidIndex);
 
-    return IndexIsActive(entityIter->second);
+    return IndexIsActive(entityIndex);
 }
 
 void Encosys::SetActive (EntityId e, bool active) {
     // Verify this entity exists
-    auto entityIter = m_idToEntity.find(e);
-    ENCOSYS_ASSERT_(entityIter != m_idToEntity.end());
+    uint32_t entityIndex = FindEntityIndex(e);
+    ENCOSYS_ASSERT_(entityIndex != c_invalidIndex);
+
+    // Active and inactive entities never share an archetype so chunk iteration can skip inactive ones
+    const EntityStorage& entity = m_entities[entityIndex];
+    if (active == IndexIsActive(entityIndex)) {
+        return;
+    }
+    if (entity.GetArchetype() != c_invalidIndex) {
+        ArchetypeMove(m_entities[entityIndex], m_archetypeRegistry[entity.GetArchetype()].GetBitset(), active);
+    }
+    UpdateQueries(e, entity.GetBitset(), !active, entity.GetBitset(), active);
 
-    uint32_t entityIndex = entityIter->second;
     IndexSetActive(entityIndex, active);
 }
 
+void Encosys::Clear () {
+    // Only the observed types pay for a pass over the entities
+    for (uint32_t i = 0; i < m_componentRegistry.Count(); ++i) {
+        const ComponentTypeId typeId = m_componentRegistry[i].Id();
+        if (m_observerRegistry.IsObserved(typeId, ComponentEvent::OnDestroy)) {
+            for (const EntityStorage& entity : m_entities) {
+                if (entity.HasComponent(typeId)) {
+                    m_observerRegistry.Record(typeId, ComponentEvent::OnDestroy, entity.GetId());
+                }
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < m_componentRegistry.Count(); ++i) {
+        if (m_componentRegistry[i].HasPool()) {
+            m_componentRegistry.GetStorage(i).Clear();
+        }
+    }
+    m_archetypeRegistry.Clear();
+    m_queryRegistry.Clear();
+    m_componentIndices.Clear();
+
+    // Every id still has to be invalidated so stale handles do not resolve to future entities
+    m_freeSlots.reserve(m_freeSlots.size() + m_entities.size());
+    for (const EntityStorage& entity : m_entities) {
+        DestroyId(entity.GetId());
+    }
+    m_entities.clear();
+    m_entityActiveCount = 0;
+}
+
+bool Encosys::Compact (std::chrono::microseconds budget) {
+    const uint32_t c_movesPerCheck = 256;
+    const auto start = std::chrono::steady_clock::now();
+    const auto outOfTime = [start, budget] () {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start) >= budget;
+    };
+
+    std::vector<uint32_t> filled;
+    CompactCursor& cursor = m_compactCursor;
+    for (; cursor.m_typeId < m_componentRegistry.Count(); ++cursor.m_typeId, cursor.m_entityIndex = 0, cursor.m_componentIndex = 0) {
+        // Archetype chunks are always packed and release themselves, and tags have nothing to pack
+        const ComponentTypeId typeId = cursor.m_typeId;
+        if (!m_componentRegistry[typeId].HasPool()) {
+            continue;
+        }
+
+        // Fill the holes first, so every index below the size is live when the components are reordered
+        BlockMemoryPool& storage = m_componentRegistry.GetStorage(typeId);
+        for (bool packed = false; !packed;) {
+            filled.clear();
+            packed = storage.FillHoles(c_movesPerCheck, filled);
+            for (const uint32_t index : filled) {
+                SetComponentIndex(m_entities[FindEntityIndex(storage.GetEntityId(index))], typeId, index);
+            }
+            if (!packed && outOfTime()) {
+                return false;
+            }
+        }
+        storage.ReleaseUnusedBlocks();
+
+        // Swap each component into the next index in entity order, entities may have moved since an interrupted call,
+        // which only costs locality
+        for (uint32_t visited = 0; cursor.m_entityIndex < EntityCount() && cursor.m_componentIndex < storage.GetSize(); ++cursor.m_entityIndex) {
+            EntityStorage& entity = m_entities[cursor.m_entityIndex];
+            if (!entity.HasComponent(typeId)) {
+                continue;
+            }
+            const uint32_t index = GetComponentIndex(entity, typeId);
+            const uint32_t target = cursor.m_componentIndex++;
+            if (index != target) {
+                const EntityId displaced = storage.GetEntityId(target);
+                storage.Swap(index, target);
+                SetComponentIndex(entity, typeId, target);
+                SetComponentIndex(m_entities[FindEntityIndex(displaced)], typeId, index);
+            }
+            if (++visited % c_movesPerCheck == 0 && outOfTime()) {
+                ++cursor.m_entityIndex;
+                return false;
+            }
+        }
+    }
+    if (cursor.m_sortRows && !SortArchetypeRows(cursor, outOfTime)) {
+        return false;
+    }
+
+    // A spike of entities also leaves the entity storage oversized
+    if (m_entities.capacity() > 2 * m_entities.size()) {
+        m_entities.shrink_to_fit();
+    }
+    m_compactCursor = CompactCursor{};
+    return true;
+}
+
+void Encosys::ApplyEntityOrder (const std::vector<uint32_t>& order, bool incremental, bool sortStorage) {
+    ENCOSYS_ASSERT_(order.size() == m_entityActiveCount);
+
+    // Only the span between the first and the last entity that moves is rewritten. Gathering it through a copy
+    // reads the entities mostly in order, since an incremental sort shifts the ones between its moves, where
+    // following the cycles of the permutation would jump around them.
+    uint32_t first = 0;
+    uint32_t last = m_entityActiveCount;
+    while (first < last && order[first] == first) {
+        ++first;
+    }
+    while (last > first && order[last - 1] == last - 1) {
+        --last;
+    }
+    std::vector<EntityStorage> gathered;
+    gathered.reserve(last - first);
+    for (uint32_t i = first; i < last; ++i) {
+        gathered.push_back(m_entities[order[i]]);
+    }
+    for (uint32_t i = first; i < last; ++i) {
+        if (order[i] == i) {
+            continue;
+        }
+        m_entities[i] = gathered[i - first];
+        m_slots[m_entities[i].GetId().Index()].m_entityIndex = i;
+        m_dirtyEntities.Mark(i);
+        m_dirtySlots.Mark(m_entities[i].GetId().Index());
+    }
+
+    m_queryRegistry.Sort([this] (EntityId id) { return FindEntityIndex(id); }, incremental);
+    if (!sortStorage) {
+        return;
+    }
+
+    // An incremental sort moves few entities but shifts the ones between them, so instead of reordering every
+    // storage now, the budgeted Compact calls catch up with the new order
+    m_compactCursor = CompactCursor{};
+    m_compactCursor.m_sortRows = true;
+    if (!incremental) {
+        Compact();
+    }
+}
+
+bool Encosys::SortArchetypeRows (CompactCursor& cursor, const std::function<bool()>& outOfTime) {
+    // Hand out rows to the entities of each archetype in entity order, swapping out whichever entity holds the row.
+    // Entities may have changed archetypes since an interrupted call, which only costs locality.
+    const uint32_t c_movesPerCheck = 256;
+    cursor.m_nextRows.resize(m_archetypeRegistry.Count(), 0);
+    for (uint32_t visited = 0; cursor.m_entityIndex < EntityCount(); ++cursor.m_entityIndex) {
+        EntityStorage& entity = m_entities[cursor.m_entityIndex];
+        const uint32_t archetypeId = entity.GetArchetype();
+        if (archetypeId == c_invalidIndex) {
+            continue;
+        }
+        Archetype& archetype = m_archetypeRegistry[archetypeId];
+        const uint32_t row = entity.GetArchetypeRow();
+        const uint32_t target = cursor.m_nextRows[archetypeId]++;
+        if (target < archetype.GetSize() && row != target) {
+            const EntityId displaced = archetype.GetEntityId(target);
+            archetype.SwapRows(row, target);
+            entity.SetArchetype(archetypeId, target);
+            m_entities[FindEntityIndex(displaced)].SetArchetype(archetypeId, row);
+            MarkEntity(entity);
+            m_dirtyEntities.Mark(FindEntityIndex(displaced));
+        }
+        if (++visited % c_movesPerCheck == 0 && outOfTime()) {
+            ++cursor.m_entityIndex;
+            return false;
+        }
+    }
+    return true;
+}
+
+void Encosys::SplitSortedEntities (ComponentTypeId typeId, std::vector<uint32_t>& kept, std::vector<uint32_t>& moved, std::vector<uint32_t>& unkeyed) const {
+    std::vector<bool> written(m_entityActiveCount, false);
+    QueryFilter filter;
+    filter.m_required.set(typeId);
+    filter.m_changed.push_back(typeId);
+    ForEachFiltered(filter.m_required, filter, m_sortTick, [&written] (uint32_t entityIndex) { written[entityIndex] = true; });
+
+    // Creating, destroying and deactivating entities swaps them around, so the unchanged ones are put back in
+    // the order of the last sort, which they mostly still are in
+    std::vector<std::pair<uint32_t, uint32_t>> ranked;
+    ranked.reserve(m_entityActiveCount);
+    for (uint32_t i = 0; i < m_entityActiveCount; ++i) {
+        const EntityStorage& entity = m_entities[i];
+        const uint32_t slot = entity.GetId().Index();
+        const uint32_t rank = slot < m_sortRanks.size() ? m_sortRanks[slot] : c_invalidIndex;
+        if (!entity.HasComponent(typeId)) {
+            unkeyed.push_back(i);
+        }
+        else if (written[i] || rank == c_invalidIndex) {
+            moved.push_back(i);
+        }
+        else {
+            ranked.emplace_back(rank, i);
+        }
+    }
+    SortNearlySorted(ranked, [] (const std::pair<uint32_t, uint32_t>& lhs, const std::pair<uint32_t, uint32_t>& rhs) { return lhs.first < rhs.first; });
+    kept.reserve(ranked.size());
+    for (const auto& entry : ranked) {
+        kept.push_back(entry.second);
+    }
+}
+
+void Encosys::RecordSortOrder (ComponentTypeId typeId) {
+    m_sortRanks.assign(m_slots.size(), c_invalidIndex);
+    for (uint32_t i = 0; i < m_entityActiveCount; ++i) {
+        if (m_entities[i].HasComponent(typeId)) {
+            m_sortRanks[m_entities[i].GetId().Index()] = i;
+        }
+    }
+    m_sortTypeId = typeId;
+    m_sortTick = m_changeTick++;
+}
+
+bool Encosys::SaveSnapshot (const char* path) const {
+    // Pending commands refer to the entities of the world as it is now
+    ENCOSYS_ASSERT_(std::all_of(m_commandBuffers.begin(), m_commandBuffers.end(), [] (const CommandBuffer* commandBuffer) { return commandBuffer->IsEmpty(); }));
+    if (!CanSnapshot()) {
+        return false;
+    }
+
+    SnapshotWriter writer;
+    if (!writer.Open(path)) {
+        return false;
+    }
+    writer.Write(SnapshotHeader{c_snapshotMagic, c_snapshotVersion, ENCOSYS_MAX_COMPONENTS_, sizeof(EntityStorage), ENCOSYS_POOL_BLOCK_SIZE_, m_componentRegistry.Count(), m_singletonRegistry.Count()});
+    writer.WriteVector(DescribeSnapshotTypes(m_componentRegistry, m_singletonRegistry));
+
+    SaveTicks(writer);
+    writer.WriteVector(m_slots);
+    writer.WriteVector(m_freeSlots);
+    writer.WriteVector(m_entities);
+    writer.Write(m_entityActiveCount);
+    m_componentIndices.Save(writer);
+    for (uint32_t i = 0; i < m_componentRegistry.Count(); ++i) {
+        if (m_componentRegistry[i].HasPool()) {
+            m_componentRegistry.GetStorage(i).Save(writer);
+        }
+    }
+    m_archetypeRegistry.Save(writer);
+    for (uint32_t i = 0; i < m_singletonRegistry.Count(); ++i) {
+        const VirtualObject& singleton = m_singletonRegistry.GetSingleton(i);
+        writer.Write(singleton.GetData(), singleton.GetBytes());
+    }
+    return writer.Close();
+}
+
+bool Encosys::LoadSnapshot (const char* path) {
+    // Pending commands refer to the entities of the world as it is now
+    ENCOSYS_ASSERT_(std::all_of(m_commandBuffers.begin(), m_commandBuffers.end(), [] (const CommandBuffer* commandBuffer) { return commandBuffer->IsEmpty(); }));
+    if (!CanSnapshot()) {
+        return false;
+    }
+
+    SnapshotReader reader;
+    if (!reader.Open(path)) {
+        return false;
+    }
+    SnapshotHeader header{};
+    std::vector<SnapshotType> types;
+    const SnapshotHeader expected{c_snapshotMagic, c_snapshotVersion, ENCOSYS_MAX_COMPONENTS_, sizeof(EntityStorage), ENCOSYS_POOL_BLOCK_SIZE_, m_componentRegistry.Count(), m_singletonRegistry.Count()};
+    if (!reader.Read(header) || memcmp(&header, &expected, sizeof(SnapshotHeader)) != 0
+        || !reader.ReadVector(types) || types != DescribeSnapshotTypes(m_componentRegistry, m_singletonRegistry)) {
+        return false;
+    }
+
+    // Events recorded for the old world refer to entities that no longer exist, and so do the delta snapshots
+    std::vector<ObserverBatch> dropped;
+    m_observerRegistry.TakePending(dropped);
+    m_compactCursor = CompactCursor{};
+    m_snapshotHistory.Clear();
+    // The ticks go back, so the next incremental sort cannot tell which keys were written since the last one
+    m_sortTypeId = c_invalidIndex;
+
+    LoadTicks(reader);
+
+    // Pools and archetypes copy each block or chunk straight out of the mapping
+    reader.ReadVector(m_slots);
+    reader.ReadVector(m_freeSlots);
+    reader.ReadVector(m_entities, EntityStorage(c_invalidEntityId));
+    reader.Read(m_entityActiveCount);
+    m_componentIndices.Load(reader);
+    for (uint32_t i = 0; i < m_componentRegistry.Count() && !reader.HasFailed(); ++i) {
+        if (m_componentRegistry[i].HasPool()) {
+            m_componentRegistry.GetStorage(i).Load(reader);
+        }
+    }
+    if (!reader.HasFailed()) {
+        m_archetypeRegistry.Load(reader, m_componentRegistry);
+    }
+    for (uint32_t i = 0; i < m_singletonRegistry.Count(); ++i) {
+        VirtualObject& singleton = m_singletonRegistry.GetSingleton(i);
+        reader.Read(singleton.GetData(), singleton.GetBytes());
+    }
+
+    if (reader.HasFailed() || reader.GetRemainingBytes() != 0 || m_entityActiveCount > m_entities.size()) {
+        for (uint32_t i = 0; i < m_componentRegistry.Count(); ++i) {
+            if (m_componentRegistry[i].HasPool()) {
+                m_componentRegistry.GetStorage(i).Clear();
+            }
+        }
+        m_archetypeRegistry.Clear();
+        m_queryRegistry.Clear();
+        m_componentIndices.Clear();
+        m_slots.clear();
+        m_freeSlots.clear();
+        m_entities.clear();
+        m_entityActiveCount = 0;
+        return false;
+    }
+    RebuildQueries();
+    return true;
+}
+
+uint32_t Encosys::CaptureSnapshot () {
+    // Pending commands refer to the entities of the world as it is now
+    ENCOSYS_ASSERT_(std::all_of(m_commandBuffers.begin(), m_commandBuffers.end(), [] (const CommandBuffer* commandBuffer) { return commandBuffer->IsEmpty(); }));
+    if (!CanSnapshot()) {
+        return c_invalidIndex;
+    }
+
+    // Singletons have no dirty tracking, so each is compared against its newest copy before Push folds the history
+    const bool full = m_snapshotHistory.IsEmpty();
+    std::vector<SingletonTypeId> changedSingletons;
+    for (uint32_t i = 0; i < m_singletonRegistry.Count(); ++i) {
+        const VirtualObject& singleton = m_singletonRegistry.GetSingleton(i);
+        const std::vector<uint8_t>* previous = full ? nullptr : m_snapshotHistory.FindBlock(m_snapshotHistory.GetNewestId(), SnapshotHistory::BlockKey(SnapshotStorageKey(SnapshotStorage::Singleton, i), 0));
+        if (previous == nullptr || previous->size() != singleton.GetBytes() || memcmp(previous->data(), singleton.GetData(), singleton.GetBytes()) != 0) {
+            changedSingletons.push_back(i);
+        }
+    }
+
+    SnapshotHistory::Snapshot& snapshot = m_snapshotHistory.Push();
+    SnapshotWriter writer(snapshot.m_state);
+    writer.Write(m_componentRegistry.Count());
+    writer.Write(m_singletonRegistry.Count());
+    SaveTicks(writer);
+    writer.Write(static_cast<uint32_t>(m_slots.size()));
+    writer.WriteVector(m_freeSlots);
+    writer.Write(static_cast<uint32_t>(m_entities.size()));
+    writer.Write(m_entityActiveCount);
+    m_componentIndices.SaveState(writer);
+    for (uint32_t i = 0; i < m_componentRegistry.Count(); ++i) {
+        if (m_componentRegistry[i].HasPool()) {
+            m_componentRegistry.GetStorage(i).SaveState(writer);
+        }
+    }
+    writer.Write(m_archetypeRegistry.Count());
+    for (uint32_t i = 0; i < m_archetypeRegistry.Count(); ++i) {
+        writer.Write(m_archetypeRegistry[i].GetSize());
+    }
+
+    CaptureBlocks(snapshot, SnapshotStorageKey(SnapshotStorage::Slots, 0), ArrayBlocks<decltype(m_slots)>(m_slots, m_dirtySlots), full);
+    CaptureBlocks(snapshot, SnapshotStorageKey(SnapshotStorage::Entities, 0), ArrayBlocks<decltype(m_entities)>(m_entities, m_dirtyEntities), full);
+    for (uint8_t sizeClass = 0; sizeClass < m_componentIndices.GetSizeClassCount(); ++sizeClass) {
+        CaptureBlocks(snapshot, SnapshotStorageKey(SnapshotStorage::Indices, sizeClass), m_componentIndices.GetBlocks(sizeClass), full);
+    }
+    for (uint32_t i = 0; i < m_componentRegistry.Count(); ++i) {
+        if (m_componentRegistry[i].HasPool()) {
+            CaptureBlocks(snapshot, SnapshotStorageKey(SnapshotStorage::Pool, i), m_componentRegistry.GetStorage(i), full);
+        }
+    }
+    for (uint32_t i = 0; i < m_archetypeRegistry.Count(); ++i) {
+        CaptureBlocks(snapshot, SnapshotStorageKey(SnapshotStorage::Archetype, i), m_archetypeRegistry[i], full);
+    }
+    for (const SingletonTypeId i : changedSingletons) {
+        const VirtualObject& singleton = m_singletonRegistry.GetSingleton(i);
+        const uint8_t* data = static_cast<const uint8_t*>(singleton.GetData());
+        snapshot.m_blocks[SnapshotHistory::BlockKey(SnapshotStorageKey(SnapshotStorage::Singleton, i), 0)].assign(data, data + singleton.GetBytes());
+    }
+    return snapshot.m_id;
+}
+
+bool Encosys::RestoreSnapshot (uint32_t snapshot) {
+    // Pending commands refer to the entities of the world as it is now
+    ENCOSYS_ASSERT_(std::all_of(m_commandBuffers.begin(), m_commandBuffers.end(), [] (const CommandBuffer* commandBuffer) { return commandBuffer->IsEmpty(); }));
+    if (!m_snapshotHistory.Contains(snapshot)) {
+        return false;
+    }
+    const std::vector<uint8_t>& state = m_snapshotHistory.Get(snapshot).m_state;
+    SnapshotReader reader(state.data(), state.size());
+    uint32_t componentCount = 0;
+    uint32_t singletonCount = 0;
+    reader.Read(componentCount);
+    reader.Read(singletonCount);
+    if (componentCount != m_componentRegistry.Count() || singletonCount != m_singletonRegistry.Count()) {
+        return false;
+    }
+
+    // Events recorded since refer to a future that is being undone
+    std::vector<ObserverBatch> dropped;
+    m_observerRegistry.TakePending(dropped);
+    m_compactCursor = CompactCursor{};
+    m_sortTypeId = c_invalidIndex;
+
+    // A block has been written since the snapshot when it is dirty now or a later snapshot copied it, and the
+    // blocks from the old size on lost their elements when the storage shrank
+    std::unordered_set<uint64_t> newer;
+    m_snapshotHistory.CollectNewerBlocks(snapshot, newer);
+    const RestoreContext context{m_snapshotHistory, snapshot, newer};
+
+    LoadTicks(reader);
+    uint32_t size = 0;
+    reader.Read(size);
+    const uint32_t slotCount = static_cast<uint32_t>(m_slots.size());
+    m_slots.resize(size);
+    RestoreBlocks(context, SnapshotStorageKey(SnapshotStorage::Slots, 0), ArrayBlocks<decltype(m_slots)>(m_slots, m_dirtySlots), slotCount >> m_dirtySlots.GetBlockShift());
+    reader.ReadVector(m_freeSlots);
+
+    reader.Read(size);
+    const uint32_t entityCount = EntityCount();
+    m_entities.resize(size, EntityStorage(c_invalidEntityId));
+    RestoreBlocks(context, SnapshotStorageKey(SnapshotStorage::Entities, 0), ArrayBlocks<decltype(m_entities)>(m_entities, m_dirtyEntities), entityCount >> m_dirtyEntities.GetBlockShift());
+    reader.Read(m_entityActiveCount);
+
+    std::vector<uint32_t> indexCounts;
+    for (uint8_t sizeClass = 0; sizeClass < m_componentIndices.GetSizeClassCount(); ++sizeClass) {
+        indexCounts.push_back(static_cast<uint32_t>(m_componentIndices.GetBlocks(sizeClass).GetSize()));
+    }
+    m_componentIndices.LoadState(reader);
+    for (uint8_t sizeClass = 0; sizeClass < m_componentIndices.GetSizeClassCount(); ++sizeClass) {
+        ArrayBlocks<ComponentIndexTable::IndexArray> blocks = m_componentIndices.GetBlocks(sizeClass);
+        RestoreBlocks(context, SnapshotStorageKey(SnapshotStorage::Indices, sizeClass), blocks, indexCounts[sizeClass] >> blocks.GetDirtyBlocks().GetBlockShift());
+    }
+
+    for (uint32_t i = 0; i < m_componentRegistry.Count(); ++i) {
+        if (m_componentRegistry[i].HasPool()) {
+            BlockMemoryPool& storage = m_componentRegistry.GetStorage(i);
+            const uint32_t poolSize = storage.GetSize();
+            storage.LoadState(reader);
+            RestoreBlocks(context, SnapshotStorageKey(SnapshotStorage::Pool, i), storage, poolSize / storage.GetBlockSize());
+        }
+    }
+
+    // Archetypes are never removed, so the ones created since the snapshot are the ones past its count
+    uint32_t archetypeCount = 0;
+    reader.Read(archetypeCount);
+    ENCOSYS_ASSERT_(archetypeCount <= m_archetypeRegistry.Count());
+    m_archetypeRegistry.Truncate(archetypeCount);
+    for (uint32_t i = 0; i < m_archetypeRegistry.Count(); ++i) {
+        Archetype& archetype = m_archetypeRegistry[i];
+        const uint32_t rowCount = archetype.GetSize();
+        reader.Read(size);
+        archetype.RestoreSize(size);
+        RestoreBlocks(context, SnapshotStorageKey(SnapshotStorage::Archetype, i), archetype, rowCount / archetype.GetChunkCapacity());
+    }
+
+    for (uint32_t i = 0; i < m_singletonRegistry.Count(); ++i) {
+        VirtualObject& singleton = m_singletonRegistry.GetSingleton(i);
+        const std::vector<uint8_t>* bytes = m_snapshotHistory.FindBlock(snapshot, SnapshotHistory::BlockKey(SnapshotStorageKey(SnapshotStorage::Singleton, i), 0));
+        ENCOSYS_ASSERT_(bytes != nullptr && bytes->size() == singleton.GetBytes());
+        if (bytes != nullptr) {
+            memcpy(singleton.GetData(), bytes->data(), singleton.GetBytes());
+        }
+    }
+    ENCOSYS_ASSERT_(!reader.HasFailed() && reader.GetRemainingBytes() == 0);
+
+    m_snapshotHistory.DropNewer(snapshot);
+    RebuildQueries();
+    return true;
+}
+
+void Encosys::SetSnapshotCapacity (uint32_t capacity) {
+    m_snapshotHistory.SetCapacity(capacity);
+}
+
+void Encosys::ClearSnapshots () {
+    m_snapshotHistory.Clear();
+}
+
+bool Encosys::CanSnapshot () const {
+    for (uint32_t i = 0; i < m_componentRegistry.Count(); ++i) {
+        if (m_componentRegistry[i].Storage() != ComponentStorage::Tag && !m_componentRegistry[i].IsTriviallyCopyable()) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < m_singletonRegistry.Count(); ++i) {
+        if (!m_singletonRegistry.GetSingleton(i).IsTriviallyCopyable()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Encosys::SaveTicks (SnapshotWriter& writer) const {
+    writer.Write(m_changeTick);
+    writer.Write(m_filterTick);
+    writer.Write(m_updateEndTick);
+    writer.Write(m_systemRegistry.Count());
+    for (uint32_t i = 0; i < m_systemRegistry.Count(); ++i) {
+        writer.Write(m_systemRegistry.GetSystemType(i).GetRunTick());
+        writer.Write(m_systemRegistry.GetSystemType(i).GetLastRunTick());
+    }
+}
+
+void Encosys::LoadTicks (SnapshotReader& reader) {
+    reader.Read(m_changeTick);
+    reader.Read(m_filterTick);
+    reader.Read(m_updateEndTick);
+    uint32_t systemCount = 0;
+    reader.Read(systemCount);
+    for (uint32_t i = 0; i < systemCount && !reader.HasFailed(); ++i) {
+        ChangeTick runTick = 0;
+        ChangeTick lastRunTick = 0;
+        reader.Read(runTick);
+        reader.Read(lastRunTick);
+        if (i < m_systemRegistry.Count()) {
+            m_systemRegistry.GetSystemType(i).SetRunTicks(runTick, lastRunTick);
+        }
+    }
+    // Systems the snapshot does not know about see every component as new
+    for (uint32_t i = systemCount; i < m_systemRegistry.Count(); ++i) {
+        m_systemRegistry.GetSystemType(i).SetRunTicks(0, 0);
+    }
+}
+
+void Encosys::MarkEntity (const EntityStorage& entity) {
+    // Copy builds the new entity outside m_entities, and storing it there marks it instead
+    const std::uintptr_t offset = reinterpret_cast<std::uintptr_t>(&entity) - reinterpret_cast<std::uintptr_t>(m_entities.data());
+    if (offset < m_entities.size() * sizeof(EntityStorage)) {
+        m_dirtyEntities.Mark(static_cast<uint32_t>(offset / sizeof(EntityStorage)));
+    }
+}
+
+void Encosys::RebuildQueries () {
+    // Neighboring entities tend to share a bitset, so each run of them is matched against the queries once
+    m_queryRegistry.Clear();
+    std::vector<EntityId> ids;
+    for (uint32_t first = 0; first < m_entityActiveCount;) {
+        const ComponentBitset& bitset = m_entities[first].GetBitset();
+        ids.clear();
+        uint32_t i = first;
+        for (; i < m_entityActiveCount && m_entities[i].GetBitset() == bitset; ++i) {
+            ids.push_back(m_entities[i].GetId());
+        }
+        m_queryRegistry.InsertBatch(ids.data(), static_cast<uint32_t>(ids.size()), bitset);
+        first = i;
+    }
+}
+
 uint32_t Encosys::EntityCount () const {
     return static_cast<uint32_t>(m_entities.size());
 }
@@ -153,13 +1111,339 @@ const SystemType& Encosys::GetSystemType (SystemTypeId systemId) const {
     return m_systemRegistry.GetSystemType(systemId);
 }
 
+EntityId Encosys::CreateId () {
+    // Reuse a destroyed slot if possible, its generation was bumped when it was freed
+    if (!m_freeSlots.empty()) {
+        const uint32_t slot = m_freeSlots.back();
+        m_freeSlots.pop_back();
+        m_dirtySlots.Mark(slot);
+        return EntityId(slot, m_slots[slot].m_generation);
+    }
+    m_slots.push_back(EntitySlot{});
+    m_dirtySlots.Mark(static_cast<uint32_t>(m_slots.size() - 1));
+    return EntityId(static_cast<uint32_t>(m_slots.size() - 1), 0);
+}
+
+void Encosys::DestroyId (EntityId e) {
+    EntitySlot& slot = m_slots[e.Index()];
+    m_dirtySlots.Mark(e.Index());
+    slot.m_entityIndex = c_invalidIndex;
+    // A slot whose generation ran out is retired, since wrapping around would make stale handles valid again
+    if (++slot.m_generation != c_pendingGeneration) {
+        m_freeSlots.push_back(e.Index());
+    }
+}
+
 void Encosys::IndexSwapEntities (uint32_t lhsIndex, uint32_t rhsIndex) {
     if (lhsIndex == rhsIndex) {
         return;
     }
-    m_idToEntity[m_entities[lhsIndex].GetId()] = rhsIndex;
-    m_idToEntity[m_entities[rhsIndex].GetId()] = lhsIndex;
+    m_slots[m_entities[lhsIndex].GetId().Index()].m_entityIndex = rhsIndex;
+    m_slots[m_entities[rhsIndex].GetId().Index()].m_entityIndex = lhsIndex;
+    m_dirtySlots.Mark(m_entities[lhsIndex].GetId().Index());
+    m_dirtySlots.Mark(m_entities[rhsIndex].GetId().Index());
     std::swap(m_entities[lhsIndex], m_entities[rhsIndex]);
+    m_dirtyEntities.Mark(lhsIndex);
+    m_dirtyEntities.Mark(rhsIndex);
+}
+
+void Encosys::ArchetypeMove (EntityStorage& entity, const ComponentBitset& bitset, bool active) {
+    const uint32_t sourceId = entity.GetArchetype();
+    const uint32_t sourceRow = entity.GetArchetypeRow();
+
+    // Reserve a row in the destination archetype, an empty bitset leaves the entity without one
+    uint32_t destId = c_invalidIndex;
+    uint32_t destRow = c_invalidIndex;
+    if (bitset.any()) {
+        destId = m_archetypeRegistry.FindOrCreate(bitset, active, m_componentRegistry);
+        if (destId == sourceId) {
+            return;
+        }
+        destRow = m_archetypeRegistry[destId].AddRow(entity.GetId());
+    }
+
+    if (sourceId != c_invalidIndex) {
+        // Relocate the shared components and destroy the ones the destination does not store
+        Archetype& source = m_archetypeRegistry[sourceId];
+        for (const ComponentType& type : source.GetTypes()) {
+            if (bitset.test(type.Id())) {
+                m_archetypeRegistry[destId].RelocateComponent(type, destRow, source, sourceRow);
+            }
+            else if (!type.IsTriviallyDestructible()) {
+                type.Destroy(source.GetComponentData(type.Id(), sourceRow));
+            }
+        }
+
+        // Patch the row of the entity that was moved into the vacated row
+        const EntityId movedId = source.RemoveRow(sourceRow);
+        if (movedId != c_invalidEntityId) {
+            m_entities[m_slots[movedId.Index()].m_entityIndex].SetArchetype(sourceId, sourceRow);
+            m_dirtyEntities.Mark(m_slots[movedId.Index()].m_entityIndex);
+        }
+    }
+
+    entity.SetArchetype(destId, destRow);
+    MarkEntity(entity);
+}
+
+void Encosys::AddSoaComponent (EntityId e, ComponentTypeId typeId, const uint8_t* component) {
+    const uint32_t entityIndex = FindEntityIndex(e);
+    ENCOSYS_ASSERT_(entityIndex != c_invalidIndex);
+    EntityStorage& entity = m_entities[entityIndex];
+    ENCOSYS_ASSERT_(!entity.HasComponent(typeId));
+    const bool active = IndexIsActive(entityIndex);
+    const ComponentBitset oldBitset = entity.GetBitset();
+
+    ComponentBitset archetypeBitset = entity.GetBitset() & m_componentRegistry.GetArchetypeBitset();
+    ArchetypeMove(entity, archetypeBitset.set(typeId), active);
+    entity.SetComponentBit(typeId, true);
+    MarkEntity(entity);
+    UpdateQueries(e, oldBitset, active, entity.GetBitset(), active);
+    m_archetypeRegistry[entity.GetArchetype()].StoreComponent(m_componentRegistry.GetType(typeId), entity.GetArchetypeRow(), component);
+    MarkAdded(entity, typeId);
+    m_observerRegistry.Record(typeId, ComponentEvent::OnAdd, e);
+}
+
+void Encosys::LoadSoaComponent (EntityId e, ComponentTypeId typeId, uint8_t* dst) const {
+    const uint32_t entityIndex = FindEntityIndex(e);
+    ENCOSYS_ASSERT_(entityIndex != c_invalidIndex && m_entities[entityIndex].HasComponent(typeId));
+    const EntityStorage& entity = m_entities[entityIndex];
+    m_archetypeRegistry[entity.GetArchetype()].LoadComponent(m_componentRegistry.GetType(typeId), entity.GetArchetypeRow(), dst);
+}
+
+void Encosys::StoreSoaComponent (EntityId e, ComponentTypeId typeId, const uint8_t* src) {
+    const uint32_t entityIndex = FindEntityIndex(e);
+    ENCOSYS_ASSERT_(entityIndex != c_invalidIndex && m_entities[entityIndex].HasComponent(typeId));
+    const EntityStorage& entity = m_entities[entityIndex];
+    m_archetypeRegistry[entity.GetArchetype()].StoreComponent(m_componentRegistry.GetType(typeId), entity.GetArchetypeRow(), src);
+    MarkChanged(entity, typeId, m_changeTick);
+}
+
+void Encosys::MarkAdded (const EntityStorage& entity, ComponentTypeId typeId) {
+    if (m_componentRegistry.GetArchetypeBitset().test(typeId)) {
+        m_archetypeRegistry[entity.GetArchetype()].MarkAdded(typeId, entity.GetArchetypeRow(), m_changeTick);
+    }
+    else if (!m_componentRegistry.GetTagBitset().test(typeId)) {
+        m_componentRegistry.GetStorage(typeId).MarkAdded(GetComponentIndex(entity, typeId), m_changeTick);
+    }
+}
+
+void Encosys::MarkChanged (const EntityStorage& entity, ComponentTypeId typeId, ChangeTick tick) {
+    if (m_componentRegistry.GetArchetypeBitset().test(typeId)) {
+        m_archetypeRegistry[entity.GetArchetype()].MarkChanged(typeId, entity.GetArchetypeRow(), tick);
+    }
+    else if (!m_componentRegistry.GetTagBitset().test(typeId)) {
+        m_componentRegistry.GetStorage(typeId).MarkChanged(GetComponentIndex(entity, typeId), tick);
+    }
+}
+
+const ComponentTicks& Encosys::GetComponentTicks (const EntityStorage& entity, ComponentTypeId typeId) const {
+    if (m_componentRegistry.GetArchetypeBitset().test(typeId)) {
+        return m_archetypeRegistry[entity.GetArchetype()].GetTicks(typeId, entity.GetArchetypeRow());
+    }
+    return m_componentRegistry.GetStorage(typeId).GetTicks(GetComponentIndex(entity, typeId));
+}
+
+bool Encosys::PassesFilter (EntityId e, const QueryFilter& filter, ChangeTick since) const {
+    return PassesFilter(m_entities[FindEntityIndex(e)], filter, since);
+}
+
+bool Encosys::PassesFilter (const EntityStorage& entity, const QueryFilter& filter, ChangeTick since) const {
+    if (!filter.PassesMasks(entity.GetBitset())) {
+        return false;
+    }
+    for (const ComponentTypeId typeId : filter.m_changed) {
+        if (!IsNewerTick(GetComponentTicks(entity, typeId).m_changed, since)) {
+            return false;
+        }
+    }
+    for (const ComponentTypeId typeId : filter.m_added) {
+        if (!IsNewerTick(GetComponentTicks(entity, typeId).m_added, since)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Encosys::PassesFilter (const Archetype& archetype, uint32_t row, const QueryFilter& filter, ChangeTick since) const {
+    for (const ComponentTypeId typeId : filter.m_changed) {
+        if (!IsNewerTick(archetype.GetTicks(typeId, row).m_changed, since)) {
+            return false;
+        }
+    }
+    for (const ComponentTypeId typeId : filter.m_added) {
+        if (!IsNewerTick(archetype.GetTicks(typeId, row).m_added, since)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Encosys::ChunkPassesFilter (const Archetype& archetype, uint32_t chunk, const QueryFilter& filter, ChangeTick since) const {
+    for (const ComponentTypeId typeId : filter.m_changed) {
+        if (!IsNewerTick(archetype.GetChunkTicks(typeId, chunk).m_changed, since)) {
+            return false;
+        }
+    }
+    for (const ComponentTypeId typeId : filter.m_added) {
+        if (!IsNewerTick(archetype.GetChunkTicks(typeId, chunk).m_added, since)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Encosys::ForEachFiltered (const ComponentBitset& bitset, const QueryFilter& filter, ChangeTick since, const std::function<void(uint32_t)>& visit) const {
+    ENCOSYS_ASSERT_(filter.HasTickFilters());
+    const bool added = filter.m_changed.empty();
+    const ComponentTypeId typeId = added ? filter.m_added.front() : filter.m_changed.front();
+    const auto isNewer = [added, since] (const ComponentTicks& ticks) {
+        return IsNewerTick(added ? ticks.m_added : ticks.m_changed, since);
+    };
+    const auto visitOwner = [&] (EntityId id) {
+        const uint32_t entityIndex = FindEntityIndex(id);
+        if (IndexIsActive(entityIndex) && m_entities[entityIndex].HasComponentBitset(bitset) && PassesFilter(m_entities[entityIndex], filter, since)) {
+            visit(entityIndex);
+        }
+    };
+
+    if (m_componentRegistry.GetArchetypeBitset()[typeId]) {
+        for (uint32_t a = 0; a < m_archetypeRegistry.Count(); ++a) {
+            const Archetype& archetype = m_archetypeRegistry[a];
+            if (!archetype.IsActive() || !archetype.GetBitset()[typeId]) {
+                continue;
+            }
+            for (uint32_t chunk = 0; chunk < archetype.GetChunkCount(); ++chunk) {
+                if (!isNewer(archetype.GetChunkTicks(typeId, chunk))) {
+                    continue;
+                }
+                const EntityId* ids = archetype.GetEntityIds(chunk);
+                const ComponentTicks* ticks = archetype.GetTicksColumn(typeId, chunk);
+                for (uint32_t row = 0; row < archetype.GetChunkSize(chunk); ++row) {
+                    if (isNewer(ticks[row])) {
+                        visitOwner(ids[row]);
+                    }
+                }
+            }
+        }
+        return;
+    }
+
+    // Destroyed pool elements have no owner, which FindEntityIndex rejects
+    const BlockMemoryPool& storage = m_componentRegistry.GetStorage(typeId);
+    for (uint32_t block = 0; block < storage.GetUsedBlockCount(); ++block) {
+        if (!isNewer(storage.GetBlockTicks(block))) {
+            continue;
+        }
+        const uint32_t end = std::min((block + 1) * storage.GetBlockSize(), storage.GetSize());
+        for (uint32_t index = block * storage.GetBlockSize(); index < end; ++index) {
+            if (isNewer(storage.GetTicks(index))) {
+                visitOwner(storage.GetEntityId(index));
+            }
+        }
+    }
+}
+
+void Encosys::FindArchetypeChunks (const ComponentBitset& bitset, const QueryFilter& filter, std::vector<std::pair<uint32_t, uint32_t>>& chunks) const {
+    for (uint32_t a = 0; a < m_archetypeRegistry.Count(); ++a) {
+        const Archetype& archetype = m_archetypeRegistry[a];
+        if (archetype.IsActive() && (archetype.GetBitset() & bitset) == bitset && filter.PassesMasks(archetype.GetBitset())) {
+            for (uint32_t c = 0; c < archetype.GetChunkCount(); ++c) {
+                chunks.emplace_back(a, c);
+            }
+        }
+    }
+}
+
+ComponentTypeId Encosys::FindSparseSetDriver (const ComponentBitset& bitset) const {
+    // Archetype components are left out since their entities are spread over several archetypes, and sparse sets
+    // win ties with pools
+    const ComponentBitset& sparseSets = m_componentRegistry.GetSparseSetBitset();
+    ComponentTypeId smallest = c_invalidIndex;
+    uint32_t smallestSize = 0;
+    for (ComponentTypeId typeId = 0; typeId < m_componentRegistry.Count(); ++typeId) {
+        if (!bitset[typeId] || !m_componentRegistry.GetPoolBitset()[typeId]) {
+            continue;
+        }
+        const uint32_t size = m_componentRegistry.GetStorage(typeId).GetSize();
+        if (smallest == c_invalidIndex || size < smallestSize || (size == smallestSize && sparseSets[typeId])) {
+            smallest = typeId;
+            smallestSize = size;
+        }
+    }
+    return smallest != c_invalidIndex && sparseSets[smallest] ? smallest : c_invalidIndex;
+}
+
+void Encosys::DestroyPoolComponent (ComponentTypeId typeId, uint32_t index) {
+    BlockMemoryPool& storage = m_componentRegistry.GetStorage(typeId);
+    storage.Destroy(index);
+
+    // Sparse sets fill the hole with their last component, so its owner needs the new index
+    if (m_componentRegistry.GetType(typeId).Storage() == ComponentStorage::SparseSet && index < storage.GetSize()) {
+        const EntityId movedId = m_componentRegistry.GetSparseSet(typeId).GetEntityId(index);
+        SetComponentIndex(m_entities[FindEntityIndex(movedId)], typeId, index);
+    }
+}
+
+void Encosys::SetComponentIndex (EntityStorage& entity, ComponentTypeId typeId, uint32_t index) {
+    ENCOSYS_ASSERT_(m_componentRegistry.GetPoolBitset().test(typeId));
+    MarkEntity(entity);
+    const uint32_t rank = ComponentIndexRank(entity, typeId);
+    if (!entity.HasComponent(typeId)) {
+        // Open a gap at the rank of the new component, the indices above it move up by one
+        const uint32_t count = static_cast<uint32_t>((entity.GetBitset() & m_componentRegistry.GetPoolBitset()).count());
+        ReserveComponentIndices(entity, count + 1);
+        uint32_t* run = m_componentIndices.GetRun(entity.GetIndexRun(), entity.GetIndexClass());
+        std::copy_backward(run + rank, run + count, run + count + 1);
+        entity.SetComponentBit(typeId, true);
+    }
+    m_componentIndices.GetRun(entity.GetIndexRun(), entity.GetIndexClass())[rank] = index;
+}
+
+void Encosys::RemoveComponentIndex (EntityStorage& entity, ComponentTypeId typeId) {
+    ENCOSYS_ASSERT_(entity.HasComponent(typeId) && m_componentRegistry.GetPoolBitset().test(typeId));
+    MarkEntity(entity);
+    const uint32_t rank = ComponentIndexRank(entity, typeId);
+    const uint32_t count = static_cast<uint32_t>((entity.GetBitset() & m_componentRegistry.GetPoolBitset()).count());
+    uint32_t* run = m_componentIndices.GetRun(entity.GetIndexRun(), entity.GetIndexClass());
+    std::copy(run + rank + 1, run + count, run + rank);
+    entity.SetComponentBit(typeId, false);
+    if (count == 1) {
+        m_componentIndices.Free(entity.GetIndexRun(), entity.GetIndexClass());
+        entity.SetIndexRun(c_invalidIndex, 0);
+    }
+}
+
+void Encosys::ReserveComponentIndices (EntityStorage& entity, uint32_t count) {
+    const bool hasRun = entity.GetIndexRun() != c_invalidIndex;
+    if (hasRun && count <= ComponentIndexTable::Capacity(entity.GetIndexClass())) {
+        return;
+    }
+    // A larger size class is a different array, so allocating never moves the old run
+    MarkEntity(entity);
+    uint8_t sizeClass = 0;
+    const uint32_t run = m_componentIndices.Allocate(count, sizeClass);
+    if (hasRun) {
+        const uint32_t* oldRun = m_componentIndices.GetRun(entity.GetIndexRun(), entity.GetIndexClass());
+        const uint32_t oldCount = static_cast<uint32_t>((entity.GetBitset() & m_componentRegistry.GetPoolBitset()).count());
+        std::copy(oldRun, oldRun + oldCount, m_componentIndices.GetRun(run, sizeClass));
+        m_componentIndices.Free(entity.GetIndexRun(), entity.GetIndexClass());
+    }
+    entity.SetIndexRun(run, sizeClass);
+}
+
+const Query& Encosys::FindOrCreateQuery (const ComponentBitset& bitset, bool pinned) {
+    return m_queryRegistry.FindOrCreate(bitset, [this] (Query& query) {
+        for (uint32_t i = 0; i < m_entityActiveCount; ++i) {
+            if (m_entities[i].HasComponentBitset(query.GetBitset())) {
+                query.Insert(m_entities[i].GetId());
+            }
+        }
+    }, pinned);
+}
+
+void Encosys::UpdateQueries (EntityId e, const ComponentBitset& oldBitset, bool oldActive, const ComponentBitset& newBitset, bool newActive) {
+    m_queryRegistry.Update(e, oldBitset, oldActive, newBitset, newActive);
 }
 
 bool Encosys::IndexIsActive (uint32_t index) const {
@@ -0,0 +1,57 @@
+#include "FrameAllocator.h"
+
+#include <cassert>
+
+namespace ecs {
+
+namespace {
+
+const std::size_t c_frameBlockAlignment = 64;
+
+}
+
+FrameAllocator::FrameAllocator (std::size_t blockBytes) : m_blockBytes{blockBytes} {}
+
+FrameAllocator::~FrameAllocator () {
+    Reset();
+    for (uint8_t* block : m_blocks) {
+        HeapAllocator::Instance().Deallocate(block, m_blockBytes, c_frameBlockAlignment);
+    }
+}
+
+void FrameAllocator::Reset () {
+    for (const LargeAllocation& allocation : m_largeAllocations) {
+        HeapAllocator::Instance().Deallocate(allocation.m_data, allocation.m_bytes, allocation.m_alignment);
+    }
+    m_largeAllocations.clear();
+    m_block = 0;
+    m_offset = 0;
+    ForgetAllocations();
+}
+
+void* FrameAllocator::DoAllocate (std::size_t bytes, std::size_t alignment) {
+    if (bytes > m_blockBytes || alignment > c_frameBlockAlignment) {
+        void* data = HeapAllocator::Instance().Allocate(bytes, alignment);
+        m_largeAllocations.push_back({data, bytes, alignment});
+        return data;
+    }
+
+    std::size_t offset = (m_offset + alignment - 1) / alignment * alignment;
+    if (m_block == m_blocks.size() || offset + bytes > m_blockBytes) {
+        // Move on to the next block, reusing the ones from earlier frames first
+        if (m_block < m_blocks.size()) {
+            ++m_block;
+        }
+        if (m_block == m_blocks.size()) {
+            m_blocks.push_back(static_cast<uint8_t*>(HeapAllocator::Instance().Allocate(m_blockBytes, c_frameBlockAlignment)));
+        }
+        offset = 0;
+    }
+    m_offset = offset + bytes;
+    return m_blocks[m_block] + offset;
+}
+
+void FrameAllocator::DoDeallocate (void* /*data*/, std::size_t /*bytes*/, std::size_t /*alignment*/) {
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,41 @@
+#include "ObserverRegistry.h"
+
+namespace ecs {
+
+void ObserverRegistry::Register (ComponentTypeId typeId, ComponentEvent event, ObserverCallback callback) {
+    // Observers are stored by value, so adding one while others run could move the running one
+    ENCOSYS_ASSERT_(!m_notifying);
+    ENCOSYS_ASSERT_(event != ComponentEvent::Count);
+    const uint32_t slot = Slot(typeId, event);
+    if (slot >= m_slots.size()) {
+        m_slots.resize(Slot(typeId + 1, ComponentEvent::OnAdd));
+    }
+    m_slots[slot].m_observers.push_back(std::move(callback));
+}
+
+void ObserverRegistry::RecordBatch (ComponentTypeId typeId, ComponentEvent event, const EntityId* ids, uint32_t count) {
+    if (IsObserved(typeId, event)) {
+        std::vector<EntityId>& pending = m_slots[Slot(typeId, event)].m_pending;
+        pending.insert(pending.end(), ids, ids + count);
+    }
+}
+
+void ObserverRegistry::TakePending (std::vector<ObserverBatch>& batches) {
+    for (uint32_t slot = 0; slot < m_slots.size(); ++slot) {
+        if (!m_slots[slot].m_pending.empty()) {
+            const uint32_t eventCount = static_cast<uint32_t>(ComponentEvent::Count);
+            batches.push_back({slot / eventCount, static_cast<ComponentEvent>(slot % eventCount), {}});
+            batches.back().m_ids.swap(m_slots[slot].m_pending);
+        }
+    }
+}
+
+void ObserverRegistry::Notify (const ObserverBatch& batch, Encosys& encosys) {
+    m_notifying = true;
+    for (const ObserverCallback& observer : m_slots[Slot(batch.m_typeId, batch.m_event)].m_observers) {
+        observer(encosys, batch.m_ids);
+    }
+    m_notifying = false;
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,59 @@
+#include "Prefab.h"
+
+#include <algorithm>
+#include <new>
+
+namespace ecs {
+
+Prefab::Prefab (const std::vector<ComponentType>& types) : m_types{types} {
+    uint32_t bytes = 0;
+    for (const ComponentType& type : m_types) {
+        m_bitset.set(type.Id());
+        bytes = (bytes + type.Alignment() - 1) / type.Alignment() * type.Alignment();
+        m_offsets.push_back(bytes);
+        bytes += type.Bytes();
+        m_alignment = std::max(m_alignment, type.Alignment());
+    }
+    m_data = static_cast<uint8_t*>(::operator new(std::max(bytes, 1u), std::align_val_t{m_alignment}));
+}
+
+Prefab::Prefab (Prefab&& other) :
+    m_bitset{other.m_bitset},
+    m_types{std::move(other.m_types)},
+    m_offsets{std::move(other.m_offsets)},
+    m_alignment{other.m_alignment},
+    m_data{other.m_data} {
+    other.m_types.clear();
+    other.m_data = nullptr;
+}
+
+Prefab& Prefab::operator= (Prefab&& other) {
+    if (this != &other) {
+        Release();
+        m_bitset = other.m_bitset;
+        m_types = std::move(other.m_types);
+        m_offsets = std::move(other.m_offsets);
+        m_alignment = other.m_alignment;
+        m_data = other.m_data;
+        other.m_types.clear();
+        other.m_data = nullptr;
+    }
+    return *this;
+}
+
+Prefab::~Prefab () {
+    Release();
+}
+
+void Prefab::Release () {
+    if (m_data == nullptr) {
+        return;
+    }
+    for (uint32_t i = 0; i < m_types.size(); ++i) {
+        m_types[i].Destroy(GetComponentData(i));
+    }
+    ::operator delete(m_data, std::align_val_t{m_alignment});
+    m_data = nullptr;
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,134 @@
+#include "QueryRegistry.h"
+#include <algorithm>
+
+namespace ecs {
+
+QueryRegistry::~QueryRegistry () {
+    for (Query* query : m_queries) {
+        delete query;
+    }
+}
+
+Query& QueryRegistry::FindOrCreate (const ComponentBitset& bitset, const std::function<void(Query&)>& populate, bool pinned) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_lookup.find(bitset);
+    if (it != m_lookup.end()) {
+        it->second->m_pinned |= pinned;
+        it->second->m_lastUse = ++m_useCounter;
+        return *it->second;
+    }
+
+    Query* query = new Query(bitset);
+    populate(*query);
+    query->m_pinned = pinned;
+    query->m_lastUse = ++m_useCounter;
+    m_queries.push_back(query);
+    m_lookup[bitset] = query;
+    if (bitset.none()) {
+        m_emptyQueries.push_back(query);
+    }
+    for (ComponentTypeId typeId = 0; typeId < ENCOSYS_MAX_COMPONENTS_; ++typeId) {
+        if (bitset[typeId]) {
+            m_componentQueries[typeId].push_back(query);
+            m_typeIdLimit = std::max(m_typeIdLimit, typeId + 1);
+        }
+    }
+    return *query;
+}
+
+void QueryRegistry::Release (uint32_t keep) {
+    std::vector<Query*> released;
+    for (Query* query : m_queries) {
+        if (!query->m_pinned) {
+            released.push_back(query);
+        }
+    }
+    if (released.size() <= keep) {
+        return;
+    }
+    // Keep the most recently used ones
+    std::sort(released.begin(), released.end(), [] (const Query* lhs, const Query* rhs) { return lhs->m_lastUse > rhs->m_lastUse; });
+    released.erase(released.begin(), released.begin() + keep);
+
+    const auto isReleased = [&released] (Query* query) {
+        return std::find(released.begin(), released.end(), query) != released.end();
+    };
+    m_queries.erase(std::remove_if(m_queries.begin(), m_queries.end(), isReleased), m_queries.end());
+    m_emptyQueries.erase(std::remove_if(m_emptyQueries.begin(), m_emptyQueries.end(), isReleased), m_emptyQueries.end());
+    for (std::vector<Query*>& queries : m_componentQueries) {
+        queries.erase(std::remove_if(queries.begin(), queries.end(), isReleased), queries.end());
+    }
+    for (Query* query : released) {
+        m_lookup.erase(query->GetBitset());
+        delete query;
+    }
+}
+
+void QueryRegistry::Sort (const std::function<uint32_t(EntityId)>& rank, bool incremental) {
+    for (Query* query : m_queries) {
+        query->Sort(rank, incremental);
+    }
+}
+
+void QueryRegistry::Clear () {
+    for (Query* query : m_queries) {
+        query->Clear();
+    }
+}
+
+template <typename TCallback>
+void QueryRegistry::ForEachOverlapping (const ComponentBitset& bitset, bool includeEmpty, TCallback&& callback) {
+    // A query listed under several of the bits is only visited the first time
+    const uint32_t visit = ++m_visitCounter;
+    for (ComponentTypeId typeId = 0; typeId < m_typeIdLimit; ++typeId) {
+        if (!bitset[typeId]) {
+            continue;
+        }
+        for (Query* query : m_componentQueries[typeId]) {
+            if (query->m_visit != visit) {
+                query->m_visit = visit;
+                callback(*query);
+            }
+        }
+    }
+    if (includeEmpty) {
+        for (Query* query : m_emptyQueries) {
+            callback(*query);
+        }
+    }
+}
+
+void QueryRegistry::InsertBatch (const EntityId* ids, uint32_t count, const ComponentBitset& bitset) {
+    ForEachOverlapping(bitset, true, [ids, count, &bitset] (Query& query) {
+        if (query.Matches(bitset)) {
+            for (uint32_t i = 0; i < count; ++i) {
+                query.Insert(ids[i]);
+            }
+        }
+    });
+}
+
+void QueryRegistry::Update (EntityId id, const ComponentBitset& oldBitset, bool oldActive, const ComponentBitset& newBitset, bool newActive) {
+    const auto update = [&] (Query& query) {
+        const bool wasMatch = oldActive && query.Matches(oldBitset);
+        const bool isMatch = newActive && query.Matches(newBitset);
+        if (wasMatch && !isMatch) {
+            query.Remove(id);
+        }
+        else if (isMatch && !wasMatch) {
+            query.Insert(id);
+        }
+    };
+    // Only the queries that include a changed component can change their match, unless the activity changed
+    if (!oldActive && !newActive) {
+        return;
+    }
+    if (oldActive == newActive) {
+        ForEachOverlapping(oldBitset ^ newBitset, false, update);
+    }
+    else {
+        ForEachOverlapping(oldBitset | newBitset, true, update);
+    }
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,204 @@
+#include "Snapshot.h"
+
+#include <cstring>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace ecs {
+
+namespace {
+
+// Pool blocks are written whole, so the buffer only has to batch the small values between them
+const std::size_t c_writeBufferBytes = 1 << 20;
+
+}
+
+SnapshotWriter::~SnapshotWriter () {
+    Close();
+}
+
+bool SnapshotWriter::Open (const char* path) {
+    Close();
+    m_file = std::fopen(path, "wb");
+    m_failed = m_file == nullptr;
+    if (m_file != nullptr) {
+        std::setvbuf(m_file, nullptr, _IOFBF, c_writeBufferBytes);
+    }
+    return !m_failed;
+}
+
+bool SnapshotWriter::Close () {
+    if (m_file != nullptr) {
+        m_failed = std::fclose(m_file) != 0 || m_failed;
+        m_file = nullptr;
+    }
+    return !m_failed;
+}
+
+void SnapshotWriter::Write (const void* data, std::size_t bytes) {
+    if (m_buffer != nullptr) {
+        const uint8_t* begin = static_cast<const uint8_t*>(data);
+        m_buffer->insert(m_buffer->end(), begin, begin + bytes);
+        return;
+    }
+    if (m_file == nullptr || m_failed || bytes == 0) {
+        return;
+    }
+    m_failed = std::fwrite(data, 1, bytes, m_file) != bytes;
+}
+
+SnapshotReader::~SnapshotReader () {
+    Close();
+}
+
+bool SnapshotReader::Open (const char* path) {
+    Close();
+    m_failed = true;
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    m_file = file;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        return false;
+    }
+    m_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (m_mapping == nullptr) {
+        return false;
+    }
+    m_data = static_cast<const uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+    if (m_data == nullptr) {
+        return false;
+    }
+    m_size = static_cast<std::size_t>(size.QuadPart);
+#else
+    const int file = open(path, O_RDONLY);
+    if (file < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(file, &info) != 0 || info.st_size <= 0) {
+        close(file);
+        return false;
+    }
+    // The mapping keeps the file alive after the descriptor is closed
+    void* data = mmap(nullptr, static_cast<std::size_t>(info.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    m_data = static_cast<const uint8_t*>(data);
+    m_size = static_cast<std::size_t>(info.st_size);
+#if defined(MADV_SEQUENTIAL)
+    madvise(data, m_size, MADV_SEQUENTIAL);
+#endif
+#endif
+    m_offset = 0;
+    m_failed = false;
+    m_mapped = true;
+    return true;
+}
+
+void SnapshotReader::Close () {
+#if defined(_WIN32)
+    if (m_mapped && m_data != nullptr) {
+        UnmapViewOfFile(m_data);
+    }
+    if (m_mapping != nullptr) {
+        CloseHandle(m_mapping);
+        m_mapping = nullptr;
+    }
+    if (m_file != nullptr) {
+        CloseHandle(m_file);
+        m_file = nullptr;
+    }
+#else
+    if (m_mapped && m_data != nullptr) {
+        munmap(const_cast<uint8_t*>(m_data), m_size);
+    }
+#endif
+    m_data = nullptr;
+    m_size = 0;
+    m_offset = 0;
+    m_mapped = false;
+}
+
+bool SnapshotReader::Read (void* data, std::size_t bytes) {
+    if (bytes > GetRemainingBytes()) {
+        return Fail();
+    }
+    if (bytes > 0) {
+        memcpy(data, m_data + m_offset, bytes);
+        m_offset += bytes;
+    }
+    return true;
+}
+
+void SnapshotHistory::SetCapacity (uint32_t capacity) {
+    m_capacity = std::max(capacity, 1u);
+    while (m_snapshots.size() > m_capacity) {
+        FoldOldest();
+    }
+}
+
+SnapshotHistory::Snapshot& SnapshotHistory::Push () {
+    m_snapshots.emplace_back();
+    m_snapshots.back().m_id = m_nextId++;
+    while (m_snapshots.size() > m_capacity) {
+        FoldOldest();
+    }
+    return m_snapshots.back();
+}
+
+// The next oldest snapshot takes every block of the oldest it did not copy again, and becomes the oldest
+void SnapshotHistory::FoldOldest () {
+    Snapshot& base = m_snapshots[0];
+    Snapshot& next = m_snapshots[1];
+    for (auto& block : base.m_blocks) {
+        if (next.m_blocks.find(block.first) == next.m_blocks.end()) {
+            next.m_blocks.emplace(block.first, std::move(block.second));
+        }
+    }
+    m_snapshots.pop_front();
+}
+
+const std::vector<uint8_t>* SnapshotHistory::FindBlock (uint32_t id, uint64_t key) const {
+    for (std::size_t i = id - GetOldestId() + 1; i-- > 0;) {
+        auto it = m_snapshots[i].m_blocks.find(key);
+        if (it != m_snapshots[i].m_blocks.end()) {
+            return &it->second;
+        }
+    }
+    return nullptr;
+}
+
+void SnapshotHistory::CollectNewerBlocks (uint32_t id, std::unordered_set<uint64_t>& keys) const {
+    for (std::size_t i = id - GetOldestId() + 1; i < m_snapshots.size(); ++i) {
+        for (const auto& block : m_snapshots[i].m_blocks) {
+            keys.insert(block.first);
+        }
+    }
+}
+
+void SnapshotHistory::DropNewer (uint32_t id) {
+    m_snapshots.resize(id - GetOldestId() + 1);
+    m_nextId = id + 1;
+}
+
+void SnapshotHistory::Clear () {
+    m_snapshots.clear();
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,56 @@
+#include "SystemScheduler.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include "System.h"
+#include "SystemRegistry.h"
+#include "ThreadPool.h"
+
+namespace ecs {
+
+void SystemScheduler::Build (const SystemRegistry& systemRegistry) {
+    const uint32_t count = systemRegistry.Count();
+    m_dependencyCounts.assign(count, 0);
+    m_dependents.assign(count, {});
+    m_roots.clear();
+
+    for (uint32_t i = 0; i < count; ++i) {
+        for (uint32_t j = 0; j < i; ++j) {
+            if (systemRegistry.GetSystemType(i).ConflictsWith(systemRegistry.GetSystemType(j))) {
+                m_dependents[j].push_back(i);
+                ++m_dependencyCounts[i];
+            }
+        }
+        if (m_dependencyCounts[i] == 0) {
+            m_roots.push_back(i);
+        }
+    }
+}
+
+void SystemScheduler::Run (ThreadPool& threadPool, SystemRegistry& systemRegistry, TimeDelta delta) const {
+    const uint32_t count = Count();
+    std::unique_ptr<std::atomic<uint32_t>[]> remainingDependencies(new std::atomic<uint32_t>[count]);
+    for (uint32_t i = 0; i < count; ++i) {
+        remainingDependencies[i] = m_dependencyCounts[i];
+    }
+    std::atomic<uint32_t> remainingSystems{count};
+
+    // Each finished system releases the dependents whose last dependency it was
+    std::function<void(uint32_t)> runSystem = [&] (uint32_t system) {
+        systemRegistry.GetSystem(system)->Update(delta);
+        for (const uint32_t dependent : m_dependents[system]) {
+            if (remainingDependencies[dependent].fetch_sub(1) == 1) {
+                threadPool.Submit([&runSystem, dependent] { runSystem(dependent); });
+            }
+        }
+        remainingSystems.fetch_sub(1, std::memory_order_release);
+    };
+
+    for (const uint32_t root : m_roots) {
+        threadPool.Submit([&runSystem, root] { runSystem(root); });
+    }
+    threadPool.Wait(remainingSystems);
+}
+
+}
\ No newline at end of file
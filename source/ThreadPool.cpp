@@ -0,0 +1,106 @@
+#include "ThreadPool.h"
+
+namespace ecs {
+
+namespace {
+
+// Identifies the pool and queue owned by the current worker thread
+thread_local const ThreadPool* t_pool = nullptr;
+thread_local uint32_t t_queueIndex = 0;
+
+}
+
+ThreadPool::ThreadPool (uint32_t workerCount) {
+    // Queue 0 is shared by threads outside the pool
+    for (uint32_t i = 0; i <= workerCount; ++i) {
+        m_queues.push_back(std::make_unique<TaskQueue>());
+    }
+    for (uint32_t i = 1; i <= workerCount; ++i) {
+        m_threads.emplace_back(&ThreadPool::WorkerMain, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool () {
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_running = false;
+    }
+    m_wake.notify_all();
+    for (std::thread& thread : m_threads) {
+        thread.join();
+    }
+}
+
+void ThreadPool::Submit (std::function<void()> task) {
+    {
+        // Taking the sleep lock orders the increment with a worker checking whether it may sleep.
+        // Counting before pushing keeps the count from ever dropping below the number of queued tasks.
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        ++m_queuedCount;
+    }
+    TaskQueue& queue = *m_queues[CurrentQueueIndex()];
+    {
+        std::lock_guard<std::mutex> lock(queue.m_mutex);
+        queue.m_tasks.push_back(std::move(task));
+    }
+    m_wake.notify_one();
+}
+
+void ThreadPool::Wait (const std::atomic<uint32_t>& counter) {
+    const uint32_t queueIndex = CurrentQueueIndex();
+    while (counter.load(std::memory_order_acquire) != 0) {
+        if (!TryRunTask(queueIndex)) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void ThreadPool::WorkerMain (uint32_t queueIndex) {
+    t_pool = this;
+    t_queueIndex = queueIndex;
+    while (true) {
+        if (TryRunTask(queueIndex)) {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        m_wake.wait(lock, [this] { return !m_running || m_queuedCount.load() > 0; });
+        if (!m_running) {
+            return;
+        }
+    }
+}
+
+bool ThreadPool::TryRunTask (uint32_t queueIndex) {
+    std::function<void()> task;
+
+    // Newest task from our own queue first, then the oldest task from any other queue
+    const uint32_t queueCount = static_cast<uint32_t>(m_queues.size());
+    for (uint32_t i = 0; i < queueCount && !task; ++i) {
+        TaskQueue& queue = *m_queues[(queueIndex + i) % queueCount];
+        std::lock_guard<std::mutex> lock(queue.m_mutex);
+        if (queue.m_tasks.empty()) {
+            continue;
+        }
+        if (i == 0) {
+            task = std::move(queue.m_tasks.back());
+            queue.m_tasks.pop_back();
+        }
+        else {
+            task = std::move(queue.m_tasks.front());
+            queue.m_tasks.pop_front();
+        }
+    }
+
+    if (!task) {
+        return false;
+    }
+    --m_queuedCount;
+    task();
+    return true;
+}
+
+uint32_t ThreadPool::CurrentQueueIndex () const {
+    return t_pool == this ? t_queueIndex : 0;
+}
+
+}
\ No newline at end of file